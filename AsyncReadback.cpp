@@ -0,0 +1,148 @@
+#include "AsyncReadback.hpp"
+#include "ImageExporter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+static const GLbitfield MAPPING_FLAGS = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+AsyncReadback::AsyncReadback(GLuint bufferCount) : slots(std::max(1u, bufferCount))
+{
+}
+
+AsyncReadback::~AsyncReadback()
+{
+    Finish();
+
+    for (auto& slot : slots)
+    {
+        if (!slot.buffer)
+            continue;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+void AsyncReadback::Reserve(Slot& slot, size_t size)
+{
+    if (slot.capacity >= size)
+        return;
+
+    // Immutable storage cannot grow, replace the buffer
+    if (slot.buffer)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+
+    glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, MAPPING_FLAGS);
+    slot.mapping = static_cast<const float*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, MAPPING_FLAGS));
+    slot.capacity = size;
+}
+
+void AsyncReadback::ReadFrame(GLuint width, GLuint height, const std::string& outFileLoc, unsigned int pngBitDepth)
+{
+    Slot& slot = slots[nextSlot];
+    nextSlot = (nextSlot + 1) % slots.size();
+
+    // The ring is full, the oldest frame has to leave the GPU and the writer before its buffer is reused
+    if (slot.state == SlotState::reading)
+        HandToWriter(slot, true);
+    WaitUntilWritten(slot);
+
+    Reserve(slot, 3 * sizeof(float) * size_t(width) * height);
+    slot.width = width;
+    slot.height = height;
+    slot.outFileLoc = outFileLoc;
+    slot.pngBitDepth = pngBitDepth;
+    slot.frameIndex = nextFrameIndex++;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.state = SlotState::reading;
+
+    // Make sure the copy is submitted even if nothing else is rendered for a while
+    glFlush();
+}
+
+void AsyncReadback::Poll()
+{
+    while (true)
+    {
+        Slot* oldest = nullptr;
+        for (auto& slot : slots)
+        {
+            if (slot.state == SlotState::reading && (!oldest || slot.frameIndex < oldest->frameIndex))
+                oldest = &slot;
+        }
+
+        if (!oldest || !HandToWriter(*oldest, false))
+            return;
+    }
+}
+
+void AsyncReadback::Finish()
+{
+    std::vector<Slot*> inFlight;
+    for (auto& slot : slots)
+    {
+        if (slot.state == SlotState::reading)
+            inFlight.push_back(&slot);
+    }
+    std::sort(inFlight.begin(), inFlight.end(), [](const Slot* a, const Slot* b) { return a->frameIndex < b->frameIndex; });
+
+    for (auto slot : inFlight)
+        HandToWriter(*slot, true);
+
+    writer.Wait();
+}
+
+bool AsyncReadback::HandToWriter(Slot& slot, bool wait)
+{
+    // Wait in one second steps, a single infinite timeout is not portable
+    const GLuint64 timeout = wait ? 1000000000 : 0;
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    while (wait && status == GL_TIMEOUT_EXPIRED)
+        status = glClientWaitSync(slot.fence, 0, timeout);
+
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    if (status == GL_WAIT_FAILED)
+        std::cerr << "Waiting for the readback of '" << slot.outFileLoc << "' failed, the image may be incomplete." << std::endl;
+
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    slot.state = SlotState::writing;
+
+    // The coherent mapping is safe to read from any thread once the fence has signaled
+    Slot* writing = &slot;
+    writer.Submit([this, writing]()
+        {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            const bool written = ImageExporter::Export(writing->outFileLoc, writing->width, writing->height, writing->mapping, writing->pngBitDepth);
+            auto endTime = std::chrono::high_resolution_clock::now();
+
+            std::lock_guard<std::mutex> lock(slotMutex);
+            totalWriteTime += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+            if (!written)
+                ++failedWrites;
+            writing->state = SlotState::free;
+            slotWritten.notify_all();
+        });
+    return true;
+}
+
+void AsyncReadback::WaitUntilWritten(Slot& slot)
+{
+    std::unique_lock<std::mutex> lock(slotMutex);
+    slotWritten.wait(lock, [&slot]() { return slot.state == SlotState::free; });
+}
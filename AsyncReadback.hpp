@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ThreadPool.hpp"
+
+// Pipelined frame export. Frames are copied into a ring of persistently mapped pixel buffer objects,
+// and once a copy's fence signals the frame is encoded on a writer thread straight from the mapping.
+// The render thread only blocks when every buffer is still in flight.
+// Every method, including the destructor, must be called on the thread that owns the GL context.
+class AsyncReadback
+{
+public:
+    explicit AsyncReadback(GLuint bufferCount = 3);
+    ~AsyncReadback();
+
+    AsyncReadback(const AsyncReadback&) = delete;
+    AsyncReadback& operator=(const AsyncReadback&) = delete;
+
+    // Starts copying the bound read framebuffer, the frame is exported to outFileLoc when the copy completes.
+    // The format follows the file extension, see ImageExporter::ForFile.
+    void ReadFrame(GLuint width, GLuint height, const std::string& outFileLoc, unsigned int pngBitDepth = 8);
+
+    // Hands every finished copy to the writer thread without blocking
+    void Poll();
+
+    // Blocks until every queued frame has been exported
+    void Finish();
+
+    // Time spent encoding and writing files on the writer thread, only stable after Finish()
+    double GetTotalWriteTime() const { return totalWriteTime; }
+    // Frames whose file could not be written, only stable after Finish()
+    size_t GetFailedWriteCount() const { return failedWrites; }
+
+private:
+    enum class SlotState { free, reading, writing };
+
+    struct Slot
+    {
+        GLuint buffer = 0;
+        size_t capacity = 0;
+        const float* mapping = nullptr;
+        GLsync fence = 0;
+        GLuint width = 0, height = 0;
+        std::string outFileLoc;
+        unsigned int pngBitDepth = 8;
+        // Only the writer thread moves a slot from writing back to free
+        std::atomic<SlotState> state{ SlotState::free };
+        // Submission order, copies are handed to the writer oldest first
+        size_t frameIndex = 0;
+    };
+
+    void Reserve(Slot& slot, size_t size);
+    // Returns false if the copy has not finished and wait is false
+    bool HandToWriter(Slot& slot, bool wait);
+    void WaitUntilWritten(Slot& slot);
+
+    std::vector<Slot> slots;
+    size_t nextSlot = 0;
+    size_t nextFrameIndex = 0;
+
+    // One worker taking the oldest write first, so files are written in frame order
+    ThreadPool writer{ 1, ThreadPool::Order::oldestFirst };
+    std::mutex slotMutex;
+    std::condition_variable slotWritten;
+    double totalWriteTime = 0;
+    size_t failedWrites = 0;
+};
@@ -0,0 +1,225 @@
+#include "BVH.hpp"
+#include <algorithm>
+
+void AABB::Grow(const glm::vec3& point)
+{
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void AABB::Grow(const AABB& other)
+{
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+float AABB::SurfaceArea() const
+{
+    if (IsEmpty())
+        return 0.f;
+
+    glm::vec3 extent = max - min;
+    return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+AABB AABB::Transformed(const glm::mat4& transform) const
+{
+    if (IsEmpty())
+        return *this;
+
+    // Same projection of the extents onto each axis as FromObject
+    glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1.f));
+    glm::vec3 halfExtent = (max - min) * 0.5f;
+    glm::vec3 extent{ 0.f, 0.f, 0.f };
+    for (int axis = 0; axis < 3; ++axis)
+        extent += glm::abs(glm::vec3(transform[axis])) * halfExtent[axis];
+
+    AABB bounds;
+    bounds.min = center - extent;
+    bounds.max = center + extent;
+    return bounds;
+}
+
+AABB AABB::FromObject(const ObjectData& obj)
+{
+    // Local half extents of the unit primitives intersected in shade_and_reflect.glsl
+    float halfExtent = 1.f;
+    switch (obj.type)
+    {
+    case ObjectData::PrimativeType::sphere: halfExtent = 1.f; break;
+    case ObjectData::PrimativeType::box: halfExtent = 0.5f; break;
+    // Bounded by their mesh instead, see TwoLevelBVH
+    case ObjectData::PrimativeType::mesh: break;
+    }
+
+    // Transform the local box by projecting its extents onto each world axis
+    glm::vec3 center = glm::vec3(obj.mv[3]);
+    glm::vec3 extent{ 0.f, 0.f, 0.f };
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        glm::vec3 column = glm::vec3(obj.mv[axis]);
+        extent += glm::abs(column) * halfExtent;
+    }
+
+    AABB bounds;
+    bounds.min = center - extent;
+    bounds.max = center + extent;
+    return bounds;
+}
+
+BVH::BVH(const std::vector<ObjectData>& objs)
+{
+    std::vector<AABB> primBounds;
+    primBounds.reserve(objs.size());
+    for (auto& obj : objs)
+        primBounds.push_back(AABB::FromObject(obj));
+
+    Build(primBounds);
+}
+
+BVH::BVH(const std::vector<AABB>& primBounds)
+{
+    Build(primBounds);
+}
+
+void BVH::Build(const std::vector<AABB>& primBounds)
+{
+    const GLuint primCount = GLuint(primBounds.size());
+
+    nodes.clear();
+    nodes.reserve(std::max(1u, 2 * primCount));
+    primIndices.resize(primCount);
+    for (GLuint ii = 0; ii < primCount; ++ii)
+        primIndices[ii] = ii;
+
+    std::vector<glm::vec3> centroids(primCount);
+    for (GLuint ii = 0; ii < primCount; ++ii)
+        centroids[ii] = primBounds[ii].Center();
+
+    struct BuildTask {
+        GLuint nodeIndex, first, count, depth;
+    };
+    std::vector<BuildTask> tasks;
+
+    nodes.push_back(BVHNode());
+    tasks.push_back({ 0, 0, primCount, 1 });
+    depth = 0;
+
+    while (!tasks.empty())
+    {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+        depth = std::max(depth, task.depth);
+
+        AABB bounds, centroidBounds;
+        for (GLuint ii = task.first; ii < task.first + task.count; ++ii)
+        {
+            bounds.Grow(primBounds[primIndices[ii]]);
+            centroidBounds.Grow(centroids[primIndices[ii]]);
+        }
+
+        BVHNode& node = nodes[task.nodeIndex];
+        node.boundsMin = bounds.min;
+        node.boundsMax = bounds.max;
+        node.leftOrFirst = task.first;
+        node.primCount = task.count;
+
+        // Without primitives the root stays an interior node linking back to itself, see IsEmptyHierarchy
+        if (task.count <= 1)
+            continue;
+
+        // Evaluate the SAH cost of splitting between every pair of bins on every axis
+        struct Bin {
+            AABB bounds;
+            GLuint count = 0;
+        };
+
+        int bestAxis = -1;
+        GLuint bestSplit = 0;
+        float bestCost = 3.402823466e+38f;
+        glm::vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (centroidExtent[axis] <= 0.f)
+                continue;
+
+            Bin bins[BIN_COUNT];
+            const float binScale = float(BIN_COUNT) / centroidExtent[axis];
+            for (GLuint ii = task.first; ii < task.first + task.count; ++ii)
+            {
+                GLuint prim = primIndices[ii];
+                GLuint bin = std::min(BIN_COUNT - 1, GLuint((centroids[prim][axis] - centroidBounds.min[axis]) * binScale));
+                bins[bin].bounds.Grow(primBounds[prim]);
+                ++bins[bin].count;
+            }
+
+            float leftArea[BIN_COUNT - 1];
+            GLuint leftCount[BIN_COUNT - 1];
+            AABB sweep;
+            GLuint sweepCount = 0;
+            for (GLuint ii = 0; ii < BIN_COUNT - 1; ++ii)
+            {
+                sweep.Grow(bins[ii].bounds);
+                sweepCount += bins[ii].count;
+                leftArea[ii] = sweep.SurfaceArea();
+                leftCount[ii] = sweepCount;
+            }
+
+            sweep = AABB();
+            sweepCount = 0;
+            for (GLuint ii = BIN_COUNT - 1; ii > 0; --ii)
+            {
+                sweep.Grow(bins[ii].bounds);
+                sweepCount += bins[ii].count;
+
+                if (leftCount[ii - 1] == 0 || sweepCount == 0)
+                    continue;
+
+                float cost = leftCount[ii - 1] * leftArea[ii - 1] + sweepCount * sweep.SurfaceArea();
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = ii;
+                }
+            }
+        }
+
+        // Intersection and traversal are weighted equally
+        const float leafCost = task.count * bounds.SurfaceArea();
+        const float splitCost = bounds.SurfaceArea() + bestCost;
+        if (task.count <= MAX_LEAF_SIZE && (bestAxis < 0 || leafCost <= splitCost))
+            continue;
+
+        GLuint* first = primIndices.data() + task.first;
+        GLuint* last = first + task.count;
+        GLuint* middle;
+        if (bestAxis >= 0)
+        {
+            const float binScale = float(BIN_COUNT) / centroidExtent[bestAxis];
+            const float splitMin = centroidBounds.min[bestAxis];
+            middle = std::partition(first, last, [&](GLuint prim)
+                {
+                    return std::min(BIN_COUNT - 1, GLuint((centroids[prim][bestAxis] - splitMin) * binScale)) < bestSplit;
+                });
+        }
+        else
+        {
+            // Every centroid coincides, split the range in half to keep leaves small
+            middle = first + task.count / 2;
+        }
+
+        GLuint leftCountTotal = GLuint(middle - first);
+        GLuint leftIndex = GLuint(nodes.size());
+        nodes.push_back(BVHNode());
+        nodes.push_back(BVHNode());
+
+        // 'node' may have been invalidated by the pushes above
+        nodes[task.nodeIndex].leftOrFirst = leftIndex;
+        nodes[task.nodeIndex].primCount = 0;
+
+        tasks.push_back({ leftIndex, task.first, leftCountTotal, task.depth + 1 });
+        tasks.push_back({ leftIndex + 1, task.first + leftCountTotal, task.count - leftCountTotal, task.depth + 1 });
+    }
+}
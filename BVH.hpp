@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "ObjectData.hpp"
+
+struct AABB
+{
+    glm::vec3 min{ 3.402823466e+38f }, max{ -3.402823466e+38f };
+
+    void Grow(const glm::vec3& point);
+    void Grow(const AABB& other);
+
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    float SurfaceArea() const;
+    bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+    // Bounds of this box after an affine transform, empty bounds stay empty
+    AABB Transformed(const glm::mat4& transform) const;
+
+    // World space bounds of an object's unit primitive after its modelview transform, meshes are bounded by MeshLibrary instead
+    static AABB FromObject(const ObjectData& obj);
+};
+
+// Flattened node, laid out to match the std430 'BVHNode' struct in shade_and_reflect.glsl.
+// Interior nodes store the index of their left child, the right child always follows it.
+// Leaves store the first entry of their range in the primitive index list.
+struct BVHNode
+{
+    glm::vec3 boundsMin;
+    GLuint leftOrFirst;
+    glm::vec3 boundsMax;
+    GLuint primCount; // 0 for interior nodes
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode must match the std430 layout used by the shader");
+
+// A hierarchy over no primitives is a lone interior node whose child link points back at itself, it has no
+// children to visit and traversals skip it
+inline bool IsEmptyHierarchy(const BVHNode& root, GLuint rootIndex)
+{
+    return root.primCount == 0 && root.leftOrFirst == rootIndex;
+}
+
+// Size of the traversal stacks in shade_and_reflect.glsl and CPURenderer, deeper hierarchies skip objects
+static const GLuint BVH_STACK_SIZE = 64;
+
+// Bounding volume hierarchy built with a binned surface area heuristic.
+class BVH
+{
+public:
+    BVH() = default;
+    explicit BVH(const std::vector<ObjectData>& objs);
+    explicit BVH(const std::vector<AABB>& primBounds);
+
+    const std::vector<BVHNode>& GetNodes() const { return nodes; }
+    const std::vector<GLuint>& GetPrimitiveIndices() const { return primIndices; }
+
+    // Deepest root to leaf path, traversal stacks must hold at least this many entries
+    GLuint GetDepth() const { return depth; }
+
+private:
+    void Build(const std::vector<AABB>& primBounds);
+
+    static const GLuint BIN_COUNT = 16;
+    static const GLuint MAX_LEAF_SIZE = 4;
+
+    std::vector<BVHNode> nodes;
+    std::vector<GLuint> primIndices;
+    GLuint depth = 0;
+};
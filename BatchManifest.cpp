@@ -0,0 +1,31 @@
+#include "BatchManifest.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+std::vector<BatchJob> LoadBatchManifest(const std::string& manifestFileLoc)
+{
+    std::ifstream infile(manifestFileLoc);
+    if (!infile.is_open())
+        throw std::runtime_error("Unable to open batch manifest '" + manifestFileLoc + "'.");
+
+    std::vector<BatchJob> jobs;
+    std::string line;
+    size_t lineNum = 0;
+    while (std::getline(infile, line)) {
+        ++lineNum;
+
+        std::istringstream tokens(line);
+        BatchJob job;
+        if (!(tokens >> job.sceneFileLoc) || job.sceneFileLoc[0] == '#')
+            continue;
+
+        std::string extra;
+        if (!(tokens >> job.outFileLoc) || (tokens >> extra))
+            throw std::runtime_error("Error parsing batch manifest at line " + std::to_string(lineNum) + ":\n\texpected 2 arguments\n\t<scene file> <output file>");
+
+        jobs.push_back(job);
+    }
+
+    return jobs;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct BatchJob
+{
+    std::string sceneFileLoc;
+    std::string outFileLoc;
+};
+
+// Reads a batch manifest: one '<scene file> <output file>' pair per line.
+// Blank lines and lines starting with '#' are ignored.
+// Throws std::runtime_error naming the offending line if the manifest is malformed.
+std::vector<BatchJob> LoadBatchManifest(const std::string& manifestFileLoc);
@@ -0,0 +1,95 @@
+#include "BenchmarkReport.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+static std::string EscapeJson(const std::string& value)
+{
+    std::string escaped;
+    for (char c : value) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        // Control characters cannot appear unescaped, none are expected in names or renderer strings
+        if ((unsigned char)c < 0x20)
+            continue;
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Missing stages are written as null
+static void WriteTime(std::ostream& out, double time)
+{
+    if (time < 0)
+        out << "null";
+    else
+        out << time;
+}
+
+static void WriteFrameStats(std::ostream& out, const std::vector<double>& frameTimes)
+{
+    if (frameTimes.empty()) {
+        out << "null";
+        return;
+    }
+
+    std::vector<double> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double time : sorted)
+        total += time;
+    const size_t middle = sorted.size() / 2;
+    const double median = sorted.size() % 2 ? sorted[middle] : 0.5 * (sorted[middle - 1] + sorted[middle]);
+
+    out << "{ \"mean\": " << total / sorted.size() << ", \"median\": " << median
+        << ", \"min\": " << sorted.front() << ", \"max\": " << sorted.back() << ", \"frames\": [";
+    for (size_t ii = 0; ii < frameTimes.size(); ++ii)
+        out << (ii ? ", " : "") << frameTimes[ii];
+    out << "] }";
+}
+
+void BenchmarkReport::Write(const std::string& outFileLoc) const
+{
+    std::ofstream out(outFileLoc);
+    if (!out.is_open())
+        throw std::runtime_error("Unable to write benchmark results '" + outFileLoc + "'.");
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\n"
+        << "  \"backend\": \"" << EscapeJson(backend) << "\",\n"
+        << "  \"device\": \"" << EscapeJson(device) << "\",\n"
+        << "  \"width\": " << width << ",\n"
+        << "  \"height\": " << height << ",\n"
+        << "  \"samples\": " << samples << ",\n"
+        << "  \"lightSamples\": " << lightSamples << ",\n"
+        << "  \"setupMs\": " << setupTime << ",\n"
+        << "  \"scenes\": [";
+
+    for (size_t ii = 0; ii < results.size(); ++ii) {
+        const BenchmarkResult& result = results[ii];
+        out << (ii ? ",\n" : "\n")
+            << "    {\n"
+            << "      \"name\": \"" << EscapeJson(result.name) << "\",\n"
+            << "      \"spheres\": " << result.params.sphereCount << ",\n"
+            << "      \"boxes\": " << result.params.boxCount << ",\n"
+            << "      \"lights\": " << result.params.lightCount << ",\n"
+            << "      \"reflectiveFraction\": " << result.params.reflectiveFraction << ",\n"
+            << "      \"seed\": " << result.params.seed << ",\n"
+            << "      \"objects\": " << result.objectCount << ",\n"
+            << "      \"bvhNodes\": " << result.bvhNodeCount << ",\n"
+            << "      \"parseMs\": " << result.parseTime << ",\n"
+            << "      \"buildMs\": " << result.buildTime << ",\n"
+            << "      \"uploadMs\": " << result.uploadTime << ",\n"
+            << "      \"shaderCompileMs\": ";
+        WriteTime(out, result.shaderCompileTime);
+        out << ",\n      \"frameMs\": ";
+        WriteFrameStats(out, result.frameTimes);
+        out << ",\n      \"exportMs\": " << result.exportTime << "\n"
+            << "    }";
+    }
+    out << "\n  ]\n}\n";
+
+    if (!out)
+        throw std::runtime_error("Unable to write benchmark results '" + outFileLoc + "'.");
+}
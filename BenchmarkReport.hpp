@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "SceneGenerator.hpp"
+
+// Timings of one generated scene, in milliseconds. Stages the backend does not have are negative.
+struct BenchmarkResult
+{
+    std::string name;
+    GeneratedSceneParams params;
+    size_t objectCount = 0, bvhNodeCount = 0;
+
+    // Reading the text file, then building the BVH and light tree from it
+    double parseTime = 0, buildTime = 0;
+    // Scene buffers, without the shader variant
+    double uploadTime = 0;
+    // Linking the scene's shader variant, 0 if an earlier scene already linked it
+    double shaderCompileTime = -1;
+    // Every timed frame, after a warm-up frame
+    std::vector<double> frameTimes;
+    // Readback where there is one, encoding and writing
+    double exportTime = 0;
+};
+
+struct BenchmarkReport
+{
+    // "cpu" or "opengl"
+    std::string backend;
+    // The OpenGL renderer string, or the CPU thread count
+    std::string device;
+    unsigned int width = 0, height = 0, samples = 1, lightSamples = 0;
+    // Creating the context and worker threads, once for the whole run
+    double setupTime = 0;
+    std::vector<BenchmarkResult> results;
+
+    // Writes the report as JSON, so runs of different versions can be compared by scripts.
+    // Throws std::runtime_error if the file cannot be written.
+    void Write(const std::string& outFileLoc) const;
+};
@@ -0,0 +1,216 @@
+#include "BinaryScene.hpp"
+#include "MappedFile.hpp"
+#include "PackedSceneData.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static const char MAGIC[4] = { 'R', 'T', 'S', 'C' };
+
+static uint64_t AlignUp(uint64_t offset)
+{
+    return (offset + BinaryScene::SECTION_ALIGNMENT - 1) / BinaryScene::SECTION_ALIGNMENT * BinaryScene::SECTION_ALIGNMENT;
+}
+
+bool BinaryScene::IsBinaryScene(const std::string& fileLoc)
+{
+    const std::string extension = ".rtscene";
+    return fileLoc.size() >= extension.size() && fileLoc.compare(fileLoc.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+void BinaryScene::Write(const std::string& fileLoc, const OpenGLModel& model)
+{
+    const std::vector<PackedMaterial> materials(model.materials.begin(), model.materials.end());
+    const std::vector<PackedLight> lights(model.lights.begin(), model.lights.end());
+    const auto& instances = model.bvh.GetInstances();
+    const auto& nodes = model.bvh.GetNodes();
+    const auto& primIndices = model.bvh.GetPrimitiveIndices();
+    const auto& meshes = model.meshes;
+
+    BinarySceneHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.maxBounces = model.MAX_BOUNCES;
+    header.topLevelDepth = model.bvh.GetTopLevelDepth();
+    header.bottomLevelDepth = model.bvh.GetBottomLevelDepth();
+    header.meshDepth = meshes.GetDepth();
+    for (int ii = 0; ii < 3; ++ii) {
+        header.cameraPosition[ii] = model.camera.position[ii];
+        header.cameraTarget[ii] = model.camera.target[ii];
+        header.cameraUp[ii] = model.camera.up[ii];
+    }
+    header.cameraFovDegrees = model.camera.fovDegrees;
+
+    // Sections in file order, each starting on an aligned offset
+    struct SectionData { BinarySceneHeader::Section& section; const void* data; uint64_t count, stride; };
+    SectionData sections[] = {
+        { header.materials, materials.data(), materials.size(), sizeof(PackedMaterial) },
+        { header.objects, model.objs.data(), model.objs.size(), sizeof(ObjectData) },
+        { header.lights, lights.data(), lights.size(), sizeof(PackedLight) },
+        { header.instances, instances.data(), instances.size(), sizeof(InstanceData) },
+        { header.bvhNodes, nodes.data(), nodes.size(), sizeof(BVHNode) },
+        { header.bvhPrimitives, primIndices.data(), primIndices.size(), sizeof(GLuint) },
+        { header.meshVertices, meshes.GetVertices().data(), meshes.GetVertices().size(), sizeof(MeshVertex) },
+        { header.meshIndices, meshes.GetIndices().data(), meshes.GetIndices().size(), sizeof(GLuint) },
+        { header.meshNodes, meshes.GetNodes().data(), meshes.GetNodes().size(), sizeof(BVHNode) },
+    };
+
+    uint64_t fileSize = sizeof(BinarySceneHeader);
+    for (auto& section : sections) {
+        section.section.offset = AlignUp(fileSize);
+        section.section.count = section.count;
+        fileSize = section.section.offset + section.count * section.stride;
+    }
+
+    // Created zeroed, the padding between sections stays that way
+    MappedFile file = MappedFile::Create(fileLoc, size_t(fileSize));
+    char* data = file.GetWritableData();
+    std::memcpy(data, &header, sizeof(header));
+    for (auto& section : sections) {
+        if (section.count > 0)
+            std::memcpy(data + section.section.offset, section.data, size_t(section.count * section.stride));
+    }
+    file.Close();
+}
+
+// Returns the section's elements, checking that they lie within the file
+template<typename T>
+static const T* GetSection(const MappedFile& file, const BinarySceneHeader::Section& section, const std::string& fileLoc)
+{
+    const uint64_t fileSize = file.GetSize();
+    if (section.offset % BinaryScene::SECTION_ALIGNMENT != 0 || section.offset > fileSize
+        || section.count > (fileSize - section.offset) / sizeof(T))
+        throw std::runtime_error("Scene file '" + fileLoc + "' is truncated or corrupt.");
+
+    return reinterpret_cast<const T*>(file.GetData() + section.offset);
+}
+
+// Whether traversal stays within the node and primitive arrays from the node. Interior nodes always come
+// before their children, which also rules out cycles. Only a root that traversal skips may be an empty hierarchy,
+// see IsEmptyHierarchy, children and placed BLAS roots are entered without that check.
+static bool IsValidNode(const BVHNode& node, uint64_t index, uint64_t nodeEnd, uint64_t primitiveCount, bool skippedIfEmpty)
+{
+    if (node.primCount > 0)
+        return uint64_t(node.leftOrFirst) + node.primCount <= primitiveCount;
+
+    if (skippedIfEmpty && IsEmptyHierarchy(node, GLuint(index)))
+        return true;
+
+    return node.leftOrFirst > index && uint64_t(node.leftOrFirst) + 1 < nodeEnd;
+}
+
+std::unique_ptr<OpenGLModel> BinaryScene::Read(const std::string& fileLoc)
+{
+    MappedFile file;
+    try {
+        file = MappedFile::OpenRead(fileLoc);
+    }
+    catch (const std::exception&) {
+        throw std::runtime_error("Scene file '" + fileLoc + "' could not be found.");
+    }
+
+    BinarySceneHeader header;
+    if (file.GetSize() < sizeof(header))
+        throw std::runtime_error("Scene file '" + fileLoc + "' is not a compiled scene.");
+    std::memcpy(&header, file.GetData(), sizeof(header));
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error("Scene file '" + fileLoc + "' is not a compiled scene.");
+    if (header.version != VERSION)
+        throw std::runtime_error("Scene file '" + fileLoc + "' was compiled with format version " + std::to_string(header.version)
+            + ", expected version " + std::to_string(VERSION) + ". Compile it again from the text scene.");
+
+    const PackedMaterial* materials = GetSection<PackedMaterial>(file, header.materials, fileLoc);
+    const ObjectData* objs = GetSection<ObjectData>(file, header.objects, fileLoc);
+    const PackedLight* lights = GetSection<PackedLight>(file, header.lights, fileLoc);
+    const InstanceData* instances = GetSection<InstanceData>(file, header.instances, fileLoc);
+    const BVHNode* nodes = GetSection<BVHNode>(file, header.bvhNodes, fileLoc);
+    const GLuint* primIndices = GetSection<GLuint>(file, header.bvhPrimitives, fileLoc);
+    const MeshVertex* meshVertices = GetSection<MeshVertex>(file, header.meshVertices, fileLoc);
+    const GLuint* meshIndices = GetSection<GLuint>(file, header.meshIndices, fileLoc);
+    const BVHNode* meshNodes = GetSection<BVHNode>(file, header.meshNodes, fileLoc);
+
+    // Objects, instances, meshes and the BVH are copied in bulk, only the few materials and lights are converted
+    std::vector<Material> modelMaterials;
+    modelMaterials.reserve(size_t(header.materials.count));
+    for (uint64_t ii = 0; ii < header.materials.count; ++ii)
+        modelMaterials.push_back(materials[ii].ToMaterial());
+
+    std::vector<Light> modelLights;
+    modelLights.reserve(size_t(header.lights.count));
+    for (uint64_t ii = 0; ii < header.lights.count; ++ii)
+        modelLights.push_back(lights[ii].ToLight());
+
+    std::vector<ObjectData> modelObjs(objs, objs + header.objects.count);
+    for (const ObjectData& obj : modelObjs) {
+        if (obj.materialIndex >= modelMaterials.size() || (obj.type == ObjectData::PrimativeType::mesh && obj.meshRoot >= header.meshNodes.count))
+            throw std::runtime_error("Scene file '" + fileLoc + "' is truncated or corrupt.");
+    }
+
+    // The shader indexes vertices with these unchecked
+    for (uint64_t ii = 0; ii < header.meshIndices.count; ++ii) {
+        if (meshIndices[ii] >= header.meshVertices.count)
+            throw std::runtime_error("Scene file '" + fileLoc + "' is truncated or corrupt.");
+    }
+    MeshLibrary meshes(std::vector<MeshVertex>(meshVertices, meshVertices + header.meshVertices.count),
+        std::vector<GLuint>(meshIndices, meshIndices + header.meshIndices.count),
+        std::vector<BVHNode>(meshNodes, meshNodes + header.meshNodes.count), header.meshDepth);
+
+    // The renderers walk every hierarchy without checking its links
+    for (uint64_t ii = 0; ii < header.meshNodes.count; ++ii) {
+        // Meshes always have faces, so no mesh hierarchy is empty
+        if (!IsValidNode(meshNodes[ii], ii, header.meshNodes.count, header.meshIndices.count / 3, false))
+            throw std::runtime_error("Scene file '" + fileLoc + "' is truncated or corrupt.");
+    }
+
+    std::vector<InstanceData> modelInstances(instances, instances + header.instances.count);
+    // The TLAS comes first, starting at node 0, and ends where the first BLAS begins.
+    // Only the TLAS root and the roots of unplaced prototypes are skipped when empty, every other node is entered.
+    uint64_t topLevelEnd = header.bvhNodes.count;
+    std::vector<bool> entered(size_t(header.bvhNodes.count), false);
+    for (const InstanceData& instance : modelInstances) {
+        if (instance.blasRoot >= header.bvhNodes.count)
+            throw std::runtime_error("Scene file '" + fileLoc + "' is truncated or corrupt.");
+        topLevelEnd = std::min(topLevelEnd, uint64_t(instance.blasRoot));
+        entered[instance.blasRoot] = true;
+    }
+    if (topLevelEnd == 0)
+        throw std::runtime_error("Scene file '" + fileLoc + "' is truncated or corrupt.");
+
+    for (uint64_t ii = 0; ii < header.bvhNodes.count; ++ii) {
+        const bool topLevel = ii < topLevelEnd;
+        if (!IsValidNode(nodes[ii], ii, topLevel ? topLevelEnd : header.bvhNodes.count, header.bvhPrimitives.count, !entered[ii]))
+            throw std::runtime_error("Scene file '" + fileLoc + "' is truncated or corrupt.");
+
+        // Parents come first, so both children are marked before the loop reaches them
+        if (nodes[ii].primCount == 0 && !IsEmptyHierarchy(nodes[ii], GLuint(ii))) {
+            entered[nodes[ii].leftOrFirst] = true;
+            entered[nodes[ii].leftOrFirst + 1] = true;
+        }
+
+        // TLAS leaves hold instances, BLAS leaves hold objects
+        const uint64_t primitiveEnd = topLevel ? header.instances.count : header.objects.count;
+        for (uint64_t prim = nodes[ii].leftOrFirst; prim < uint64_t(nodes[ii].leftOrFirst) + nodes[ii].primCount; ++prim) {
+            if (primIndices[prim] >= primitiveEnd)
+                throw std::runtime_error("Scene file '" + fileLoc + "' is truncated or corrupt.");
+        }
+    }
+
+    if (std::max({ header.topLevelDepth, header.bottomLevelDepth, header.meshDepth }) > BVH_STACK_SIZE)
+        throw std::runtime_error("Scene file '" + fileLoc + "' has a BVH deeper than the " + std::to_string(BVH_STACK_SIZE)
+            + " levels the renderers can traverse.");
+
+    TwoLevelBVH bvh(std::move(modelInstances), std::vector<BVHNode>(nodes, nodes + header.bvhNodes.count),
+        std::vector<GLuint>(primIndices, primIndices + header.bvhPrimitives.count), header.topLevelDepth, header.bottomLevelDepth);
+
+    Camera camera;
+    for (int ii = 0; ii < 3; ++ii) {
+        camera.position[ii] = header.cameraPosition[ii];
+        camera.target[ii] = header.cameraTarget[ii];
+        camera.up[ii] = header.cameraUp[ii];
+    }
+    camera.fovDegrees = header.cameraFovDegrees;
+
+    return std::unique_ptr<OpenGLModel>(new OpenGLModel(header.maxBounces, std::move(modelMaterials), std::move(modelObjs), std::move(modelLights), std::move(meshes), std::move(bvh),
+        camera));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "OpenGLModel.h"
+
+// Compiled '.rtscene' form of a scene file, written by '--compile'. Everything the text loader derives
+// (inverted transforms, interned materials, instances, both BVH levels, loaded meshes, the camera) is stored ready to use, each section in the layout
+// of its shader storage buffer, so loading is a memory map and a bulk copy per array.
+//
+// Layout, little-endian:
+//   BinarySceneHeader
+//   PackedMaterial[materials.count]
+//   ObjectData[objects.count]
+//   PackedLight[lights.count]
+//   InstanceData[instances.count]
+//   BVHNode[bvhNodes.count]
+//   GLuint[bvhPrimitives.count]
+//   MeshVertex[meshVertices.count]
+//   GLuint[meshIndices.count]
+//   BVHNode[meshNodes.count]
+// Sections start at multiples of SECTION_ALIGNMENT, a valid storage buffer offset alignment on every
+// driver, so the file can also be uploaded as one buffer and bound by range.
+struct BinarySceneHeader
+{
+    struct Section
+    {
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    char magic[4];
+    uint32_t version;
+    uint32_t maxBounces;
+    uint32_t topLevelDepth;
+    uint32_t bottomLevelDepth;
+    uint32_t meshDepth;
+    Section materials, objects, lights, instances, bvhNodes, bvhPrimitives;
+    Section meshVertices, meshIndices, meshNodes;
+    float cameraPosition[3], cameraTarget[3], cameraUp[3];
+    float cameraFovDegrees;
+};
+static_assert(sizeof(BinarySceneHeader) == 208, "BinarySceneHeader is written to disk as-is");
+
+class BinaryScene
+{
+public:
+    // Bumped whenever the layout of the header or any section changes
+    static const uint32_t VERSION = 4;
+    static const uint64_t SECTION_ALIGNMENT = 256;
+
+    // Whether the file name has the '.rtscene' extension
+    static bool IsBinaryScene(const std::string& fileLoc);
+
+    // Throws std::runtime_error if the file cannot be written
+    static void Write(const std::string& fileLoc, const OpenGLModel& model);
+    // Throws std::runtime_error for missing, truncated or other version files
+    static std::unique_ptr<OpenGLModel> Read(const std::string& fileLoc);
+};
@@ -0,0 +1,658 @@
+#include "CPURenderer.hpp"
+#include "SampleJitter.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Everything below intentionally follows shade_and_reflect.glsl line for line so both
+// backends produce the same image. Keep the two in sync when changing either one.
+
+static const float MAX_FLOAT = 3.402823466e+38f;
+
+// Work done for the sample being traced on this thread, the counts the GLSL cost output writes
+struct SampleCost {
+    GLuint raycasts = 0, shadowRays = 0, tests = 0;
+};
+static thread_local SampleCost sampleCost;
+
+// PCG hash, see Jarzynski and Olano, "Hash Functions for GPU Rendering"
+static GLuint PcgHash(GLuint value)
+{
+    GLuint state = value * 747796405u + 2891336453u;
+    GLuint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Uniform in [0, 1), advances the state
+static float RandomFloat(GLuint& rngState)
+{
+    rngState = PcgHash(rngState);
+    return float(rngState >> 8u) * (1.f / 16777216.f);
+}
+
+static float Sign(float value)
+{
+    return float((0.f < value) - (value < 0.f));
+}
+
+static bool IntersectsWithBoxSide(float& tMin, float& tMax, float start, float dir)
+{
+    float t1 = (-0.5f - start);
+    float t2 = (0.5f - start);
+    if (dir == 0) {
+        // no intersection
+        if (Sign(t2) == Sign(t1)) return false;
+
+        tMin = -MAX_FLOAT;
+        tMax = MAX_FLOAT;
+        return true;
+    }
+
+    t1 /= dir;
+    t2 /= dir;
+
+    if (dir < 0) {
+        tMin = std::min(t1, t2);
+        tMax = std::max(t1, t2);
+    }
+    else {
+        tMin = t1;
+        tMax = t2;
+    }
+
+    return true;
+}
+
+static bool IntersectsBounds(const BVHNode& node, const glm::vec3& start, const glm::vec3& invDirection, float maxTime, float& entryTime)
+{
+    ++sampleCost.tests;
+    glm::vec3 t1 = (node.boundsMin - start) * invDirection;
+    glm::vec3 t2 = (node.boundsMax - start) * invDirection;
+    glm::vec3 tNear = glm::min(t1, t2);
+    glm::vec3 tFar = glm::max(t1, t2);
+
+    entryTime = std::max(std::max(tNear.x, tNear.y), tNear.z);
+    float exitTime = std::min(std::min(tFar.x, tFar.y), tFar.z);
+
+    return entryTime <= exitTime && exitTime >= 0 && entryTime <= maxTime;
+}
+
+CPURenderer::CPURenderer(OpenGLModel& model, unsigned int threadCount) : model(&model), pool(threadCount)
+{
+}
+
+std::vector<float> CPURenderer::Render(GLuint width, GLuint height)
+{
+    return RenderRegion(width, height, 0, 0, width, height);
+}
+
+std::vector<float> CPURenderer::RenderRegion(GLuint width, GLuint height, GLuint regionX, GLuint regionY, GLuint regionWidth, GLuint regionHeight)
+{
+    frameSize = glm::vec2(float(width), float(height));
+    fov = model->camera.GetHalfFov();
+    cameraToWorld = model->camera.GetCameraToWorld();
+    regionOrigin = glm::uvec2(regionX, regionY);
+    this->regionWidth = regionWidth;
+
+    std::vector<float> pixels(3 * size_t(regionWidth) * regionHeight);
+    float* pixelData = pixels.data();
+
+    const GLuint regionRight = regionX + regionWidth, regionTop = regionY + regionHeight;
+    for (GLuint y0 = regionY; y0 < regionTop; y0 += TILE_SIZE)
+    {
+        for (GLuint x0 = regionX; x0 < regionRight; x0 += TILE_SIZE)
+        {
+            GLuint x1 = std::min(x0 + TILE_SIZE, regionRight);
+            GLuint y1 = std::min(y0 + TILE_SIZE, regionTop);
+            pool.Submit([this, x0, y0, x1, y1, pixelData]() { RenderTile(x0, y0, x1, y1, pixelData); });
+        }
+    }
+    pool.Wait();
+
+    return pixels;
+}
+
+void CPURenderer::RenderTile(GLuint x0, GLuint y0, GLuint x1, GLuint y1, float* pixels) const
+{
+    const size_t rowStride = 3 * size_t(regionWidth);
+
+    for (GLuint y = y0; y < y1; ++y)
+    {
+        float* row = pixels + (y - regionOrigin.y) * rowStride;
+        for (GLuint x = x0; x < x1; ++x)
+        {
+            // Same sample positions as gl_FragCoord plus the GL path's jitter, the first is the pixel center
+            glm::vec3 color(0.f);
+            for (GLuint sample = 0; sample < sampleCount; ++sample)
+            {
+                const glm::vec2 jitter = GetSampleJitter(sample);
+                // Same light sampling seed as the GL path's sample of this pixel
+                GLuint rngState = PcgHash(x + PcgHash(y + PcgHash(sample)));
+                sampleCost = SampleCost();
+                glm::vec3 sampleColor = TracePixel(float(x) + 0.5f + jitter.x, float(y) + 0.5f + jitter.y, rngState);
+                // Every raycast after the primary one follows a reflection
+                if (costOutput)
+                    sampleColor = glm::vec3(float(sampleCost.tests), float(sampleCost.raycasts - 1), float(sampleCost.shadowRays));
+                color += sampleColor;
+            }
+            color /= float(sampleCount);
+
+            float* pixel = row + 3 * size_t(x - regionOrigin.x);
+            if (costOutput)
+            {
+                pixel[0] = color.r;
+                pixel[1] = color.g;
+                pixel[2] = color.b;
+                continue;
+            }
+
+            // The GL path clamps on readback, see OpenGLView::SetUpWindow
+            pixel[0] = glm::clamp(color.r, 0.f, 1.f);
+            pixel[1] = glm::clamp(color.g, 0.f, 1.f);
+            pixel[2] = glm::clamp(color.b, 0.f, 1.f);
+        }
+    }
+}
+
+glm::vec3 CPURenderer::TracePixel(float fragX, float fragY, GLuint& rngState) const
+{
+    const float halfWidth = frameSize.x / 2.0f;
+    const float halfHeight = frameSize.y / 2.0f;
+
+    Ray ray;
+    ray.start = cameraToWorld * glm::vec4(0.f, 0.f, 0.f, 1.f);
+    ray.direction = cameraToWorld * glm::vec4(fragX - halfWidth, fragY - halfHeight, -(halfHeight / std::tan(fov)), 0.f);
+
+    HitRecord hit;
+    hit.time = MAX_FLOAT;
+
+    if (!Raycast(ray, hit))
+        return glm::vec3(0.f, 0.f, 0.f);
+
+    glm::vec3 absorbColor{ 0.f, 0.f, 0.f }, reflectColor{ 0.f, 0.f, 0.f };
+
+    absorbColor = hit.mat->absorption * Shade(hit, rngState);
+    float absorptionPercent = hit.mat->absorption;
+
+    GLuint bounces = 0;
+    Ray reflectionRay;
+    reflectionRay.start = hit.intersection;
+    reflectionRay.direction = glm::vec4(hit.reflection, 0.f);
+    reflectionRay.start += glm::vec4(glm::normalize(glm::vec3(reflectionRay.direction)), 0.f) * 0.001f;
+    HitRecord reflectionHit;
+    reflectionHit.time = MAX_FLOAT;
+
+    while (bounces++ < model->MAX_BOUNCES && absorptionPercent <= 0.999f && Raycast(reflectionRay, reflectionHit))
+    {
+        reflectColor = Shade(reflectionHit, rngState);
+        float reflectedAbsorption = (1.f - absorptionPercent) * reflectionHit.mat->absorption;
+        absorbColor += reflectedAbsorption * reflectColor;
+        absorptionPercent += reflectedAbsorption;
+
+        // reinitialize values for next iteration
+        reflectionRay.start = reflectionHit.intersection;
+        reflectionRay.direction = glm::vec4(reflectionHit.reflection, 0.f);
+        reflectionRay.start += glm::vec4(glm::normalize(glm::vec3(reflectionRay.direction)), 0.f) * 0.001f;
+        reflectionHit.time = MAX_FLOAT;
+    }
+
+    if (bounces == 0 && absorptionPercent < 1.f)
+        absorbColor += (1.f - absorptionPercent) * reflectColor;
+
+    return absorbColor;
+}
+
+template<typename LeafVisitor>
+bool CPURenderer::Traverse(const std::vector<BVHNode>& nodes, GLuint rootIndex, const Ray& ray, const float& maxTime, LeafVisitor visitLeaf) const
+{
+    glm::vec3 start = glm::vec3(ray.start);
+    // Keep the reciprocal finite so axis-aligned rays never produce 0 * inf
+    glm::vec3 direction = glm::vec3(ray.direction);
+    for (int axis = 0; axis < 3; ++axis)
+        if (std::abs(direction[axis]) < 1e-20f) direction[axis] = 1e-20f;
+    glm::vec3 invDirection = 1.f / direction;
+
+    GLuint nodeStack[BVH_STACK_SIZE];
+    float entryStack[BVH_STACK_SIZE];
+    GLuint stackSize = 0;
+
+    if (IsEmptyHierarchy(nodes[rootIndex], rootIndex)) return false;
+
+    float entryTime;
+    if (IntersectsBounds(nodes[rootIndex], start, invDirection, maxTime, entryTime)) {
+        nodeStack[stackSize] = rootIndex;
+        entryStack[stackSize++] = entryTime;
+    }
+
+    while (stackSize > 0) {
+        --stackSize;
+        // A closer hit may have been found since this node was pushed
+        if (entryStack[stackSize] > maxTime) continue;
+
+        const BVHNode& node = nodes[nodeStack[stackSize]];
+
+        if (node.primCount > 0) {
+            if (visitLeaf(node)) return true;
+            continue;
+        }
+
+        float leftEntry, rightEntry;
+        const GLuint leftIndex = node.leftOrFirst;
+        const GLuint rightIndex = node.leftOrFirst + 1;
+        bool hitLeft = IntersectsBounds(nodes[leftIndex], start, invDirection, maxTime, leftEntry);
+        bool hitRight = IntersectsBounds(nodes[rightIndex], start, invDirection, maxTime, rightEntry);
+
+        // Push the farther child first so the nearer one is visited next
+        if (hitLeft && hitRight && leftEntry < rightEntry && stackSize < BVH_STACK_SIZE) {
+            nodeStack[stackSize] = rightIndex;
+            entryStack[stackSize++] = rightEntry;
+            hitRight = false;
+        }
+        if (hitLeft && stackSize < BVH_STACK_SIZE) {
+            nodeStack[stackSize] = leftIndex;
+            entryStack[stackSize++] = leftEntry;
+        }
+        if (hitRight && stackSize < BVH_STACK_SIZE) {
+            nodeStack[stackSize] = rightIndex;
+            entryStack[stackSize++] = rightEntry;
+        }
+    }
+    return false;
+}
+
+// Ray time of the hit on the unit sphere, negative if there is none
+static float IntersectSphere(const glm::vec4& start, const glm::vec4& direction)
+{
+    ++sampleCost.tests;
+    // Solve quadratic
+    float A = direction.x * direction.x +
+        direction.y * direction.y +
+        direction.z * direction.z;
+    float B = 2.0f *
+        (direction.x * start.x + direction.y * start.y +
+            direction.z * start.z);
+    float C = start.x * start.x + start.y * start.y +
+        start.z * start.z - 1.0f;
+
+    float radical = B * B - 4.0f * A * C;
+
+    // no intersection
+    if (radical < 0) return -1.f;
+
+    float root = std::sqrt(radical);
+
+    float t1 = (-B - root) / (2.0f * A);
+    float t2 = (-B + root) / (2.0f * A);
+
+    // negative when the object is fully behind the ray
+    return (t1 >= 0 && t2 >= 0) ? std::min(t1, t2) : std::max(t1, t2);
+}
+
+// Ray time of the hit on the unit box, negative if there is none
+static float IntersectBox(const glm::vec4& start, const glm::vec4& direction)
+{
+    ++sampleCost.tests;
+    float txMin, txMax, tyMin, tyMax, tzMin, tzMax;
+
+    if (!IntersectsWithBoxSide(txMin, txMax, start.x, direction.x))
+        return -1.f;
+
+    if (!IntersectsWithBoxSide(tyMin, tyMax, start.y, direction.y))
+        return -1.f;
+
+    if (!IntersectsWithBoxSide(tzMin, tzMax, start.z, direction.z))
+        return -1.f;
+
+    float tMin = std::max(std::max(txMin, tyMin), tzMin);
+    float tMax = std::min(std::min(txMax, tyMax), tzMax);
+
+    // no intersection
+    if (tMax < tMin) return -1.f;
+
+    // negative when the object is fully behind the ray
+    return (tMin >= 0 && tMax >= 0) ? std::min(tMin, tMax) : std::max(tMin, tMax);
+}
+
+void CPURenderer::IntersectObject(const ObjectData& obj, const Ray& prototypeRay, HitRecord& hit) const
+{
+    Ray ray;
+
+    ray.start = obj.mvInverse * prototypeRay.start;
+    ray.direction = obj.mvInverse * prototypeRay.direction;
+
+    switch (obj.type) {
+    case ObjectData::PrimativeType::sphere:
+    {
+        float tMin = IntersectSphere(ray.start, ray.direction);
+        // no intersection, or object is fully behind camera
+        if (tMin < 0) return;
+
+        if (hit.time < tMin) return;
+
+        hit.time = tMin;
+
+        glm::vec4 objSpaceIntersection = ray.start + tMin * ray.direction;
+        hit.intersection = obj.mv * objSpaceIntersection;
+        glm::vec4 objSpaceNormal = objSpaceIntersection;
+        objSpaceNormal.w = 0.0f;
+        glm::vec4 normal = obj.mv * objSpaceNormal;
+        hit.normal = glm::vec3(normal);
+        hit.mat = &model->materials[obj.materialIndex];
+        return;
+    }
+
+    case ObjectData::PrimativeType::box:
+    {
+        float tHit = IntersectBox(ray.start, ray.direction);
+        // no intersection, or object is fully behind camera
+        if (tHit < 0) return;
+
+        // already hit a closer object
+        if (hit.time <= tHit) return;
+
+        glm::vec4 objSpaceIntersection = ray.start + tHit * ray.direction;
+
+        glm::vec4 objSpaceNormal{ 0.f, 0.f, 0.f, 0.f };
+        const float BOX_EXTENTS = 0.4998f;
+        if (objSpaceIntersection.x > BOX_EXTENTS) objSpaceNormal.x += 1.0f;
+        else if (objSpaceIntersection.x < -BOX_EXTENTS) objSpaceNormal.x -= 1.0f;
+
+        if (objSpaceIntersection.y > BOX_EXTENTS) objSpaceNormal.y += 1.0f;
+        else if (objSpaceIntersection.y < -BOX_EXTENTS) objSpaceNormal.y -= 1.0f;
+
+        if (objSpaceIntersection.z > BOX_EXTENTS) objSpaceNormal.z += 1.0f;
+        else if (objSpaceIntersection.z < -BOX_EXTENTS) objSpaceNormal.z -= 1.0f;
+
+        hit.time = tHit;
+        hit.intersection = obj.mv * objSpaceIntersection;
+        glm::vec4 normal = obj.mv * objSpaceNormal;
+        hit.normal = glm::vec3(normal);
+        hit.mat = &model->materials[obj.materialIndex];
+        return;
+    }
+
+    case ObjectData::PrimativeType::mesh:
+        IntersectMesh(obj, ray, hit);
+        return;
+
+    }
+}
+
+// Moller-Trumbore, returns the ray time of the hit or MAX_FLOAT. Triangles are hit from either side.
+static float IntersectTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& start, const glm::vec3& direction, glm::vec2& barycentric)
+{
+    ++sampleCost.tests;
+    glm::vec3 edge1 = v1 - v0;
+    glm::vec3 edge2 = v2 - v0;
+    glm::vec3 p = glm::cross(direction, edge2);
+    float determinant = glm::dot(edge1, p);
+    // Ray is parallel to the triangle
+    if (determinant == 0.f) return MAX_FLOAT;
+
+    float invDeterminant = 1.f / determinant;
+    glm::vec3 s = start - v0;
+    barycentric.x = glm::dot(s, p) * invDeterminant;
+    if (barycentric.x < 0.f || barycentric.x > 1.f) return MAX_FLOAT;
+
+    glm::vec3 q = glm::cross(s, edge1);
+    barycentric.y = glm::dot(direction, q) * invDeterminant;
+    if (barycentric.y < 0.f || barycentric.x + barycentric.y > 1.f) return MAX_FLOAT;
+
+    float t = glm::dot(edge2, q) * invDeterminant;
+    return t > 0.f ? t : MAX_FLOAT;
+}
+
+void CPURenderer::IntersectMesh(const ObjectData& obj, const Ray& ray, HitRecord& hit) const
+{
+    auto& vertices = model->meshes.GetVertices();
+    auto& indices = model->meshes.GetIndices();
+    const glm::vec3 start = glm::vec3(ray.start);
+    const glm::vec3 direction = glm::vec3(ray.direction);
+
+    float hitTime = hit.time;
+    GLuint hitTriangle = 0;
+    glm::vec2 hitBarycentric{ 0.f, 0.f };
+
+    Traverse(model->meshes.GetNodes(), obj.meshRoot, ray, hitTime, [&](const BVHNode& leaf) {
+        for (GLuint triangle = leaf.leftOrFirst; triangle < leaf.leftOrFirst + leaf.primCount; ++triangle) {
+            glm::vec2 barycentric;
+            float t = IntersectTriangle(vertices[indices[3 * triangle]].position, vertices[indices[3 * triangle + 1]].position,
+                vertices[indices[3 * triangle + 2]].position, start, direction, barycentric);
+            if (t < hitTime) {
+                hitTime = t;
+                hitTriangle = triangle;
+                hitBarycentric = barycentric;
+            }
+        }
+        return false;
+        });
+
+    if (hitTime >= hit.time) return;
+
+    const MeshVertex& v0 = vertices[indices[3 * hitTriangle]];
+    const MeshVertex& v1 = vertices[indices[3 * hitTriangle + 1]];
+    const MeshVertex& v2 = vertices[indices[3 * hitTriangle + 2]];
+    glm::vec3 normal = (1.f - hitBarycentric.x - hitBarycentric.y) * v0.normal + hitBarycentric.x * v1.normal + hitBarycentric.y * v2.normal;
+    if (normal == glm::vec3(0.f))
+        normal = glm::cross(v1.position - v0.position, v2.position - v0.position);
+    // Face the ray, mesh windings are not consistent enough to cull or trust
+    if (glm::dot(normal, direction) > 0.f)
+        normal = -normal;
+
+    hit.time = hitTime;
+    hit.intersection = obj.mv * (ray.start + hitTime * ray.direction);
+    hit.normal = glm::vec3(obj.mvInverseTranspose * glm::vec4(normal, 0.f));
+    hit.mat = &model->materials[obj.materialIndex];
+}
+
+bool CPURenderer::Raycast(const Ray& worldRay, HitRecord& hit) const
+{
+    ++sampleCost.raycasts;
+    auto& primIndices = model->bvh.GetPrimitiveIndices();
+    auto& instances = model->bvh.GetInstances();
+    GLuint hitInstance = 0;
+
+    auto& nodes = model->bvh.GetNodes();
+    Traverse(nodes, 0, worldRay, hit.time, [&](const BVHNode& topLevelLeaf) {
+        for (GLuint primIndex = topLevelLeaf.leftOrFirst; primIndex < topLevelLeaf.leftOrFirst + topLevelLeaf.primCount; ++primIndex) {
+            const GLuint instanceIndex = primIndices[primIndex];
+            const InstanceData& instance = instances[instanceIndex];
+
+            // Affine transforms keep ray times, so hit.time culls across instances
+            Ray prototypeRay;
+            prototypeRay.start = instance.transformInverse * worldRay.start;
+            prototypeRay.direction = instance.transformInverse * worldRay.direction;
+
+            const float previousTime = hit.time;
+            Traverse(nodes, instance.blasRoot, prototypeRay, hit.time, [&](const BVHNode& leaf) {
+                for (GLuint objIndex = leaf.leftOrFirst; objIndex < leaf.leftOrFirst + leaf.primCount; ++objIndex)
+                    IntersectObject(model->objs[primIndices[objIndex]], prototypeRay, hit);
+                return false;
+                });
+            if (hit.time < previousTime)
+                hitInstance = instanceIndex;
+        }
+        return false;
+        });
+
+    if (hit.time == MAX_FLOAT) return false;
+
+    // Move the hit out of its prototype's space, normals take the inverse transpose
+    const InstanceData& instance = instances[hitInstance];
+    hit.intersection = instance.transform * hit.intersection;
+    hit.normal = glm::normalize(glm::vec3(glm::vec4(hit.normal, 0.f) * instance.transformInverse));
+    hit.reflection = glm::reflect(glm::vec3(worldRay.direction), hit.normal);
+    return true;
+}
+
+bool CPURenderer::ObjectOccludes(const ObjectData& obj, const Ray& prototypeRay, float maxTime) const
+{
+    Ray ray;
+    ray.start = obj.mvInverse * prototypeRay.start;
+    ray.direction = obj.mvInverse * prototypeRay.direction;
+
+    float t = -1.f;
+    switch (obj.type) {
+    case ObjectData::PrimativeType::sphere: t = IntersectSphere(ray.start, ray.direction); break;
+    case ObjectData::PrimativeType::box: t = IntersectBox(ray.start, ray.direction); break;
+    case ObjectData::PrimativeType::mesh:
+    {
+        auto& vertices = model->meshes.GetVertices();
+        auto& indices = model->meshes.GetIndices();
+        const glm::vec3 start = glm::vec3(ray.start);
+        const glm::vec3 direction = glm::vec3(ray.direction);
+
+        return Traverse(model->meshes.GetNodes(), obj.meshRoot, ray, maxTime, [&](const BVHNode& leaf) {
+            glm::vec2 barycentric;
+            for (GLuint triangle = leaf.leftOrFirst; triangle < leaf.leftOrFirst + leaf.primCount; ++triangle) {
+                if (IntersectTriangle(vertices[indices[3 * triangle]].position, vertices[indices[3 * triangle + 1]].position,
+                    vertices[indices[3 * triangle + 2]].position, start, direction, barycentric) < maxTime)
+                    return true;
+            }
+            return false;
+            });
+    }
+    }
+    return t >= 0 && t < maxTime;
+}
+
+bool CPURenderer::Occluded(const Ray& worldRay, float maxTime) const
+{
+    ++sampleCost.shadowRays;
+    auto& nodes = model->bvh.GetNodes();
+    auto& primIndices = model->bvh.GetPrimitiveIndices();
+    auto& instances = model->bvh.GetInstances();
+
+    return Traverse(nodes, 0, worldRay, maxTime, [&](const BVHNode& topLevelLeaf) {
+        for (GLuint primIndex = topLevelLeaf.leftOrFirst; primIndex < topLevelLeaf.leftOrFirst + topLevelLeaf.primCount; ++primIndex) {
+            const InstanceData& instance = instances[primIndices[primIndex]];
+
+            Ray prototypeRay;
+            prototypeRay.start = instance.transformInverse * worldRay.start;
+            prototypeRay.direction = instance.transformInverse * worldRay.direction;
+
+            bool hit = Traverse(nodes, instance.blasRoot, prototypeRay, maxTime, [&](const BVHNode& leaf) {
+                for (GLuint objIndex = leaf.leftOrFirst; objIndex < leaf.leftOrFirst + leaf.primCount; ++objIndex) {
+                    if (ObjectOccludes(model->objs[primIndices[objIndex]], prototypeRay, maxTime))
+                        return true;
+                }
+                return false;
+                });
+            if (hit) return true;
+        }
+        return false;
+        });
+}
+
+// Upper bound on the light a subtree could deliver to a point: its power times the largest N.L over its bounds.
+// Lights have no falloff, so distance only matters through the angle the bounds cover.
+static float LightImportance(const LightTreeNode& node, const glm::vec3& position, const glm::vec3& normal)
+{
+    glm::vec3 center = 0.5f * (node.boundsMin + node.boundsMax);
+    float radius = 0.5f * glm::length(node.boundsMax - node.boundsMin);
+    glm::vec3 toCenter = center - position;
+    float distance = glm::length(toCenter);
+    // Inside the bounding sphere, lights may be in any direction
+    if (distance <= radius)
+        return node.power;
+
+    // cos(max(theta - alpha, 0)) for the angle theta to the center and the half-angle alpha of the sphere
+    float cosTheta = glm::dot(normal, toCenter) / distance;
+    float sinAlpha = radius / distance;
+    float cosAlpha = std::sqrt(1.f - sinAlpha * sinAlpha);
+    if (cosTheta >= cosAlpha)
+        return node.power;
+
+    float sinTheta = std::sqrt(std::max(1.f - cosTheta * cosTheta, 0.f));
+    return node.power * std::max(cosTheta * cosAlpha + sinTheta * sinAlpha, 0.f);
+}
+
+static const GLuint NO_LIGHT = 0xffffffffu;
+
+GLuint CPURenderer::SampleLightTree(const glm::vec3& position, const glm::vec3& normal, GLuint& rngState, float& pdf) const
+{
+    auto& nodes = model->lightTree.GetNodes();
+    GLuint nodeIndex = 0;
+    pdf = 1.f;
+    while (nodes[nodeIndex].lightCount == 0) {
+        GLuint left = nodes[nodeIndex].leftOrFirst;
+        float leftImportance = LightImportance(nodes[left], position, normal);
+        float rightImportance = LightImportance(nodes[left + 1], position, normal);
+        float totalImportance = leftImportance + rightImportance;
+        if (totalImportance <= 0.f)
+            return NO_LIGHT;
+
+        float leftProbability = leftImportance / totalImportance;
+        if (RandomFloat(rngState) < leftProbability) {
+            nodeIndex = left;
+            pdf *= leftProbability;
+        }
+        else {
+            nodeIndex = left + 1;
+            pdf *= 1.f - leftProbability;
+        }
+    }
+    return nodes[nodeIndex].leftOrFirst;
+}
+
+glm::vec3 CPURenderer::DirectLight(const HitRecord& hit, const Light& light, const glm::vec3& normalView) const
+{
+    const glm::vec3 fPosition = glm::vec3(hit.intersection);
+    glm::vec3 lightVec;
+    if (light.lightPosition.w != 0)
+        lightVec = glm::vec3(light.lightPosition) - fPosition;
+    else
+        lightVec = -glm::vec3(light.lightPosition);
+
+    glm::vec3 lightDirection = glm::normalize(lightVec);
+    float nDotL = glm::dot(normalView, lightDirection);
+
+    // Surfaces facing away from the light get no direct light whether or not it is blocked
+    if (nDotL <= 0)
+        return glm::vec3(0.f, 0.f, 0.f);
+
+    // Shoot ray towards light source, any hit before it means shadow.
+    Ray rayToLight;
+    rayToLight.start = glm::vec4(fPosition, 1.0f);
+    rayToLight.direction = glm::vec4(lightVec, 0.0f);
+    // Need 'skin' width to avoid hitting itself.
+    rayToLight.start += 0.01f * glm::vec4(lightDirection, 0.f);
+
+    if (Occluded(rayToLight, 1.f))
+        return glm::vec3(0.f, 0.f, 0.f);
+
+    glm::vec3 viewVec = glm::normalize(glm::vec3(cameraToWorld[3]) - fPosition);
+    glm::vec3 reflectVec = glm::normalize(glm::reflect(-lightDirection, normalView));
+    float rDotV = std::max(glm::dot(reflectVec, viewVec), 0.0f);
+
+    const Material& mat = *hit.mat;
+    glm::vec3 diffuse = mat.diffuse * light.diffuse * nDotL;
+    glm::vec3 specular = mat.specular * light.specular * std::pow(rDotV, std::max(mat.shininess, 1.0f));
+    return diffuse + specular;
+}
+
+glm::vec3 CPURenderer::Shade(const HitRecord& hit, GLuint& rngState) const
+{
+    const Material& mat = *hit.mat;
+    glm::vec3 normalView = glm::normalize(hit.normal);
+    glm::vec3 fColor{ 0.f, 0.f, 0.f };
+
+    if (model->lightTree.ShouldSample(lightSamples)) {
+        // Ambient light is never blocked, every light's share of it is summed on the host
+        fColor += mat.ambient * model->lightTree.GetAmbient();
+
+        // Each sample stands in for every point light, weighted by how likely it was to be picked
+        glm::vec3 sampledColor{ 0.f, 0.f, 0.f };
+        for (GLuint sampleIndex = 0; sampleIndex < lightSamples; ++sampleIndex) {
+            float pdf;
+            GLuint lightIndex = SampleLightTree(glm::vec3(hit.intersection), normalView, rngState, pdf);
+            if (lightIndex != NO_LIGHT)
+                sampledColor += DirectLight(hit, model->lights[lightIndex], normalView) / pdf;
+        }
+        // Clamping an estimate would bias it, only the accumulated pixel is clamped
+        return fColor + sampledColor / float(lightSamples);
+    }
+
+    for (auto& light : model->lights)
+        fColor += mat.ambient * light.ambient + DirectLight(hit, light, normalView);
+    return glm::vec3(std::min(fColor.x, 1.f), std::min(fColor.y, 1.f), std::min(fColor.z, 1.f));
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <vector>
+#include "OpenGLModel.h"
+#include "ThreadPool.hpp"
+
+// Software mirror of shade_and_reflect.glsl for machines without a usable GPU.
+// Render() returns the same bottom-up float RGB buffer as OpenGLView::GetFrameAsPixels.
+class CPURenderer
+{
+public:
+    // A thread count of 0 uses every hardware thread.
+    CPURenderer(OpenGLModel& model, unsigned int threadCount = 0);
+
+    // Viewed from the model's camera
+    std::vector<float> Render(GLuint width, GLuint height);
+
+    // Renders only a rectangle of a width x height frame, in bottom-up pixel coordinates.
+    // The result holds just the region's pixels, bottom-up like Render().
+    std::vector<float> RenderRegion(GLuint width, GLuint height, GLuint regionX, GLuint regionY, GLuint regionWidth, GLuint regionHeight);
+
+    // Samples per pixel, taken at the same jittered positions as OpenGLView's progressive rendering
+    void SetSampleCount(GLuint sampleCount) { this->sampleCount = std::max(sampleCount, 1u); }
+    // Point lights sampled per hit in scenes with more lights than this, with the same choices as OpenGLView
+    void SetLightSampleCount(GLuint lightSamples) { this->lightSamples = lightSamples; }
+    // Renders each pixel's intersection tests, bounces and shadow rays instead of its colour, see CostHeatmap
+    void SetCostOutput(bool costOutput) { this->costOutput = costOutput; }
+
+    // Renders a different scene with the same worker threads
+    void SetModel(OpenGLModel& model) { this->model = &model; }
+    unsigned int GetThreadCount() const { return pool.GetThreadCount(); }
+
+private:
+    struct Ray {
+        glm::vec4 start;
+        glm::vec4 direction;
+    };
+
+    struct HitRecord {
+        const Material* mat = nullptr;
+        glm::vec4 intersection{ 0.f };
+        glm::vec3 normal{ 0.f };
+        glm::vec3 reflection{ 0.f };
+        float time;
+    };
+
+    void RenderTile(GLuint x0, GLuint y0, GLuint x1, GLuint y1, float* pixels) const;
+
+    // rngState seeds the light sampling of every hit along the pixel's path
+    glm::vec3 TracePixel(float fragX, float fragY, GLuint& rngState) const;
+    // Walks the nodes below rootIndex nearest first, calling visitLeaf for each leaf the ray may reach before
+    // maxTime. Leaves update maxTime as they find closer hits, or return true to stop the walk early,
+    // which Traverse then returns.
+    template<typename LeafVisitor>
+    bool Traverse(const std::vector<BVHNode>& nodes, GLuint rootIndex, const Ray& ray, const float& maxTime, LeafVisitor visitLeaf) const;
+    // Closest hit over the TLAS and the BLAS of every instance it reaches, in world space
+    bool Raycast(const Ray& worldRay, HitRecord& hit) const;
+    // Leaves the hit in the prototype's space with an unnormalized normal, Raycast finishes it
+    void IntersectObject(const ObjectData& obj, const Ray& prototypeRay, HitRecord& hit) const;
+    // Closest hit on a mesh object, ray is in mesh space
+    void IntersectMesh(const ObjectData& obj, const Ray& ray, HitRecord& hit) const;
+    // Any-hit test for shadow rays, stops at the first hit before maxTime without building a hit record
+    bool Occluded(const Ray& worldRay, float maxTime) const;
+    bool ObjectOccludes(const ObjectData& obj, const Ray& prototypeRay, float maxTime) const;
+    // Light index picked from the light tree by importance and the probability of picking it, NO_LIGHT if none reach
+    GLuint SampleLightTree(const glm::vec3& position, const glm::vec3& normal, GLuint& rngState, float& pdf) const;
+    // Diffuse and specular light from one light, zero when it is behind the surface or blocked
+    glm::vec3 DirectLight(const HitRecord& hit, const Light& light, const glm::vec3& normalView) const;
+    glm::vec3 Shade(const HitRecord& hit, GLuint& rngState) const;
+
+    static const GLuint TILE_SIZE = 32;
+
+    OpenGLModel* model;
+    ThreadPool pool;
+
+    // Per-frame camera values, mirrors the 'camera' uniform
+    glm::vec2 frameSize{ 0.f, 0.f };
+    float fov = 0.f;
+    glm::mat4 cameraToWorld{ 1.f };
+    GLuint sampleCount = 1;
+    GLuint lightSamples = 0;
+    bool costOutput = false;
+    // Bottom-left pixel and width of the region being rendered
+    glm::uvec2 regionOrigin{ 0, 0 };
+    GLuint regionWidth = 0;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Where a scene is viewed from, set by the scene file's 'camera' block. Objects and lights are stored in world
+// space, so moving the camera only changes the 'camera.toWorld' uniform the primary rays are generated with.
+struct Camera
+{
+    glm::vec3 position{ 0.f, 0.f, 10.f };
+    glm::vec3 target{ 0.f, 0.f, 0.f };
+    glm::vec3 up{ 0.f, 1.f, 0.f };
+    // Full vertical field of view, in degrees
+    float fovDegrees = 60.f;
+
+    // Half-angle of the vertical field of view in radians, as used by 'camera.fov'
+    float GetHalfFov() const { return glm::radians(fovDegrees) * 0.5f; }
+
+    // Takes rays from camera space, looking down -z from the origin with y up, into world space
+    glm::mat4 GetCameraToWorld() const { return glm::inverse(glm::lookAt(position, target, up)); }
+
+    bool operator==(const Camera& other) const
+    {
+        return position == other.position && target == other.target && up == other.up && fovDegrees == other.fovDegrees;
+    }
+};
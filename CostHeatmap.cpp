@@ -0,0 +1,147 @@
+#include "CostHeatmap.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+static const char* METRIC_NAMES[] = { "none", "intersection tests", "bounces", "shadow rays" };
+static const unsigned int HISTOGRAM_BUCKETS = 10, HISTOGRAM_WIDTH = 50;
+// Side of the blocks ranked by mean cost, and how many are listed
+static const unsigned int BLOCK_SIZE = 32, HOTTEST_BLOCKS = 5;
+
+CostMetric ParseCostMetric(const std::string& name)
+{
+    if (name == "tests")
+        return CostMetric::intersectionTests;
+    if (name == "bounces")
+        return CostMetric::bounces;
+    if (name == "shadow-rays")
+        return CostMetric::shadowRays;
+    throw std::runtime_error("Invalid heatmap '" + name + "', expected tests, bounces or shadow-rays.");
+}
+
+// The metric's channel in a cost frame
+static size_t GetChannel(CostMetric metric)
+{
+    return size_t(metric) - size_t(CostMetric::intersectionTests);
+}
+
+// The 99th percentile of the metric, at least 1 so empty frames do not divide by zero
+static float GetHeatmapScale(const std::vector<float>& costs, CostMetric metric)
+{
+    const size_t channel = GetChannel(metric);
+    std::vector<float> values(costs.size() / 3);
+    for (size_t ii = 0; ii < values.size(); ++ii)
+        values[ii] = costs[3 * ii + channel];
+    if (values.empty())
+        return 1.f;
+
+    auto percentile = values.begin() + (values.size() - 1) * 99 / 100;
+    std::nth_element(values.begin(), percentile, values.end());
+    return std::max(*percentile, 1.f);
+}
+
+void PrintCostSummary(std::ostream& out, const std::vector<float>& costs, unsigned int width, unsigned int height, CostMetric metric)
+{
+    const size_t pixelCount = size_t(width) * height;
+    if (pixelCount == 0 || metric == CostMetric::none)
+        return;
+
+    // Formatted separately so the caller's stream flags are left alone
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1);
+
+    text << "Per-pixel cost:";
+    for (CostMetric each : { CostMetric::intersectionTests, CostMetric::bounces, CostMetric::shadowRays })
+    {
+        const size_t channel = GetChannel(each);
+        double total = 0;
+        float maximum = 0;
+        for (size_t ii = 0; ii < pixelCount; ++ii)
+        {
+            total += costs[3 * ii + channel];
+            maximum = std::max(maximum, costs[3 * ii + channel]);
+        }
+        text << (each == CostMetric::intersectionTests ? " " : ", ") << METRIC_NAMES[size_t(each)]
+            << " mean " << total / pixelCount << " max " << maximum;
+    }
+    text << "\n";
+
+    const size_t channel = GetChannel(metric);
+    float maximum = 0;
+    for (size_t ii = 0; ii < pixelCount; ++ii)
+        maximum = std::max(maximum, costs[3 * ii + channel]);
+
+    // Linear buckets up to the maximum, so the tail that blows the budget stays visible
+    const float bucketSize = std::max(maximum, 1.f) / HISTOGRAM_BUCKETS;
+    size_t buckets[HISTOGRAM_BUCKETS] = {};
+    for (size_t ii = 0; ii < pixelCount; ++ii)
+        ++buckets[std::min(size_t(costs[3 * ii + channel] / bucketSize), size_t(HISTOGRAM_BUCKETS - 1))];
+    const size_t largestBucket = *std::max_element(std::begin(buckets), std::end(buckets));
+
+    text << "Histogram of " << METRIC_NAMES[size_t(metric)] << " per pixel, heatmap scaled to "
+        << GetHeatmapScale(costs, metric) << ":\n";
+    for (unsigned int bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+    {
+        // Any non-empty bucket gets at least one mark
+        const size_t barLength = buckets[bucket] ? std::max<size_t>(1, buckets[bucket] * HISTOGRAM_WIDTH / largestBucket) : 0;
+        text << "  " << std::setw(8) << bucket * bucketSize << " - " << std::setw(8) << (bucket + 1) * bucketSize
+            << " " << std::setw(6) << 100.0 * buckets[bucket] / pixelCount << "% " << std::string(barLength, '#') << "\n";
+    }
+
+    struct Block {
+        unsigned int x, y;
+        double meanCost;
+    };
+    std::vector<Block> blocks;
+    for (unsigned int y0 = 0; y0 < height; y0 += BLOCK_SIZE)
+    {
+        for (unsigned int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const unsigned int x1 = std::min(x0 + BLOCK_SIZE, width), y1 = std::min(y0 + BLOCK_SIZE, height);
+            double total = 0;
+            for (unsigned int y = y0; y < y1; ++y)
+                for (unsigned int x = x0; x < x1; ++x)
+                    total += costs[3 * (size_t(y) * width + x) + channel];
+            // Cost frames are bottom-up, report the block's top-left corner as image viewers count it
+            blocks.push_back({ x0, height - y1, total / ((x1 - x0) * (y1 - y0)) });
+        }
+    }
+
+    const size_t listed = std::min<size_t>(HOTTEST_BLOCKS, blocks.size());
+    std::partial_sort(blocks.begin(), blocks.begin() + listed, blocks.end(), [](const Block& a, const Block& b)
+        {
+            return a.meanCost > b.meanCost;
+        });
+    text << "Most expensive " << BLOCK_SIZE << "x" << BLOCK_SIZE << " blocks:";
+    for (size_t ii = 0; ii < listed; ++ii)
+        text << " (" << blocks[ii].x << ", " << blocks[ii].y << ") " << blocks[ii].meanCost << (ii + 1 < listed ? "," : "");
+
+    out << text.str() << std::endl;
+}
+
+std::vector<float> MakeCostHeatmap(const std::vector<float>& costs, CostMetric metric)
+{
+    if (metric == CostMetric::none)
+        return costs;
+
+    // Evenly spaced stops of the ramp
+    static const float RAMP[][3] = {
+        { 0.f, 0.f, .5f }, { 0.f, .5f, 1.f }, { 0.f, .8f, .3f }, { 1.f, .9f, 0.f }, { 1.f, .4f, 0.f }, { .8f, 0.f, 0.f },
+    };
+    const size_t lastStop = sizeof(RAMP) / sizeof(RAMP[0]) - 1;
+
+    const size_t channel = GetChannel(metric);
+    const float scale = GetHeatmapScale(costs, metric);
+    std::vector<float> pixels(costs.size());
+    for (size_t ii = 0; ii < costs.size() / 3; ++ii)
+    {
+        const float position = std::min(costs[3 * ii + channel] / scale, 1.f) * lastStop;
+        const size_t stop = std::min(size_t(position), lastStop - 1);
+        const float blend = position - stop;
+        for (size_t component = 0; component < 3; ++component)
+            pixels[3 * ii + component] = RAMP[stop][component] + (RAMP[stop + 1][component] - RAMP[stop][component]) * blend;
+    }
+    return pixels;
+}
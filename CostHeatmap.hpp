@@ -0,0 +1,20 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Which per-pixel cost a heatmap shows. Cost frames hold them as RGB: intersection tests (BVH nodes and
+// primitives) in red, reflection bounces in green and shadow rays in blue, each the mean over the pixel's samples.
+enum class CostMetric { none, intersectionTests, bounces, shadowRays };
+
+// Parses "tests", "bounces" or "shadow-rays". Throws std::runtime_error for anything else.
+CostMetric ParseCostMetric(const std::string& name);
+
+// Prints the mean and maximum of every cost, a histogram of the chosen metric and the most expensive blocks of
+// the image, in top-down pixel coordinates as the exported file shows them.
+void PrintCostSummary(std::ostream& out, const std::vector<float>& costs, unsigned int width, unsigned int height, CostMetric metric);
+
+// Colours the chosen metric from blue through green and yellow to red, scaled to its 99th percentile so a few
+// outliers do not wash out the rest. The result is a bottom-up RGB frame for ImageExporter.
+std::vector<float> MakeCostHeatmap(const std::vector<float>& costs, CostMetric metric);
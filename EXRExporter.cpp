@@ -0,0 +1,125 @@
+#include "EXRExporter.hpp"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// OpenEXR stores every value little-endian, which matches the platforms this project builds for
+static const int32_t EXR_MAGIC = 20000630;
+static const int32_t EXR_VERSION = 2; // single part scanline file, no flags
+static const int32_t EXR_PIXEL_TYPE_FLOAT = 2;
+
+template<typename T>
+static void Append(std::vector<char>& dst, const T& value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    dst.insert(dst.end(), bytes, bytes + sizeof(T));
+}
+
+static void AppendString(std::vector<char>& dst, const char* str)
+{
+    dst.insert(dst.end(), str, str + std::strlen(str) + 1);
+}
+
+static void AppendAttribute(std::vector<char>& dst, const char* name, const char* type, const std::vector<char>& value)
+{
+    AppendString(dst, name);
+    AppendString(dst, type);
+    Append(dst, int32_t(value.size()));
+    dst.insert(dst.end(), value.begin(), value.end());
+}
+
+void EXRExporter::Begin(const std::string& outFileLoc, unsigned int width, unsigned int height)
+{
+    this->outFileLoc = outFileLoc;
+    this->width = width;
+    this->height = height;
+    rowsWritten = 0;
+
+    file.open(outFileLoc, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("Unable to open '" + outFileLoc + "' for writing.");
+
+    std::vector<char> header;
+    Append(header, EXR_MAGIC);
+    Append(header, EXR_VERSION);
+
+    // Channels have to be listed in alphabetical order
+    std::vector<char> channels;
+    for (const char* name : { "B", "G", "R" }) {
+        AppendString(channels, name);
+        Append(channels, EXR_PIXEL_TYPE_FLOAT);
+        Append(channels, uint32_t(0)); // pLinear and reserved bytes
+        Append(channels, int32_t(1)); // x sampling
+        Append(channels, int32_t(1)); // y sampling
+    }
+    channels.push_back('\0');
+    AppendAttribute(header, "channels", "chlist", channels);
+
+    AppendAttribute(header, "compression", "compression", { 0 }); // NO_COMPRESSION
+
+    std::vector<char> window;
+    Append(window, int32_t(0));
+    Append(window, int32_t(0));
+    Append(window, int32_t(width) - 1);
+    Append(window, int32_t(height) - 1);
+    AppendAttribute(header, "dataWindow", "box2i", window);
+    AppendAttribute(header, "displayWindow", "box2i", window);
+
+    AppendAttribute(header, "lineOrder", "lineOrder", { 0 }); // INCREASING_Y, top row first
+
+    std::vector<char> value;
+    Append(value, 1.f);
+    AppendAttribute(header, "pixelAspectRatio", "float", value);
+    AppendAttribute(header, "screenWindowWidth", "float", value);
+    value.clear();
+    Append(value, 0.f);
+    Append(value, 0.f);
+    AppendAttribute(header, "screenWindowCenter", "v2f", value);
+    header.push_back('\0');
+
+    file.write(header.data(), header.size());
+
+    // One chunk per scanline: y coordinate, data size, then each channel's row in channel order
+    const uint64_t chunkSize = 2 * sizeof(int32_t) + 3 * sizeof(float) * uint64_t(width);
+    uint64_t offset = header.size() + sizeof(uint64_t) * uint64_t(height);
+    for (unsigned int row = 0; row < height; ++row, offset += chunkSize)
+        file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+
+    chunkBuffer.resize(3 * size_t(width));
+}
+
+void EXRExporter::WriteRows(const float* pixelData, unsigned int rowCount)
+{
+    if (rowsWritten + rowCount > height)
+        throw std::runtime_error("Too many rows written to '" + outFileLoc + "'.");
+
+    const int32_t dataSize = int32_t(chunkBuffer.size() * sizeof(float));
+    for (unsigned int row = 0; row < rowCount; ++row, pixelData += size_t(width) * 3) {
+        // Interleaved RGB to planar B, G, R
+        float* blue = chunkBuffer.data();
+        float* green = blue + width;
+        float* red = green + width;
+        for (unsigned int col = 0; col < width; ++col) {
+            red[col] = pixelData[3 * col];
+            green[col] = pixelData[3 * col + 1];
+            blue[col] = pixelData[3 * col + 2];
+        }
+
+        const int32_t y = int32_t(rowsWritten + row);
+        file.write(reinterpret_cast<const char*>(&y), sizeof(y));
+        file.write(reinterpret_cast<const char*>(&dataSize), sizeof(dataSize));
+        file.write(reinterpret_cast<const char*>(chunkBuffer.data()), dataSize);
+    }
+
+    rowsWritten += rowCount;
+}
+
+void EXRExporter::End()
+{
+    if (rowsWritten != height)
+        throw std::runtime_error("Only " + std::to_string(rowsWritten) + " of " + std::to_string(height) + " rows were written to '" + outFileLoc + "'.");
+
+    file.close();
+    if (file.fail())
+        throw std::runtime_error("Unable to finish writing '" + outFileLoc + "'.");
+}
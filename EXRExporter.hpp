@@ -0,0 +1,22 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ImageExporter.hpp"
+
+// Writes uncompressed scanline OpenEXR files with 32 bit float R, G and B channels.
+// Every scanline chunk has the same size, so the offset table is written up front and rows stream straight to disk.
+class EXRExporter : public ImageExporter
+{
+public:
+    void Begin(const std::string& outFileLoc, unsigned int width, unsigned int height) override;
+    void WriteRows(const float* pixelData, unsigned int rowCount) override;
+    void End() override;
+
+private:
+    unsigned int width = 0, height = 0, rowsWritten = 0;
+
+    std::string outFileLoc;
+    std::ofstream file;
+    std::vector<float> chunkBuffer;
+};
@@ -0,0 +1,116 @@
+#include "FileWatcher.hpp"
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <climits>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// How often the watcher checks whether it should stop, and how often the fallback polls the modification time
+static const int WATCH_INTERVAL_MS = 100;
+
+FileWatcher::FileWatcher(const std::string& fileLoc, std::function<void()> onChange) :
+    fileLoc(fileLoc), onChange(std::move(onChange))
+{
+    if (!std::filesystem::exists(fileLoc))
+        throw std::runtime_error("Cannot watch '" + fileLoc + "', it does not exist.");
+
+#ifdef __linux__
+    const std::filesystem::path path(fileLoc);
+    const std::string directory = path.has_parent_path() ? path.parent_path().string() : ".";
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0 || inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        if (inotifyFd >= 0)
+            close(inotifyFd);
+        throw std::runtime_error("Cannot watch '" + directory + "' for changes.");
+    }
+#endif
+
+    watcher = std::thread(&FileWatcher::Watch, this);
+}
+
+FileWatcher::~FileWatcher()
+{
+    stopping = true;
+    watcher.join();
+#ifdef __linux__
+    close(inotifyFd);
+#endif
+}
+
+bool FileWatcher::TakeChange(std::chrono::steady_clock::time_point& changeTime)
+{
+    std::lock_guard<std::mutex> lock(changeMutex);
+    if (!changed)
+        return false;
+
+    changed = false;
+    changeTime = this->changeTime;
+    return true;
+}
+
+void FileWatcher::NotifyChange()
+{
+    {
+        std::lock_guard<std::mutex> lock(changeMutex);
+        if (!changed)
+            changeTime = std::chrono::steady_clock::now();
+        changed = true;
+    }
+    if (onChange)
+        onChange();
+}
+
+#ifdef __linux__
+void FileWatcher::Watch()
+{
+    const std::string fileName = std::filesystem::path(fileLoc).filename().string();
+
+    // Large enough for several events with the longest file names
+    alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    pollfd pollFd = { inotifyFd, POLLIN, 0 };
+    while (!stopping)
+    {
+        if (poll(&pollFd, 1, WATCH_INTERVAL_MS) <= 0)
+            continue;
+
+        // One save can raise several events, they are reported as a single change
+        bool fileChanged = false;
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* next = buffer; next < buffer + length; )
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(next);
+                if (event->len > 0 && fileName == event->name)
+                    fileChanged = true;
+                next += sizeof(inotify_event) + event->len;
+            }
+        }
+        if (fileChanged)
+            NotifyChange();
+    }
+}
+#else
+void FileWatcher::Watch()
+{
+    std::error_code error;
+    auto lastWriteTime = std::filesystem::last_write_time(fileLoc, error);
+    while (!stopping)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_INTERVAL_MS));
+
+        // Missing while an editor replaces it, the change is noticed once the new file is in place
+        const auto writeTime = std::filesystem::last_write_time(fileLoc, error);
+        if (!error && writeTime != lastWriteTime)
+        {
+            lastWriteTime = writeTime;
+            NotifyChange();
+        }
+    }
+}
+#endif
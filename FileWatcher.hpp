@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Watches a file for changes from a background thread. Uses inotify on Linux, elsewhere the modification time is
+// polled. Editors that save by writing a new file and renaming it over the old one are caught as well, since the
+// file's directory is watched rather than the file itself.
+class FileWatcher
+{
+public:
+    // onChange is called on the watcher thread after every change, use it to wake the thread that calls TakeChange
+    FileWatcher(const std::string& fileLoc, std::function<void()> onChange);
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Whether the file changed since the last call. changeTime is set to when the earliest of those changes was noticed.
+    bool TakeChange(std::chrono::steady_clock::time_point& changeTime);
+
+private:
+    void Watch();
+    void NotifyChange();
+
+    const std::string fileLoc;
+    const std::function<void()> onChange;
+
+    std::mutex changeMutex;
+    bool changed = false;
+    std::chrono::steady_clock::time_point changeTime;
+
+    // Watches the file's directory on Linux, -1 where the modification time is polled instead
+    int inotifyFd = -1;
+
+    std::atomic<bool> stopping{ false };
+    std::thread watcher;
+};
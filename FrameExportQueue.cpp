@@ -0,0 +1,23 @@
+#include "FrameExportQueue.hpp"
+#include "ImageExporter.hpp"
+#include <chrono>
+
+void FrameExportQueue::Export(std::vector<float> pixels, GLuint width, GLuint height, const std::string& outFileLoc, unsigned int pngBitDepth)
+{
+    // The previous frame's pixels are only released once it is written
+    writer.Wait();
+    this->pixels = std::move(pixels);
+    writer.Submit([this, width, height, outFileLoc, pngBitDepth]()
+        {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            if (!ImageExporter::Export(outFileLoc, width, height, this->pixels.data(), pngBitDepth))
+                ++failedExports;
+            totalWriteTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+        });
+}
+
+double FrameExportQueue::Finish()
+{
+    writer.Wait();
+    return totalWriteTime;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include "ThreadPool.hpp"
+
+// Exports CPU rendered frames on a writer thread, one at a time, so each frame is encoded and written while the
+// next one renders. GL frames go through AsyncReadback instead.
+class FrameExportQueue
+{
+public:
+    FrameExportQueue() : writer(1) {}
+
+    FrameExportQueue(const FrameExportQueue&) = delete;
+    FrameExportQueue& operator=(const FrameExportQueue&) = delete;
+
+    // Waits for the previous frame to be written, then starts exporting this one.
+    // The format follows the file extension, see ImageExporter::ForFile.
+    void Export(std::vector<float> pixels, GLuint width, GLuint height, const std::string& outFileLoc, unsigned int pngBitDepth = 8);
+
+    // Waits for the last frame, returns the total time spent encoding and writing files
+    double Finish();
+
+    // Frames whose file could not be written, only stable after Finish()
+    size_t GetFailedCount() const { return failedExports; }
+
+private:
+    // Written only by the writer thread, read after it is idle
+    std::vector<float> pixels;
+    double totalWriteTime = 0;
+    size_t failedExports = 0;
+
+    // Declared last, so its thread has stopped before the state it writes is destroyed
+    ThreadPool writer;
+};
@@ -0,0 +1,167 @@
+#include "GpuProfiler.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+static const char* PHASE_NAMES[] = { "trace", "present" };
+
+GpuProfiler::GpuProfiler(GLuint counterBinding, GLuint frameCount) : counterBinding(counterBinding), slots(std::max(1u, frameCount))
+{
+    const GLuint zeros[2 * COUNTER_COUNT] = {};
+    for (auto& slot : slots)
+    {
+        glGenQueries(2 * PHASE_COUNT, slot.queries);
+        glGenBuffers(1, &slot.counterBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.counterBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeros), zeros, GL_DYNAMIC_READ);
+    }
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    for (auto& slot : slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        glDeleteQueries(2 * PHASE_COUNT, slot.queries);
+        glDeleteBuffers(1, &slot.counterBuffer);
+    }
+}
+
+void GpuProfiler::BeginFrame()
+{
+    Poll();
+
+    Slot& slot = slots[currentSlot];
+    recording = !slot.fence;
+    if (!recording)
+    {
+        ++skippedFrames;
+        return;
+    }
+
+    const GLuint zeros[2 * COUNTER_COUNT] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.counterBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, counterBinding, slot.counterBuffer);
+    slot.phaseMask = 0;
+}
+
+void GpuProfiler::BeginPhase(Phase phase)
+{
+    if (Slot* slot = CurrentSlot())
+        glQueryCounter(slot->queries[2 * phase], GL_TIMESTAMP);
+}
+
+void GpuProfiler::EndPhase(Phase phase)
+{
+    if (Slot* slot = CurrentSlot())
+    {
+        glQueryCounter(slot->queries[2 * phase + 1], GL_TIMESTAMP);
+        slot->phaseMask |= 1u << phase;
+    }
+}
+
+void GpuProfiler::EndFrame()
+{
+    Slot* slot = CurrentSlot();
+    if (!slot)
+        return;
+
+    // The counters are read back with glGetBufferSubData once the fence signals
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    recording = false;
+    currentSlot = (currentSlot + 1) % slots.size();
+}
+
+bool GpuProfiler::Collect(Slot& slot, bool wait)
+{
+    if (!slot.fence)
+        return true;
+
+    // A zero timeout only checks the fence, the flush in EndFrame guarantees it is eventually signaled
+    GLenum status = glClientWaitSync(slot.fence, 0, 0);
+    while (wait && status == GL_TIMEOUT_EXPIRED)
+        status = glClientWaitSync(slot.fence, 0, 1000000000ull);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return false;
+
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    for (int phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+        if (!(slot.phaseMask & (1u << phase)))
+            continue;
+
+        // The commands have completed, so both timestamps are available without stalling
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(slot.queries[2 * phase], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(slot.queries[2 * phase + 1], GL_QUERY_RESULT, &end);
+        phaseTime[phase] += end - begin;
+        ++phaseFrames[phase];
+    }
+
+    GLuint frameCounters[2 * COUNTER_COUNT] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.counterBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(frameCounters), frameCounters);
+    for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+        counters[counter] += GLuint64(frameCounters[2 * counter + 1]) << 32 | frameCounters[2 * counter];
+
+    ++frames;
+    return true;
+}
+
+void GpuProfiler::Poll(bool wait)
+{
+    for (auto& slot : slots)
+        Collect(slot, wait);
+}
+
+bool GpuProfiler::ShouldReport(double interval) const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - intervalStart).count() >= interval;
+}
+
+void GpuProfiler::Report(std::ostream& out)
+{
+    // Formatted separately so the caller's stream flags are left alone
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(2);
+    text << "Profile of " << frames << (frames == 1 ? " frame" : " frames");
+    if (skippedFrames)
+        text << " (" << skippedFrames << " skipped while the GPU was behind)";
+    text << ":";
+
+    if (frames)
+    {
+        for (int phase = 0; phase < PHASE_COUNT; ++phase)
+        {
+            if (phaseFrames[phase])
+                text << " " << PHASE_NAMES[phase] << " " << 1e-6 * double(phaseTime[phase]) / phaseFrames[phase] << "ms";
+        }
+
+        const GLuint64 rays = counters[primaryRays] + counters[shadowRays] + counters[bounceRays];
+        const double perFrame = 1.0 / frames;
+        text << "\n  rays per frame: " << std::setprecision(0) << rays * perFrame
+            << " (" << counters[primaryRays] * perFrame << " primary, " << counters[bounceRays] * perFrame << " bounce, "
+            << counters[shadowRays] * perFrame << " shadow)";
+
+        // Throughput of the trace phase alone, presenting casts no rays
+        text << std::setprecision(2);
+        if (phaseTime[trace])
+            text << ", " << 1e3 * double(rays) / double(phaseTime[trace]) << " Mrays/s";
+        if (rays)
+            text << ", " << double(counters[nodeTests]) / rays << " node and " << double(counters[primitiveTests]) / rays << " primitive tests per ray";
+    }
+    out << text.str() << std::endl;
+
+    std::fill(std::begin(phaseTime), std::end(phaseTime), 0);
+    std::fill(std::begin(phaseFrames), std::end(phaseFrames), 0);
+    std::fill(std::begin(counters), std::end(counters), 0);
+    frames = skippedFrames = 0;
+    intervalStart = std::chrono::steady_clock::now();
+}
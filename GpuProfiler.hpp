@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+// Frame instrumentation for OpenGLView. Timestamp queries bracket each render phase and the shader counts its
+// rays and intersection tests into a buffer, both per frame in a small ring. Results are collected once the GPU
+// has finished with a frame, without waiting for it, so profiling does not serialize the CPU and GPU.
+// Every method, including the destructor, must be called on the thread that owns the GL context.
+class GpuProfiler
+{
+public:
+    enum Phase { trace, present, PHASE_COUNT };
+
+    // counterBinding is the shader storage binding of the shader's ray counter block
+    explicit GpuProfiler(GLuint counterBinding, GLuint frameCount = 4);
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // Starts recording a frame into the next free slot and binds its counters. If every slot is still in flight
+    // the frame is not recorded, rather than waiting for the GPU.
+    void BeginFrame();
+    void BeginPhase(Phase phase);
+    void EndPhase(Phase phase);
+    void EndFrame();
+
+    // Collects every finished frame, or waits for all of them
+    void Poll(bool wait = false);
+
+    // Whether interval seconds have passed since the last report
+    bool ShouldReport(double interval = 1.0) const;
+    // Prints per-phase GPU times, ray counts and throughput averaged over the frames since the last report,
+    // then starts a new interval
+    void Report(std::ostream& out);
+
+private:
+    // In the order of the shader's ray counter block, which holds each as a low and a high 32 bit word
+    enum Counter { primaryRays, shadowRays, bounceRays, nodeTests, primitiveTests, COUNTER_COUNT };
+
+    struct Slot
+    {
+        // Begin and end timestamp of each phase
+        GLuint queries[2 * PHASE_COUNT] = {};
+        GLuint counterBuffer = 0;
+        GLsync fence = 0;
+        // Phases recorded this frame, a bit per phase
+        GLuint phaseMask = 0;
+    };
+
+    // Returns false if the frame has not finished and wait is false
+    bool Collect(Slot& slot, bool wait);
+    Slot* CurrentSlot() { return recording ? &slots[currentSlot] : nullptr; }
+
+    GLuint counterBinding;
+    std::vector<Slot> slots;
+    size_t currentSlot = 0;
+    bool recording = false;
+
+    // Totals since the last report
+    GLuint64 phaseTime[PHASE_COUNT] = {};
+    size_t phaseFrames[PHASE_COUNT] = {};
+    GLuint64 counters[COUNTER_COUNT] = {};
+    size_t frames = 0, skippedFrames = 0;
+    std::chrono::steady_clock::time_point intervalStart = std::chrono::steady_clock::now();
+};
@@ -0,0 +1,59 @@
+#include "ImageExporter.hpp"
+#include "EXRExporter.hpp"
+#include "PFMExporter.hpp"
+#include "PNGExporter.h"
+#include "RawFrameExporter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <stdexcept>
+
+static std::string GetLowercaseExtension(const std::string& fileLoc)
+{
+    size_t dot = fileLoc.find_last_of('.');
+    size_t slash = fileLoc.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return "";
+
+    std::string extension = fileLoc.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+    return extension;
+}
+
+std::unique_ptr<ImageExporter> ImageExporter::ForFile(const std::string& outFileLoc, unsigned int pngBitDepth)
+{
+    const std::string extension = GetLowercaseExtension(outFileLoc);
+    if (extension == ".png")
+        return std::unique_ptr<ImageExporter>(new PNGExporter(pngBitDepth));
+    if (extension == ".exr")
+        return std::unique_ptr<ImageExporter>(new EXRExporter());
+    if (extension == ".pfm")
+        return std::unique_ptr<ImageExporter>(new PFMExporter());
+    if (extension == ".rtfb")
+        return std::unique_ptr<ImageExporter>(new RawFrameExporter());
+
+    throw std::runtime_error("Unsupported output format '" + outFileLoc + "', expected .png, .exr, .pfm or .rtfb.");
+}
+
+bool ImageExporter::IsHighPrecision(const std::string& outFileLoc, unsigned int pngBitDepth)
+{
+    return GetLowercaseExtension(outFileLoc) != ".png" || pngBitDepth > 8;
+}
+
+bool ImageExporter::Export(const std::string& outFileLoc, unsigned int width, unsigned int height, const float* pixelData, unsigned int pngBitDepth)
+{
+    try {
+        auto exporter = ForFile(outFileLoc, pngBitDepth);
+        exporter->Begin(outFileLoc, width, height);
+        for (unsigned int row = 0; row < height; ++row)
+            exporter->WriteRows(pixelData + size_t(height - 1 - row) * width * 3, 1);
+        exporter->End();
+    }
+    catch (const std::exception& err) {
+        std::cerr << "Error writing file: " << outFileLoc << "\n\t" << err.what() << std::endl;
+        return false;
+    }
+
+    std::cout << "Exported to '" << outFileLoc << "'" << std::endl;
+    return true;
+}
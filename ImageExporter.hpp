@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+// Writes an image one band of scanlines at a time, so a frame never has to be held in memory as a whole.
+// Rows are linear RGB floats and must arrive top-down, each exactly once, between Begin and End.
+// Implementations throw std::runtime_error when the file cannot be written.
+class ImageExporter
+{
+public:
+    virtual ~ImageExporter() = default;
+
+    virtual void Begin(const std::string& outFileLoc, unsigned int width, unsigned int height) = 0;
+    // rowCount rows of width * 3 floats, continuing where the previous call stopped
+    virtual void WriteRows(const float* pixelData, unsigned int rowCount) = 0;
+    virtual void End() = 0;
+
+    // Chooses the format from the file extension: .png, .exr, .pfm or .rtfb (see RawFrameExporter).
+    // pngBitDepth is 8 or 16. Throws std::runtime_error for unknown extensions.
+    static std::unique_ptr<ImageExporter> ForFile(const std::string& outFileLoc, unsigned int pngBitDepth = 8);
+
+    // Whether the format keeps more precision than an 8 bit framebuffer can provide
+    static bool IsHighPrecision(const std::string& outFileLoc, unsigned int pngBitDepth = 8);
+
+    // Exports a whole frame of width * height bottom-up RGB floats, as read back from OpenGL.
+    // Errors are reported on stderr instead of thrown, returns false if the file could not be written.
+    static bool Export(const std::string& outFileLoc, unsigned int width, unsigned int height, const float* pixelData, unsigned int pngBitDepth = 8);
+};
@@ -0,0 +1,80 @@
+#include "LightTree.hpp"
+#include "BVH.hpp"
+#include <algorithm>
+
+LightTree::LightTree(const std::vector<Light>& lights)
+{
+    // Scene lights are always points, placed by the transforms above them
+    std::vector<GLuint> pointLights(lights.size());
+    for (GLuint ii = 0; ii < GLuint(lights.size()); ++ii)
+    {
+        ambient += lights[ii].ambient;
+        pointLights[ii] = ii;
+    }
+
+    if (pointLights.empty())
+        return;
+
+    struct BuildTask {
+        GLuint nodeIndex, first, count;
+    };
+    std::vector<BuildTask> tasks;
+
+    nodes.reserve(2 * pointLights.size() - 1);
+    nodes.push_back(LightTreeNode());
+    tasks.push_back({ 0, 0, GLuint(pointLights.size()) });
+
+    while (!tasks.empty())
+    {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+
+        AABB bounds;
+        float power = 0.f;
+        for (GLuint ii = task.first; ii < task.first + task.count; ++ii)
+        {
+            const Light& light = lights[pointLights[ii]];
+            bounds.Grow(glm::vec3(light.lightPosition));
+            // Ambient is excluded, it is added without sampling
+            glm::vec3 intensity = glm::max(light.diffuse, 0.f) + glm::max(light.specular, 0.f);
+            power += intensity.x + intensity.y + intensity.z;
+        }
+
+        LightTreeNode& node = nodes[task.nodeIndex];
+        node.boundsMin = bounds.min;
+        node.boundsMax = bounds.max;
+        node.power = power;
+
+        if (task.count == 1)
+        {
+            node.leftOrFirst = pointLights[task.first];
+            node.lightCount = 1;
+            continue;
+        }
+
+        // Median split along the longest axis keeps the tree balanced, so every light is reached in log2(n) steps
+        glm::vec3 extent = bounds.max - bounds.min;
+        int axis = 0;
+        if (extent.y > extent[axis]) axis = 1;
+        if (extent.z > extent[axis]) axis = 2;
+
+        GLuint* first = pointLights.data() + task.first;
+        GLuint* middle = first + task.count / 2;
+        std::nth_element(first, middle, first + task.count, [&](GLuint a, GLuint b)
+            {
+                return lights[a].lightPosition[axis] < lights[b].lightPosition[axis];
+            });
+
+        GLuint leftCount = task.count / 2;
+        GLuint leftIndex = GLuint(nodes.size());
+        nodes.push_back(LightTreeNode());
+        nodes.push_back(LightTreeNode());
+
+        // 'node' may have been invalidated by the pushes above
+        nodes[task.nodeIndex].leftOrFirst = leftIndex;
+        nodes[task.nodeIndex].lightCount = 0;
+
+        tasks.push_back({ leftIndex, task.first, leftCount });
+        tasks.push_back({ leftIndex + 1, task.first + leftCount, task.count - leftCount });
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Light.hpp"
+
+// Flattened node, laid out to match the std430 'LightTreeNode' struct in shade_and_reflect.glsl.
+// Interior nodes store the index of their left child, the right child always follows it.
+// Every leaf holds exactly one light.
+struct LightTreeNode
+{
+    glm::vec3 boundsMin;
+    GLuint leftOrFirst; // left child index for interior nodes, index into the model's lights for leaves
+    glm::vec3 boundsMax;
+    GLuint lightCount; // 1 for leaves, 0 for interior nodes
+    // Summed diffuse and specular intensity of every light below the node
+    GLfloat power;
+    GLfloat padding[3] = { 0.f, 0.f, 0.f };
+};
+static_assert(sizeof(LightTreeNode) == 48, "LightTreeNode must match the std430 layout used by the shader");
+
+// Bounding volume hierarchy over the point lights, with each node's aggregated power, for scenes with
+// too many lights to shade every one at every hit. Shading points walk it from the root, picking a child
+// by how much light it could deliver to them, so each sample costs one shadow ray however many lights
+// there are.
+class LightTree
+{
+public:
+    LightTree() = default;
+    explicit LightTree(const std::vector<Light>& lights);
+
+    // Empty when the scene has no point lights
+    const std::vector<LightTreeNode>& GetNodes() const { return nodes; }
+    // Summed ambient term of every light, ambient light is never shadowed so it needs no sampling
+    glm::vec3 GetAmbient() const { return ambient; }
+
+    GLuint GetPointLightCount() const { return GLuint(nodes.size() + 1) / 2; }
+    // Whether shading points should sample lightSamples point lights from the tree instead of shading
+    // each of them, only worth it once there are more lights than samples
+    bool ShouldSample(GLuint lightSamples) const { return lightSamples > 0 && GetPointLightCount() > lightSamples; }
+
+private:
+    std::vector<LightTreeNode> nodes;
+    glm::vec3 ambient{ 0.f, 0.f, 0.f };
+};
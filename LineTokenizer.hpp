@@ -0,0 +1,51 @@
+#pragma once
+
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+// Splits a line into whitespace separated tokens without copying it
+class LineTokenizer
+{
+public:
+    explicit LineTokenizer(std::string_view line) : rest(line) {}
+
+    static bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    bool Next(std::string_view& o_token)
+    {
+        size_t start = 0;
+        while (start < rest.size() && IsSpace(rest[start])) ++start;
+        if (start == rest.size()) return false;
+
+        size_t end = start;
+        while (end < rest.size() && !IsSpace(rest[end])) ++end;
+
+        o_token = rest.substr(start, end - start);
+        rest.remove_prefix(end);
+        return true;
+    }
+
+    bool NextFloat(float& o_value)
+    {
+        std::string_view token;
+        if (!Next(token)) return false;
+        return ParseFloat(token, o_value);
+    }
+
+    // The whole token must be a number
+    static bool ParseFloat(std::string_view token, float& o_value)
+    {
+        // from_chars does not take the leading '+' that stream extraction allows
+        if (token.size() > 1 && token[0] == '+') token.remove_prefix(1);
+
+        auto result = std::from_chars(token.data(), token.data() + token.size(), o_value);
+        return result.ec == std::errc() && result.ptr == token.data() + token.size();
+    }
+
+private:
+    std::string_view rest;
+};
@@ -0,0 +1,192 @@
+#include "MappedFile.hpp"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    Close();
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    std::swap(writable, other.writable);
+#ifdef _WIN32
+    std::swap(fileHandle, other.fileHandle);
+    std::swap(mappingHandle, other.mappingHandle);
+#else
+    std::swap(fileDescriptor, other.fileDescriptor);
+#endif
+    return *this;
+}
+
+#ifdef _WIN32
+
+MappedFile MappedFile::OpenRead(const std::string& fileLoc)
+{
+    MappedFile file;
+    HANDLE handle = CreateFileA(fileLoc.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Unable to open '" + fileLoc + "'.");
+    file.fileHandle = handle;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize))
+        throw std::runtime_error("Unable to read the size of '" + fileLoc + "'.");
+    file.size = size_t(fileSize.QuadPart);
+
+    // Empty files cannot be mapped, they are left with no data
+    if (file.size == 0)
+        return file;
+
+    file.mappingHandle = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!file.mappingHandle)
+        throw std::runtime_error("Unable to map '" + fileLoc + "'.");
+
+    file.data = static_cast<char*>(MapViewOfFile(file.mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!file.data)
+        throw std::runtime_error("Unable to map '" + fileLoc + "'.");
+
+    return file;
+}
+
+MappedFile MappedFile::Create(const std::string& fileLoc, size_t size)
+{
+    MappedFile file;
+    HANDLE handle = CreateFileA(fileLoc.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Unable to create '" + fileLoc + "'.");
+    file.fileHandle = handle;
+    file.size = size;
+    file.writable = true;
+
+    if (size == 0)
+        return file;
+
+    const unsigned long long mappingSize = size;
+    file.mappingHandle = CreateFileMappingA(handle, NULL, PAGE_READWRITE, DWORD(mappingSize >> 32), DWORD(mappingSize & 0xFFFFFFFF), NULL);
+    if (!file.mappingHandle)
+        throw std::runtime_error("Unable to map '" + fileLoc + "'.");
+
+    file.data = static_cast<char*>(MapViewOfFile(file.mappingHandle, FILE_MAP_WRITE, 0, 0, 0));
+    if (!file.data)
+        throw std::runtime_error("Unable to map '" + fileLoc + "'.");
+
+    return file;
+}
+
+void MappedFile::Flush()
+{
+    if (data && writable)
+    {
+        FlushViewOfFile(data, 0);
+        FlushFileBuffers(fileHandle);
+    }
+}
+
+void MappedFile::Close()
+{
+    if (data)
+        UnmapViewOfFile(data);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+
+    data = nullptr;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+    size = 0;
+    writable = false;
+}
+
+#else
+
+MappedFile MappedFile::OpenRead(const std::string& fileLoc)
+{
+    MappedFile file;
+    file.fileDescriptor = open(fileLoc.c_str(), O_RDONLY);
+    if (file.fileDescriptor < 0)
+        throw std::runtime_error("Unable to open '" + fileLoc + "'.");
+
+    struct stat fileStat;
+    if (fstat(file.fileDescriptor, &fileStat) != 0)
+        throw std::runtime_error("Unable to read the size of '" + fileLoc + "'.");
+    file.size = size_t(fileStat.st_size);
+
+    // Empty files cannot be mapped, they are left with no data
+    if (file.size == 0)
+        return file;
+
+    void* mapping = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, file.fileDescriptor, 0);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("Unable to map '" + fileLoc + "'.");
+    file.data = static_cast<char*>(mapping);
+
+    return file;
+}
+
+MappedFile MappedFile::Create(const std::string& fileLoc, size_t size)
+{
+    MappedFile file;
+    file.fileDescriptor = open(fileLoc.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file.fileDescriptor < 0)
+        throw std::runtime_error("Unable to create '" + fileLoc + "'.");
+    file.size = size;
+    file.writable = true;
+
+    if (size == 0)
+        return file;
+
+    if (ftruncate(file.fileDescriptor, off_t(size)) != 0)
+        throw std::runtime_error("Unable to resize '" + fileLoc + "'.");
+
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fileDescriptor, 0);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("Unable to map '" + fileLoc + "'.");
+    file.data = static_cast<char*>(mapping);
+
+    return file;
+}
+
+void MappedFile::Flush()
+{
+    if (data && writable)
+        msync(data, size, MS_SYNC);
+}
+
+void MappedFile::Close()
+{
+    if (data)
+        munmap(data, size);
+    if (fileDescriptor >= 0)
+        close(fileDescriptor);
+
+    data = nullptr;
+    fileDescriptor = -1;
+    size = 0;
+    writable = false;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// File mapped into memory, either read-only or created at a fixed size for writing.
+// Throws std::runtime_error if the file cannot be opened or mapped.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    static MappedFile OpenRead(const std::string& fileLoc);
+    // Creates or truncates the file to size bytes and maps it writable
+    static MappedFile Create(const std::string& fileLoc, size_t size);
+
+    const char* GetData() const { return data; }
+    char* GetWritableData() { return writable ? data : nullptr; }
+    size_t GetSize() const { return size; }
+
+    // Writes dirty pages back to the file before returning
+    void Flush();
+    void Close();
+
+private:
+    char* data = nullptr;
+    size_t size = 0;
+    bool writable = false;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+};
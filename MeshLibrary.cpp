@@ -0,0 +1,57 @@
+#include "MeshLibrary.hpp"
+#include "ObjLoader.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+MeshLibrary::MeshLibrary(std::vector<MeshVertex> vertices, std::vector<GLuint> indices, std::vector<BVHNode> nodes, GLuint depth) :
+    vertices(std::move(vertices)), indices(std::move(indices)), nodes(std::move(nodes)), depth(depth)
+{
+}
+
+GLuint MeshLibrary::Add(const std::string& objFileLoc)
+{
+    const size_t firstIndex = indices.size();
+    ObjLoader::Load(objFileLoc, vertices, indices);
+
+    const GLuint triangleCount = GLuint((indices.size() - firstIndex) / 3);
+    if (triangleCount == 0)
+        throw std::runtime_error("Mesh file '" + objFileLoc + "' has no faces.");
+
+    std::vector<AABB> triangleBounds(triangleCount);
+    for (GLuint ii = 0; ii < triangleCount; ++ii)
+    {
+        for (int corner = 0; corner < 3; ++corner)
+            triangleBounds[ii].Grow(vertices[indices[firstIndex + 3 * ii + corner]].position);
+    }
+
+    BVH bvh(triangleBounds);
+    depth = std::max(depth, bvh.GetDepth());
+
+    // Store the triangles in leaf order so leaves can index them without a separate index array
+    const std::vector<GLuint>& order = bvh.GetPrimitiveIndices();
+    std::vector<GLuint> sorted(3 * size_t(triangleCount));
+    for (GLuint ii = 0; ii < triangleCount; ++ii)
+    {
+        for (int corner = 0; corner < 3; ++corner)
+            sorted[3 * ii + corner] = indices[firstIndex + 3 * order[ii] + corner];
+    }
+    std::copy(sorted.begin(), sorted.end(), indices.begin() + firstIndex);
+
+    // Rebase child links and leaf ranges onto the shared arrays
+    const GLuint rootNode = GLuint(nodes.size());
+    const GLuint firstTriangle = GLuint(firstIndex / 3);
+    for (BVHNode node : bvh.GetNodes())
+    {
+        node.leftOrFirst += node.primCount > 0 ? firstTriangle : rootNode;
+        nodes.push_back(node);
+    }
+    return rootNode;
+}
+
+AABB MeshLibrary::GetBounds(GLuint rootNode) const
+{
+    AABB bounds;
+    bounds.min = nodes[rootNode].boundsMin;
+    bounds.max = nodes[rootNode].boundsMax;
+    return bounds;
+}
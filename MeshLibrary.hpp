@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "BVH.hpp"
+
+// Laid out like the std430 'MeshVertex' struct in shade_and_reflect.glsl
+struct MeshVertex
+{
+    glm::vec3 position;
+    float padding0 = 0.f;
+    // Zero when the file has no normal for the vertex, the face normal is used instead
+    glm::vec3 normal;
+    float padding1 = 0.f;
+};
+static_assert(sizeof(MeshVertex) == 32, "MeshVertex must match the std430 'MeshVertex' struct");
+
+// Triangle meshes of a scene. Every mesh shares one vertex, index and node array so they upload as single
+// buffers, and gets its own BVH over its triangles. Objects of type mesh refer to a mesh by the root of
+// that BVH and place it with their own transform, so a mesh loaded once can be drawn any number of times.
+//
+// Triangles are stored in the order of their BVH's leaves, so a leaf's leftOrFirst is the index of its
+// first triangle and indices[3 * triangle + corner] is an index into vertices.
+class MeshLibrary
+{
+public:
+    MeshLibrary() = default;
+    // Adopts meshes loaded earlier, e.g. ones stored in a compiled scene file
+    MeshLibrary(std::vector<MeshVertex> vertices, std::vector<GLuint> indices, std::vector<BVHNode> nodes, GLuint depth);
+
+    // Loads an OBJ file and builds its BVH, returns the BVH's root node.
+    // Throws std::runtime_error if the file is missing, malformed or has no faces.
+    GLuint Add(const std::string& objFileLoc);
+
+    // Mesh space bounds of the mesh with the given root node
+    AABB GetBounds(GLuint rootNode) const;
+
+    const std::vector<MeshVertex>& GetVertices() const { return vertices; }
+    const std::vector<GLuint>& GetIndices() const { return indices; }
+    const std::vector<BVHNode>& GetNodes() const { return nodes; }
+    // Deepest root to leaf path of any mesh's BVH
+    GLuint GetDepth() const { return depth; }
+
+private:
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<BVHNode> nodes;
+    GLuint depth = 0;
+};
@@ -0,0 +1,120 @@
+#include "ObjLoader.hpp"
+#include "LineTokenizer.hpp"
+#include "MappedFile.hpp"
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+
+static std::runtime_error ObjError(const std::string& objFileLoc, size_t lineNum, const std::string& message)
+{
+    return std::runtime_error("Error parsing mesh file '" + objFileLoc + "' at line " + std::to_string(lineNum) + ":\n\t" + message);
+}
+
+// Resolves a 1-based or negative (relative to the end) OBJ index, returns false if it is out of range
+static bool ParseIndex(std::string_view token, size_t count, size_t& o_index)
+{
+    long long value = 0;
+    auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (result.ec != std::errc() || result.ptr != token.data() + token.size() || value == 0)
+        return false;
+
+    const long long resolved = value > 0 ? value - 1 : (long long)count + value;
+    if (resolved < 0 || resolved >= (long long)count)
+        return false;
+
+    o_index = size_t(resolved);
+    return true;
+}
+
+void ObjLoader::Load(const std::string& objFileLoc, std::vector<MeshVertex>& io_vertices, std::vector<GLuint>& io_indices)
+{
+    MappedFile file;
+    try
+    {
+        file = MappedFile::OpenRead(objFileLoc);
+    }
+    catch (const std::exception&)
+    {
+        throw std::runtime_error("Mesh file '" + objFileLoc + "' could not be found.");
+    }
+
+    std::vector<glm::vec3> positions, normals;
+    // Mesh vertex of each position used without a normal, and of each position and normal pair
+    std::vector<GLuint> positionVertices;
+    std::unordered_map<uint64_t, GLuint> pairVertices;
+    std::vector<GLuint> polygon;
+
+    std::string_view contents(file.GetData(), file.GetSize());
+    size_t lineNum = 0;
+
+    while (!contents.empty())
+    {
+        ++lineNum;
+        size_t lineEnd = contents.find('\n');
+        std::string_view line = contents.substr(0, lineEnd);
+        contents.remove_prefix(lineEnd == std::string_view::npos ? contents.size() : lineEnd + 1);
+
+        LineTokenizer stream(line);
+        std::string_view command;
+        if (!stream.Next(command) || command[0] == '#')
+            continue;
+
+        if (command == "v" || command == "vn")
+        {
+            glm::vec3 value;
+            if (!stream.NextFloat(value.x) || !stream.NextFloat(value.y) || !stream.NextFloat(value.z))
+                throw ObjError(objFileLoc, lineNum, std::string(command) + " expects 3 numbers");
+
+            if (command == "v")
+            {
+                positions.push_back(value);
+                positionVertices.push_back(UINT32_MAX);
+            }
+            else
+                normals.push_back(value);
+        }
+        else if (command == "f")
+        {
+            polygon.clear();
+            std::string_view corner;
+            while (stream.Next(corner))
+            {
+                // v, v/vt, v//vn or v/vt/vn
+                const size_t firstSlash = corner.find('/');
+                const size_t lastSlash = corner.rfind('/');
+                const bool hasNormal = firstSlash != std::string_view::npos && lastSlash != firstSlash;
+
+                size_t position = 0, normal = 0;
+                if (!ParseIndex(corner.substr(0, firstSlash), positions.size(), position))
+                    throw ObjError(objFileLoc, lineNum, "face references undefined vertex '" + std::string(corner) + "'");
+                if (hasNormal && !ParseIndex(corner.substr(lastSlash + 1), normals.size(), normal))
+                    throw ObjError(objFileLoc, lineNum, "face references undefined normal '" + std::string(corner) + "'");
+
+                GLuint* vertex = &positionVertices[position];
+                if (hasNormal)
+                    vertex = &pairVertices.emplace(uint64_t(position) << 32 | uint64_t(normal), UINT32_MAX).first->second;
+
+                if (*vertex == UINT32_MAX)
+                {
+                    *vertex = GLuint(io_vertices.size());
+                    MeshVertex meshVertex;
+                    meshVertex.position = positions[position];
+                    meshVertex.normal = hasNormal ? normals[normal] : glm::vec3(0.f);
+                    io_vertices.push_back(meshVertex);
+                }
+                polygon.push_back(*vertex);
+            }
+
+            if (polygon.size() < 3)
+                throw ObjError(objFileLoc, lineNum, "face needs at least 3 vertices, found " + std::to_string(polygon.size()));
+
+            for (size_t ii = 2; ii < polygon.size(); ++ii)
+            {
+                io_indices.push_back(polygon[0]);
+                io_indices.push_back(polygon[ii - 1]);
+                io_indices.push_back(polygon[ii]);
+            }
+        }
+    }
+}
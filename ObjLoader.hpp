@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include "MeshLibrary.hpp"
+
+// Streaming reader for the geometry in Wavefront OBJ files. The file is memory mapped and read line by line
+// straight into the caller's arrays. Only 'v', 'vn' and 'f' are read; polygons are split into triangle fans,
+// and texture coordinates, groups and materials are skipped.
+class ObjLoader
+{
+public:
+    // Appends the file's vertices and triangles, indices count from the vertices already in io_vertices.
+    // Throws std::runtime_error naming the line of malformed input.
+    static void Load(const std::string& objFileLoc, std::vector<MeshVertex>& io_vertices, std::vector<GLuint>& io_indices);
+};
@@ -1,26 +1,36 @@
 #pragma once
 #include "Material.hpp"
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
+// Laid out like the std430 'ObjectData' struct in shade_and_reflect.glsl, so object arrays are
+// uploaded and written to compiled scene files as-is. Materials live in the model's material table.
 struct ObjectData
 {
     enum class PrimativeType : GLuint {
         sphere,
-        box
+        box,
+        mesh
     };
 
-    ObjectData(PrimativeType type, Material& mat, glm::mat4 mv) :
-        mat(mat),
+    ObjectData(PrimativeType type, GLuint materialIndex, glm::mat4 mv, GLuint meshRoot = 0) :
         mv(mv),
         mvInverse(glm::inverse(mv)),
         mvInverseTranspose(glm::transpose(mvInverse)),
-        type(type)
+        type(type),
+        materialIndex(materialIndex),
+        meshRoot(meshRoot)
     {
     }
 
-    Material mat;
     glm::mat4 mv, mvInverse, mvInverseTranspose;
     PrimativeType type;
+    // Index into OpenGLModel::materials
+    GLuint materialIndex;
+    // Root node of a mesh object's BVH in MeshLibrary, unused by other types
+    GLuint meshRoot;
+    GLuint padding = 0;
 
 };
+static_assert(sizeof(ObjectData) == 208, "ObjectData must match the std430 'ObjectData' struct");
 
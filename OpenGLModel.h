@@ -1,19 +1,62 @@
 #pragma once
 #include <glad/glad.h>
 #include <vector>
+#include "Camera.hpp"
 #include "Material.hpp"
 #include "ObjectData.hpp"
 #include "Light.hpp"
+#include "LightTree.hpp"
+#include "MeshLibrary.hpp"
+#include "SceneAnimation.hpp"
+#include "TwoLevelBVH.hpp"
 
 struct OpenGLModel
 {
-    OpenGLModel(const GLuint maxBounces, const std::vector<ObjectData>& objs, const std::vector<Light>& lights) :
-        MAX_BOUNCES(maxBounces), objs(objs), lights(lights)
+    // A previous model of the same scene lets the BVH keep the bottom levels of prototypes that did not change
+    OpenGLModel(const GLuint maxBounces, const std::vector<Material>& materials, const std::vector<ObjectData>& objs, const std::vector<Light>& lights,
+        MeshLibrary meshes, const std::vector<Prototype>& prototypes, std::vector<InstanceData> instances, const Camera& camera,
+        SceneAnimation animation = SceneAnimation(), const OpenGLModel* previous = nullptr) :
+        MAX_BOUNCES(maxBounces), materials(materials), objs(objs), lights(lights), lightTree(this->lights), meshes(std::move(meshes)),
+        bvh(this->objs, this->meshes, prototypes, std::move(instances),
+            previous ? PreviousBVHBuild{ &previous->bvh, &previous->objs, &previous->meshes } : PreviousBVHBuild()),
+        camera(camera), animation(std::move(animation))
+    {
+    }
+
+    // Takes a BVH that was already built over objs, see BinaryScene
+    OpenGLModel(const GLuint maxBounces, std::vector<Material> materials, std::vector<ObjectData> objs, std::vector<Light> lights, MeshLibrary meshes, TwoLevelBVH bvh,
+        const Camera& camera) :
+        MAX_BOUNCES(maxBounces), materials(std::move(materials)), objs(std::move(objs)), lights(std::move(lights)), lightTree(this->lights),
+        meshes(std::move(meshes)), bvh(std::move(bvh)), camera(camera)
     {
     }
 
     const GLuint MAX_BOUNCES;
-    const std::vector<ObjectData> objs;
-    const std::vector<Light> lights;
+    // Interned materials, indexed by ObjectData::materialIndex
+    const std::vector<Material> materials;
+    // Objects of every prototype, each stored once however often it is instanced. SetFrame moves the animated ones.
+    std::vector<ObjectData> objs;
+    std::vector<Light> lights;
+    // Hierarchy over the lights for sampling them, cheap enough to rebuild on every load and every animated frame
+    LightTree lightTree;
+    // Triangle meshes placed by mesh objects, each with its own BVH
+    const MeshLibrary meshes;
+    // Acceleration structure over the instances and objs, shared by every backend. Refit rather than rebuilt by SetFrame.
+    TwoLevelBVH bvh;
+    // Everything above is in world space, so the camera can move without touching it, see OpenGLView::SetCamera
+    Camera camera;
+    // Loaded at its first frame. Compiled scenes are never animated.
+    SceneAnimation animation;
+
+    // Moves the animated objects, lights and instances to frame and refits the BVH around them.
+    // Upload the change with OpenGLView::UploadFrame.
+    void SetFrame(GLuint frame)
+    {
+        std::vector<InstanceData> instances = bvh.GetInstances();
+        animation.Apply(float(frame), objs, lights, instances);
+        if (animation.HasAnimatedLights())
+            lightTree = LightTree(lights);
+        bvh.Refit(objs, meshes, instances, animation.GetAnimatedPrototypes());
+    }
 };
 
@@ -1,76 +1,691 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <vector>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 
+#include "BatchManifest.hpp"
+#include "BenchmarkReport.hpp"
+#include "BinaryScene.hpp"
+#include "CostHeatmap.hpp"
+#include "CPURenderer.hpp"
+#include "FileWatcher.hpp"
+#include "FrameExportQueue.hpp"
 #include "Light.hpp"
 #include "ObjectData.hpp"
 #include "OpenGLView.hpp"
-#include "PNGExporter.h"
+#include "ImageExporter.hpp"
+#include "RenderOptions.hpp"
+#include "SceneGenerator.hpp"
 #include "SceneLoader.hpp"
 
+using Clock = std::chrono::high_resolution_clock;
+
+static double MillisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Loads a text scene, or a compiled '.rtscene' file without parsing or rebuilding the BVH.
+// Throws std::runtime_error with the loader's message on failure.
+// Reloads of an edited scene pass the model they replace, so unchanged parts of its BVH are kept
+static std::unique_ptr<OpenGLModel> LoadModel(const std::string& sceneFileLoc, const OpenGLModel* previous = nullptr)
+{
+    if (BinaryScene::IsBinaryScene(sceneFileLoc))
+        return BinaryScene::Read(sceneFileLoc);
+
+    std::vector<Material> materials;
+    std::vector<ObjectData> objects;
+    std::vector<Light> lights;
+    MeshLibrary meshes;
+    std::vector<Prototype> prototypes;
+    std::vector<InstanceData> instances;
+    Camera camera;
+    SceneAnimation animation;
+    SceneLoader loader;
+    loader.Load(sceneFileLoc, materials, objects, lights, meshes, prototypes, instances, camera, animation);
+    return std::unique_ptr<OpenGLModel>(new OpenGLModel(8, materials, objects, lights, std::move(meshes), prototypes, std::move(instances), camera,
+        std::move(animation), previous));
+}
+
+template<typename T>
+static bool IsSameArray(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+static bool IsSameModel(const OpenGLModel& a, const OpenGLModel& b)
+{
+    return a.MAX_BOUNCES == b.MAX_BOUNCES && a.camera == b.camera && IsSameArray(a.materials, b.materials) && IsSameArray(a.objs, b.objs)
+        && IsSameArray(a.lights, b.lights) && IsSameArray(a.bvh.GetInstances(), b.bvh.GetInstances())
+        && IsSameArray(a.bvh.GetNodes(), b.bvh.GetNodes()) && IsSameArray(a.bvh.GetPrimitiveIndices(), b.bvh.GetPrimitiveIndices())
+        && a.bvh.GetTopLevelDepth() == b.bvh.GetTopLevelDepth() && a.bvh.GetBottomLevelDepth() == b.bvh.GetBottomLevelDepth()
+        && IsSameArray(a.meshes.GetVertices(), b.meshes.GetVertices()) && IsSameArray(a.meshes.GetIndices(), b.meshes.GetIndices())
+        && IsSameArray(a.meshes.GetNodes(), b.meshes.GetNodes()) && a.meshes.GetDepth() == b.meshes.GetDepth();
+}
+
+// Shortest of a few loads, to keep the first load's cold file cache out of the comparison
+static double TimeLoad(const std::string& sceneFileLoc)
+{
+    double bestTime = 0;
+    for (int run = 0; run < 5; ++run) {
+        auto startTime = Clock::now();
+        LoadModel(sceneFileLoc);
+        const double loadTime = MillisecondsSince(startTime);
+        bestTime = run == 0 ? loadTime : std::min(bestTime, loadTime);
+    }
+    return bestTime;
+}
+
+// Writes the scene as a '.rtscene' file, reads it back to check the round trip and compares load times
+static int CompileScene(const std::string& sceneFileLoc, const std::string& binaryFileLoc)
+{
+    try {
+        auto model = LoadModel(sceneFileLoc);
+        if (model->animation.HasFrameRange()) {
+            std::cout << "'" << sceneFileLoc << "' is animated, compiled scenes only hold a single frame." << std::endl;
+            return 1;
+        }
+        BinaryScene::Write(binaryFileLoc, *model);
+
+        auto compiled = BinaryScene::Read(binaryFileLoc);
+        if (!IsSameModel(*model, *compiled)) {
+            std::cout << "Round trip failed, '" << binaryFileLoc << "' does not load the same scene as '" << sceneFileLoc << "'." << std::endl;
+            return 1;
+        }
+
+        std::cout << "Compiled '" << sceneFileLoc << "' to '" << binaryFileLoc << "': " << model->materials.size() << " materials, "
+            << model->objs.size() << " objects, " << model->lights.size() << " lights, " << model->bvh.GetInstances().size() << " instances, "
+            << model->bvh.GetNodes().size() << " BVH nodes, " << model->meshes.GetIndices().size() / 3 << " mesh triangles.\n";
+    }
+    catch (const std::exception& err) {
+        std::cout << err.what() << std::endl;
+        return 1;
+    }
+
+    const double textLoadTime = TimeLoad(sceneFileLoc);
+    const double binaryLoadTime = TimeLoad(binaryFileLoc);
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Load time: text " << textLoadTime << "ms, binary " << binaryLoadTime << "ms ("
+        << textLoadTime / std::max(binaryLoadTime, 0.001) << "x faster).\n";
+    return 0;
+}
+
+// Renders every job in the manifest offscreen. The context, shader program and CPU worker threads
+// are created once, so each job only pays for loading and uploading its scene.
+static int RunBatch(const RenderOptions& options)
+{
+    std::vector<BatchJob> jobs;
+    try {
+        jobs = LoadBatchManifest(options.batchManifestLoc);
+    }
+    catch (const std::exception& err) {
+        std::cout << err.what() << std::endl;
+        return 1;
+    }
+
+    auto batchStartTime = Clock::now();
+
+    OpenGLView view;
+    view.SetShaderCacheDirectory(options.shaderCacheDir);
+    view.SetSampleCount(options.samples);
+    view.SetLightSampleCount(options.lightSamples);
+    view.SetWavefront(options.wavefront);
+    for (auto& job : jobs)
+        if (ImageExporter::IsHighPrecision(job.outFileLoc, options.pngBitDepth))
+            view.SetFloatRenderTarget(true);
+    std::unique_ptr<CPURenderer> cpuRenderer;
+    if (!options.useCPU)
+        view.SetUpWindow(options.width, options.height, true);
+    const double setupTime = MillisecondsSince(batchStartTime);
+
+    std::cout << std::fixed << std::setprecision(2);
+
+    size_t failedJobs = 0;
+    double totalLoadTime = 0, totalUploadTime = 0, totalRenderTime = 0;
+    FrameExportQueue cpuExports;
+    for (size_t ii = 0; ii < jobs.size(); ++ii) {
+        const BatchJob& job = jobs[ii];
+        std::cout << "[" << ii + 1 << "/" << jobs.size() << "] " << job.sceneFileLoc << std::endl;
+
+        // Loading includes building the BVH
+        auto startTime = Clock::now();
+        std::unique_ptr<OpenGLModel> modelPtr;
+        try {
+            modelPtr = LoadModel(job.sceneFileLoc);
+        }
+        catch (const std::exception& err) {
+            std::cout << err.what() << std::endl;
+            ++failedJobs;
+            continue;
+        }
+        OpenGLModel& model = *modelPtr;
+        options.OverrideCamera(model.camera);
+        const double loadTime = MillisecondsSince(startTime);
+
+        startTime = Clock::now();
+        if (!options.useCPU)
+            view.SetModel(model);
+        else if (!cpuRenderer) {
+            cpuRenderer.reset(new CPURenderer(model));
+            cpuRenderer->SetSampleCount(options.samples);
+            cpuRenderer->SetLightSampleCount(options.lightSamples);
+        }
+        else
+            cpuRenderer->SetModel(model);
+        const double uploadTime = MillisecondsSince(startTime);
+
+        // The GPU frame is only submitted here, its readback and export overlap the next job
+        startTime = Clock::now();
+        if (options.useCPU) {
+            GLuint width = options.width, height = options.height;
+            cpuExports.Export(cpuRenderer->Render(width, height), width, height, job.outFileLoc, options.pngBitDepth);
+        }
+        else {
+            while (!view.IsConverged())
+                view.Render();
+            view.ExportFrameAsync(job.outFileLoc, options.pngBitDepth);
+        }
+        const double renderTime = MillisecondsSince(startTime);
+
+        std::cout << "    load " << loadTime << "ms, upload " << uploadTime << "ms, render " << renderTime << "ms\n";
+
+        totalLoadTime += loadTime;
+        totalUploadTime += uploadTime;
+        totalRenderTime += renderTime;
+    }
+
+    // Exports run on a writer thread, only their total is known. Jobs whose file could not be written failed too.
+    double totalExportTime = 0;
+    if (options.useCPU) {
+        totalExportTime = cpuExports.Finish();
+        failedJobs += cpuExports.GetFailedCount();
+    }
+    else {
+        totalExportTime = view.FinishExports();
+        failedJobs += view.GetFailedExportCount();
+        view.TearDownWindow();
+    }
+
+    const size_t finishedJobs = jobs.size() - failedJobs;
+    std::cout << "Rendered " << finishedJobs << " of " << jobs.size() << " jobs in " << MillisecondsSince(batchStartTime)
+        << "ms, setup " << setupTime << "ms.\n";
+    if (finishedJobs > 0) {
+        std::cout << "Totals: load " << totalLoadTime << "ms, upload " << totalUploadTime << "ms, render " << totalRenderTime
+            << "ms, export " << totalExportTime << "ms\n";
+        std::cout << "Per job: load " << totalLoadTime / finishedJobs << "ms, upload " << totalUploadTime / finishedJobs
+            << "ms, render " << totalRenderTime / finishedJobs << "ms, export " << totalExportTime / finishedJobs << "ms\n";
+    }
+
+    return failedJobs == 0 ? 0 : 1;
+}
+
+// Output file of one frame of a sequence, 'render.png' becomes 'render_0007.png'. Numbers are padded to the
+// widest frame number so the files sort in order.
+static std::string GetSequenceFileLoc(const std::string& outFileLoc, GLuint frame, GLuint lastFrame)
+{
+    const std::filesystem::path path(outFileLoc);
+    const size_t digits = std::max(std::to_string(lastFrame).size(), size_t(4));
+    std::string number = std::to_string(frame);
+    number.insert(0, digits - number.size(), '0');
+    return (path.parent_path() / (path.stem().string() + "_" + number + path.extension().string())).string();
+}
+
+// Renders every frame of an animated scene offscreen to a numbered image sequence. Frames after the first only
+// move the animated transforms and refit the BVH, and each frame's readback and export overlap the rendering of
+// the frames after it.
+static int RunSequence(const RenderOptions& options, OpenGLModel& model)
+{
+    const SceneAnimation& animation = model.animation;
+    const GLuint width = options.width, height = options.height;
+    std::cout << "Rendering frames " << animation.GetFirstFrame() << " to " << animation.GetLastFrame() << ".\n";
+
+    OpenGLView view(model);
+    std::unique_ptr<CPURenderer> cpuRenderer;
+    if (options.useCPU) {
+        cpuRenderer.reset(new CPURenderer(model));
+        cpuRenderer->SetSampleCount(options.samples);
+        cpuRenderer->SetLightSampleCount(options.lightSamples);
+    }
+    else {
+        view.SetShaderCacheDirectory(options.shaderCacheDir);
+        view.SetFloatRenderTarget(ImageExporter::IsHighPrecision(options.outFileLoc, options.pngBitDepth));
+        view.SetSampleCount(options.samples);
+        view.SetLightSampleCount(options.lightSamples);
+        view.SetWavefront(options.wavefront);
+        view.SetProfiling(options.profile);
+        view.SetUpWindow(width, height, true);
+    }
+
+    FrameExportQueue cpuExports;
+    double updateTime = 0, uploadTime = 0;
+
+    auto sequenceStartTime = Clock::now();
+    for (GLuint frame = animation.GetFirstFrame(); frame <= animation.GetLastFrame(); ++frame) {
+        // The scene was loaded at the first frame
+        if (frame != animation.GetFirstFrame()) {
+            auto startTime = Clock::now();
+            model.SetFrame(frame);
+            updateTime += MillisecondsSince(startTime);
+
+            startTime = Clock::now();
+            if (!options.useCPU)
+                view.UploadFrame();
+            uploadTime += MillisecondsSince(startTime);
+        }
+
+        const std::string frameFileLoc = GetSequenceFileLoc(options.outFileLoc, frame, animation.GetLastFrame());
+        if (options.useCPU) {
+            cpuExports.Export(cpuRenderer->Render(width, height), width, height, frameFileLoc, options.pngBitDepth);
+        }
+        else {
+            // Only submitted here, the next frame is updated on the CPU while this one renders
+            while (!view.IsConverged())
+                view.Render();
+            view.ExportFrameAsync(frameFileLoc, options.pngBitDepth);
+        }
+    }
+
+    double exportTime = 0;
+    size_t failedFrames = 0;
+    if (options.useCPU) {
+        exportTime = cpuExports.Finish();
+        failedFrames = cpuExports.GetFailedCount();
+    }
+    else {
+        exportTime = view.FinishExports();
+        failedFrames = view.GetFailedExportCount();
+    }
+    const double sequenceTime = MillisecondsSince(sequenceStartTime);
+
+    const GLuint frameCount = animation.GetFrameCount();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Rendered " << frameCount << (frameCount == 1 ? " frame" : " frames") << " to '" << GetSequenceFileLoc(options.outFileLoc, animation.GetFirstFrame(), animation.GetLastFrame())
+        << "' onwards in " << sequenceTime << "ms, " << frameCount * 1000.0 / std::max(sequenceTime, 0.001) << " frames per second sustained.\n";
+    std::cout << "Per frame: animation " << updateTime / frameCount << "ms, upload " << uploadTime / frameCount << "ms, export "
+        << exportTime / frameCount << "ms\n";
+
+    if (failedFrames > 0)
+        std::cout << failedFrames << " of " << frameCount << " frames could not be written.\n";
+
+    if (!options.useCPU) {
+        view.ReportProfile();
+        view.TearDownWindow();
+    }
+    return failedFrames == 0 ? 0 : 1;
+}
+
+// Renders the frame a band of tiles at a time and streams each band to the exporter,
+// so neither the GPU render target nor host memory has to hold the whole image
+static int RunTiled(const RenderOptions& options, OpenGLModel& model)
+{
+    const GLuint width = options.width, height = options.height, tileSize = options.tileSize;
+
+    auto startTime = Clock::now();
+    try {
+        auto exporter = ImageExporter::ForFile(options.outFileLoc, options.pngBitDepth);
+        exporter->Begin(options.outFileLoc, width, height);
+
+        if (options.useCPU) {
+            CPURenderer renderer(model);
+            renderer.SetSampleCount(options.samples);
+            renderer.SetLightSampleCount(options.lightSamples);
+            // Bands are full-width strips, the exporters need whole rows
+            for (GLuint bandTop = 0; bandTop < height; bandTop += tileSize) {
+                const GLuint bandHeight = std::min(tileSize, height - bandTop);
+                auto band = renderer.RenderRegion(width, height, 0, height - bandTop - bandHeight, width, bandHeight);
+                for (GLuint row = bandHeight; row-- > 0;)
+                    exporter->WriteRows(band.data() + 3 * size_t(width) * row, 1);
+            }
+        }
+        else {
+            OpenGLView view(model);
+            view.SetShaderCacheDirectory(options.shaderCacheDir);
+            view.SetFloatRenderTarget(ImageExporter::IsHighPrecision(options.outFileLoc, options.pngBitDepth));
+            view.SetSampleCount(options.samples);
+            view.SetLightSampleCount(options.lightSamples);
+            view.SetWavefront(options.wavefront);
+            view.SetUpWindow(std::min(tileSize, width), std::min(tileSize, height), true);
+            view.RenderTiled(width, height, tileSize, *exporter);
+            view.TearDownWindow();
+        }
+
+        exporter->End();
+    }
+    catch (const std::exception& err) {
+        std::cerr << "Error writing file: " << options.outFileLoc << "\n\t" << err.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Frame finished in " << MillisecondsSince(startTime) << "ms, " << tileSize << "px tiles.\n";
+    std::cout << "Exported to '" << options.outFileLoc << "'" << std::endl;
+    return 0;
+}
+
+// Generated scenes of the benchmark, each leaning on a different part of the frame
+static const struct {
+    const char* name;
+    GeneratedSceneParams params;
+} BENCHMARK_SCENES[] = {
+    { "spheres-64", { 64, 0, 1, 0.f, 1 } },
+    { "mixed-1k", { 512, 512, 4, 0.f, 2 } },
+    { "mixed-1k-reflective", { 512, 512, 4, 0.5f, 3 } },
+    { "mixed-16k", { 8192, 8192, 2, 0.25f, 4 } },
+    { "lights-256", { 256, 256, 256, 0.25f, 5 } },
+};
+
+// Renders every generated scene offscreen and writes the time spent in each stage as JSON.
+// Like RunBatch, one context or set of worker threads serves the whole run.
+static int RunBenchmark(const RenderOptions& options)
+{
+    const std::filesystem::path outDirectory = std::filesystem::path(options.benchmarkOutFileLoc).parent_path();
+
+    BenchmarkReport report;
+    report.backend = options.useCPU ? "cpu" : options.wavefront ? "opengl-wavefront" : "opengl";
+    report.width = options.width;
+    report.height = options.height;
+    report.samples = options.samples;
+    report.lightSamples = options.lightSamples;
+
+    auto startTime = Clock::now();
+    OpenGLView view;
+    std::unique_ptr<CPURenderer> cpuRenderer;
+    if (!options.useCPU) {
+        // Compile times are only comparable without the on-disk cache
+        view.SetShaderCacheDirectory("");
+        view.SetSampleCount(options.samples);
+        view.SetLightSampleCount(options.lightSamples);
+        view.SetWavefront(options.wavefront);
+        view.SetUpWindow(options.width, options.height, true);
+        report.device = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    }
+    report.setupTime = MillisecondsSince(startTime);
+
+    std::cout << std::fixed << std::setprecision(2);
+
+    for (auto& scene : BENCHMARK_SCENES) {
+        BenchmarkResult result;
+        result.name = scene.name;
+        result.params = scene.params;
+        const std::string sceneFileLoc = (outDirectory / ("benchmark-" + result.name + ".txt")).string();
+        const std::string imageFileLoc = (outDirectory / ("benchmark-" + result.name + ".png")).string();
+        std::cout << result.name << std::endl;
+
+        std::unique_ptr<OpenGLModel> modelPtr;
+        try {
+            GenerateScene(sceneFileLoc, scene.params);
+
+            // Same steps as LoadModel, timed apart
+            std::vector<Material> materials;
+            std::vector<ObjectData> objects;
+            std::vector<Light> lights;
+            MeshLibrary meshes;
+            std::vector<Prototype> prototypes;
+            std::vector<InstanceData> instances;
+            Camera camera;
+            SceneAnimation animation;
+            SceneLoader loader;
+            startTime = Clock::now();
+            loader.Load(sceneFileLoc, materials, objects, lights, meshes, prototypes, instances, camera, animation);
+            result.parseTime = MillisecondsSince(startTime);
+
+            startTime = Clock::now();
+            modelPtr.reset(new OpenGLModel(8, materials, objects, lights, std::move(meshes), prototypes, std::move(instances), camera, std::move(animation)));
+            result.buildTime = MillisecondsSince(startTime);
+            options.OverrideCamera(modelPtr->camera);
+        }
+        catch (const std::exception& err) {
+            std::cout << err.what() << std::endl;
+            return 1;
+        }
+        OpenGLModel& model = *modelPtr;
+        result.objectCount = model.objs.size();
+        result.bvhNodeCount = model.bvh.GetNodes().size();
+
+        startTime = Clock::now();
+        if (!options.useCPU) {
+            view.SetModel(model);
+            // SetModel waits for nothing, finish the uploads before stopping the clock
+            view.WaitForFrame();
+            result.shaderCompileTime = view.GetShaderCompileTime();
+            result.uploadTime = MillisecondsSince(startTime) - result.shaderCompileTime;
+        }
+        else if (!cpuRenderer) {
+            // The worker threads are started once, for the first scene
+            cpuRenderer.reset(new CPURenderer(model));
+            cpuRenderer->SetSampleCount(options.samples);
+            cpuRenderer->SetLightSampleCount(options.lightSamples);
+            report.setupTime += MillisecondsSince(startTime);
+            report.device = std::to_string(cpuRenderer->GetThreadCount()) + " threads";
+        }
+        else {
+            cpuRenderer->SetModel(model);
+            result.uploadTime = MillisecondsSince(startTime);
+        }
+
+        // The first frame warms caches and lets the driver finish any deferred work, it is not timed
+        std::vector<float> pixels;
+        for (GLuint frame = 0; frame <= options.benchmarkFrames; ++frame) {
+            startTime = Clock::now();
+            if (options.useCPU) {
+                pixels = cpuRenderer->Render(options.width, options.height);
+            }
+            else {
+                view.ResetAccumulation();
+                while (!view.IsConverged())
+                    view.Render();
+                view.WaitForFrame();
+            }
+            if (frame > 0)
+                result.frameTimes.push_back(MillisecondsSince(startTime));
+        }
+
+        startTime = Clock::now();
+        GLuint width = options.width, height = options.height;
+        if (!options.useCPU)
+            pixels = view.GetFrameAsPixels(width, height);
+        ImageExporter::Export(imageFileLoc, width, height, pixels.data(), options.pngBitDepth);
+        result.exportTime = MillisecondsSince(startTime);
+
+        double frameTotal = 0;
+        for (double frameTime : result.frameTimes)
+            frameTotal += frameTime;
+        std::cout << "    " << result.objectCount << " objects, parse " << result.parseTime << "ms, build " << result.buildTime
+            << "ms, upload " << result.uploadTime << "ms, frame " << frameTotal / result.frameTimes.size() << "ms, export " << result.exportTime << "ms\n";
+
+        report.results.push_back(std::move(result));
+    }
+
+    if (!options.useCPU)
+        view.TearDownWindow();
+
+    try {
+        report.Write(options.benchmarkOutFileLoc);
+    }
+    catch (const std::exception& err) {
+        std::cout << err.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Benchmark results written to '" << options.benchmarkOutFileLoc << "'" << std::endl;
+    return 0;
+}
+
+// Renders until the window closes, reloading the scene whenever the watcher sees its file change. A scene that
+// fails to load leaves the last one on screen. Each reload prints its own time and, once drawn, the time from the
+// save to the edit being on screen.
+static void RunWatched(OpenGLView& view, FileWatcher& watcher, const RenderOptions& options, const std::string& sceneFileLoc,
+    std::unique_ptr<OpenGLModel>& modelPtr)
+{
+    std::cout << "Watching '" << sceneFileLoc << "' for changes.\n";
+    std::chrono::steady_clock::time_point changeTime;
+    bool reloadPending = false;
+    while (!view.ShouldWindowClose()) {
+        if (watcher.TakeChange(changeTime)) {
+            try {
+                auto startTime = Clock::now();
+                auto reloaded = LoadModel(sceneFileLoc, modelPtr.get());
+                options.OverrideCamera(reloaded->camera);
+                const double loadTime = MillisecondsSince(startTime);
+
+                // The previous model is compared against while uploading, so it is only released afterwards
+                startTime = Clock::now();
+                view.UpdateModel(*reloaded);
+                const double uploadTime = MillisecondsSince(startTime);
+                modelPtr = std::move(reloaded);
+
+                auto& bvh = modelPtr->bvh;
+                auto& stats = view.GetSceneUploadStats();
+                std::cout << std::fixed << std::setprecision(2) << "Reloaded '" << sceneFileLoc << "' in " << loadTime << "ms, rebuilding "
+                    << bvh.GetRebuiltBottomLevelCount() << " of " << bvh.GetBottomLevelCount() << " bottom level BVHs. Uploaded "
+                    << stats.uploadedBytes << " of " << stats.totalBytes << " bytes in " << stats.uploadedRanges << " ranges in " << uploadTime << "ms.\n";
+                reloadPending = true;
+            }
+            catch (const std::exception& err) {
+                std::cout << err.what() << "\nKeeping the previous scene." << std::endl;
+            }
+        }
+
+        view.Render();
+
+        if (reloadPending && view.GetLastPresentTime() > changeTime) {
+            const double latency = std::chrono::duration<double, std::milli>(view.GetLastPresentTime() - changeTime).count();
+            std::cout << std::fixed << std::setprecision(2) << "Edit on screen " << latency << "ms after the file changed.\n";
+            reloadPending = false;
+        }
+    }
+}
+
 int main(int argc, char** argv) {
-    // TODO: add flags for setting these vars
-    GLuint width = 1920, height = 1080;
-    float fov = glm::radians(60.f);
-    fov *= 0.5f;
-    // TODO: add flag for output file
-    std::string outFileLoc = "render.png";
-
-    if (argc > 2) {
+    RenderOptions options;
+    try {
+        options = RenderOptions::Parse(argc, argv);
+        // Fail on unsupported output formats before spending time on rendering
+        ImageExporter::ForFile(options.outFileLoc, options.pngBitDepth);
+    }
+    catch (const std::exception& err) {
+        std::cout << err.what() << "\n" << RenderOptions::Usage(argv[0]);
         return 1;
     }
 
-    std::string sceneFileLoc;
-    if (argc < 2) {
+    if (!options.batchManifestLoc.empty())
+        return RunBatch(options);
+    if (!options.benchmarkOutFileLoc.empty())
+        return RunBenchmark(options);
+
+    GLuint width = options.width, height = options.height;
+    const std::string& outFileLoc = options.outFileLoc;
+    std::string sceneFileLoc = options.sceneFileLoc;
+
+    if (sceneFileLoc.empty()) {
         std::cout << "Enter the scene file to render:\n";
         std::cin >> sceneFileLoc;
     }
-    else {
-        sceneFileLoc = argv[1];
-    }
 
-    std::vector<ObjectData> objects;
-    std::vector<Light> lights;
+    if (!options.compileOutFileLoc.empty())
+        return CompileScene(sceneFileLoc, options.compileOutFileLoc);
 
+    std::unique_ptr<OpenGLModel> modelPtr;
     try {
-        SceneLoader loader;
-        loader.Load(sceneFileLoc, objects, lights);
+        modelPtr = LoadModel(sceneFileLoc);
     }
-    catch (std::exception err) {
+    catch (const std::exception& err) {
         std::cout << err.what() << std::endl;
         return 1;
     }
 
     std::cout << "Scene file loaded without any errors.\n";
 
-    OpenGLModel model(8, objects, lights);
-    OpenGLView view(model);
+    OpenGLModel& model = *modelPtr;
+    options.OverrideCamera(model.camera);
 
-    view.SetUpWindow(width, height);
+    if (options.tileSize > 0)
+        return RunTiled(options, model);
+    // Windows and heatmaps show the first frame
+    if (model.animation.HasFrameRange() && (options.useCPU || options.headless) && options.heatmap == CostMetric::none)
+        return RunSequence(options, model);
 
-    while (!view.ShouldWindowClose()) {
-#if _DEBUG
-        auto startTime = std::chrono::high_resolution_clock::now();
-#endif
-        view.Render();
+    if (options.useCPU) {
+        CPURenderer renderer(model);
+        renderer.SetSampleCount(options.samples);
+        renderer.SetLightSampleCount(options.lightSamples);
+        renderer.SetCostOutput(options.heatmap != CostMetric::none);
 
-#if _DEBUG
+        auto startTime = std::chrono::high_resolution_clock::now();
+        auto pixels = renderer.Render(width, height);
         auto endTime = std::chrono::high_resolution_clock::now();
 
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-
         std::cout << "Frame finished in " << duration.count() << "ms.\n";
-#endif
+
+        if (options.heatmap != CostMetric::none) {
+            PrintCostSummary(std::cout, pixels, width, height, options.heatmap);
+            pixels = MakeCostHeatmap(pixels, options.heatmap);
+        }
+        return ImageExporter::Export(outFileLoc, width, height, pixels.data(), options.pngBitDepth) ? 0 : 1;
+    }
+
+    OpenGLView view(model);
+    view.SetShaderCacheDirectory(options.shaderCacheDir);
+    view.SetFloatRenderTarget(ImageExporter::IsHighPrecision(outFileLoc, options.pngBitDepth));
+    view.SetSampleCount(options.samples);
+    view.SetLightSampleCount(options.lightSamples);
+    view.SetWavefront(options.wavefront);
+    view.SetProfiling(options.profile);
+    view.SetInteractive(options.interactive, options.frameBudgetMs);
+    view.SetCostOutput(options.heatmap != CostMetric::none);
+
+    // Watching starts before the window opens so saves made while it does are not missed
+    std::unique_ptr<FileWatcher> watcher;
+    if (options.watch) {
+        try {
+            watcher.reset(new FileWatcher(sceneFileLoc, [] { glfwPostEmptyEvent(); }));
+        }
+        catch (const std::exception& err) {
+            std::cout << err.what() << std::endl;
+            return 1;
+        }
+    }
+
+    view.SetUpWindow(width, height, options.headless);
+
+    if (options.headless) {
+        // One frame, no redraw loop
+        auto startTime = std::chrono::high_resolution_clock::now();
+        while (!view.IsConverged())
+            view.Render();
+        view.WaitForFrame();
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+        std::cout << "Frame finished in " << duration.count() << "ms, " << options.samples << (options.samples == 1 ? " sample.\n" : " samples.\n");
+        view.ReportProfile();
+    }
+    else if (watcher) {
+        RunWatched(view, *watcher, options, sceneFileLoc, modelPtr);
+    }
+    else {
+        // Samples accumulate until the target count, after which Render() only waits for window events.
+        // Interactive views preview changes first. Frame times are reported by the view while profiling.
+        while (!view.ShouldWindowClose())
+            view.Render();
     }
 
     auto pixels = view.GetFrameAsPixels(width, height);
-    PNGExporter::Export(outFileLoc, width, height, pixels);
+    if (options.heatmap != CostMetric::none) {
+        PrintCostSummary(std::cout, pixels, width, height, options.heatmap);
+        pixels = MakeCostHeatmap(pixels, options.heatmap);
+    }
+    const bool exported = ImageExporter::Export(outFileLoc, width, height, pixels.data(), options.pngBitDepth);
 
     view.TearDownWindow();
 
-    return 0;
+    return exported ? 0 : 1;
 }
\ No newline at end of file
@@ -1,31 +1,411 @@
 #include "OpenGLView.hpp"
+#include "PackedSceneData.hpp"
+#include "SampleJitter.hpp"
+#include "ShaderCache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
 #include <fstream>
 
-OpenGLView::OpenGLView(OpenGLModel& model) : model(model)
+// Shader storage bindings, must match the layout qualifiers in shade_and_reflect.glsl
+static const GLuint BVH_NODE_BINDING = 0;
+static const GLuint BVH_PRIMITIVE_BINDING = 1;
+static const GLuint OBJECT_BINDING = 2;
+static const GLuint LIGHT_BINDING = 3;
+static const GLuint MATERIAL_BINDING = 4;
+static const GLuint INSTANCE_BINDING = 5;
+static const GLuint MESH_NODE_BINDING = 6;
+static const GLuint MESH_VERTEX_BINDING = 7;
+static const GLuint MESH_INDEX_BINDING = 8;
+static const GLuint LIGHT_TREE_NODE_BINDING = 9;
+static const GLuint RAY_COUNTER_BINDING = 11;
+// Seconds without a change after which an interactive view stops previewing and refines at full resolution
+static const double INTERACTION_SETTLE_TIME = 0.25;
+// Previews never drop below this fraction of the window's width and height
+static const float MIN_PREVIEW_SCALE = 0.125f;
+
+OpenGLView::OpenGLView(OpenGLModel& model) : model(&model)
 {
 }
 
+void OpenGLView::SetModel(OpenGLModel& model)
+{
+    this->model = &model;
+
+    // Keep the context and program, only the scene buffers change
+    if (window)
+        LoadScene();
+}
+
+void OpenGLView::UpdateModel(OpenGLModel& model)
+{
+    const OpenGLModel* previous = this->model;
+    this->model = &model;
+
+    if (window)
+        LoadScene(previous);
+}
+
+void OpenGLView::SetCamera(const Camera& camera)
+{
+    model->camera = camera;
+    if (!window)
+        return;
+
+    SetCameraUniforms();
+    MarkDirty();
+}
+
 void OpenGLView::Render()
 {
-    glfwPollEvents();
+    if (interactive && !headless)
+    {
+        // One preview per batch of events, then wait for more until the changes have settled
+        if (previewPending)
+            RenderPreview();
+        const double idle = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastChange).count();
+        if (idle < INTERACTION_SETTLE_TIME)
+        {
+            glfwWaitEventsTimeout(INTERACTION_SETTLE_TIME - idle);
+            return;
+        }
+    }
+
+    if (IsConverged())
+    {
+        // The image is final, drawing it again would only waste GPU time unless it is being measured
+        if (headless)
+            return;
+        if (!profiler)
+        {
+            glfwWaitEvents();
+            return;
+        }
+        ResetAccumulation();
+    }
+
+    if (!headless)
+        glfwPollEvents();
+
+    if (profiler)
+    {
+        profiler->BeginFrame();
+        profiler->BeginPhase(GpuProfiler::trace);
+    }
+
+    RenderSample();
+
+    if (profiler)
+        profiler->EndPhase(GpuProfiler::trace);
+
+    // Nothing is presented offscreen, callers wait with WaitForFrame or read back asynchronously
+    if (headless)
+    {
+        if (profiler)
+            profiler->EndFrame();
+        glFlush();
+        return;
+    }
 
+    if (profiler)
+        profiler->BeginPhase(GpuProfiler::present);
+    Present();
+    if (profiler)
+    {
+        profiler->EndPhase(GpuProfiler::present);
+        profiler->EndFrame();
+        if (profiler->ShouldReport())
+            profiler->Report(std::cout);
+    }
+}
+
+void OpenGLView::RenderSample()
+{
+    GLuint target = renderTargetFBO;
+    if (accumulationFBO[0])
+    {
+        const GLuint current = accumulatedSamples % 2;
+        target = accumulationFBO[current];
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumulationColor[1 - current]);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    glUseProgram(shaderProgram);
-    glBindVertexArray(quadVAO);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    const glm::vec2 jitter = GetSampleJitter(accumulatedSamples);
+    SetUniform("camera.jitter", jitter.x, jitter.y);
+    SetUniform("accumulatedSamples", accumulatedSamples);
+    if (UsesWavefront())
+    {
+        wavefrontPipeline->Render(width, height);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, wavefrontPipeline->GetOutputFramebuffer());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    else
+    {
+        glUseProgram(shaderProgram);
+        glBindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    }
+    ++accumulatedSamples;
+}
 
+void OpenGLView::Present()
+{
+    if (accumulationFBO[0])
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, GetResultFramebuffer());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
     glfwSwapBuffers(window);
+    lastPresentTime = std::chrono::steady_clock::now();
 }
 
-void OpenGLView::SetUpWindow(GLuint width, GLuint height)
+bool OpenGLView::IsInteracting() const
 {
+    return interactive && std::chrono::steady_clock::now() - lastChange < std::chrono::duration<double>(INTERACTION_SETTLE_TIME);
+}
+
+void OpenGLView::RenderPreview()
+{
+    previewPending = false;
+    // Minimized windows have no pixels to draw
+    if (width == 0 || height == 0)
+        return;
+
+    const GLuint previewWidth = std::max(GLuint(width * previewScale), 1u);
+    const GLuint previewHeight = std::max(GLuint(height * previewScale), 1u);
+    auto startTime = std::chrono::steady_clock::now();
+    if (profiler)
+    {
+        profiler->BeginFrame();
+        profiler->BeginPhase(GpuProfiler::trace);
+    }
+
+    // A single centered sample, rays spread over the smaller frame cover the same view
+    SetUniform("camera.frameSize", float(previewWidth), float(previewHeight));
+    SetUniform("camera.jitter", 0.f, 0.f);
+    SetUniform("accumulatedSamples", 0u);
+    GLuint source = previewFBO;
+    if (UsesWavefront())
+    {
+        wavefrontPipeline->Render(previewWidth, previewHeight);
+        source = wavefrontPipeline->GetOutputFramebuffer();
+    }
+    else
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, previewFBO);
+        glViewport(0, 0, previewWidth, previewHeight);
+        glUseProgram(shaderProgram);
+        glBindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        glViewport(0, 0, width, height);
+    }
+    SetUniform("camera.frameSize", float(width), float(height));
+
+    if (profiler)
+    {
+        profiler->EndPhase(GpuProfiler::trace);
+        profiler->BeginPhase(GpuProfiler::present);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, previewWidth, previewHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    if (profiler)
+    {
+        profiler->EndPhase(GpuProfiler::present);
+        profiler->EndFrame();
+    }
+
+    // Waiting here keeps vsync out of the measurement, previews are shown as soon as they finish anyway
+    glFinish();
+    const double frameTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    glfwSwapBuffers(window);
+    lastPresentTime = std::chrono::steady_clock::now();
+    if (profiler && profiler->ShouldReport())
+        profiler->Report(std::cout);
+
+    // Tracing time grows with the pixel count, so each side scales by the square root of the budget's ratio.
+    // Steps are bounded to ride out a single slow or fast frame.
+    const double step = std::clamp(std::sqrt(frameBudget / std::max(frameTime, 0.01)), 0.5, 1.5);
+    previewScale = std::clamp(float(previewScale * step), MIN_PREVIEW_SCALE, 1.f);
+}
+
+void OpenGLView::WaitForFrame()
+{
+    glFinish();
+}
+
+void OpenGLView::RenderTiled(GLuint imageWidth, GLuint imageHeight, GLuint tileSize, ImageExporter& exporter)
+{
+    if (!headless)
+        throw std::runtime_error("Tiled rendering needs a headless view.");
+
+    const GLuint bandSize = std::min(tileSize, imageHeight);
+    SetWindowSize(std::min(tileSize, imageWidth), bandSize);
+    // Rays are generated for the whole frame, each tile only offsets its fragment coordinates
+    SetUniform("camera.frameSize", float(imageWidth), float(imageHeight));
+
+    std::vector<float> band(3 * size_t(imageWidth) * bandSize);
+    // Tiles are read back side by side into the band
+    glPixelStorei(GL_PACK_ROW_LENGTH, imageWidth);
+
+    // Bands go top-down, the order the exporters expect their rows in
+    for (GLuint bandTop = 0; bandTop < imageHeight; bandTop += bandSize)
+    {
+        const GLuint bandHeight = std::min(bandSize, imageHeight - bandTop);
+        const GLuint bandY = imageHeight - bandTop - bandHeight;
+
+        for (GLuint tileX = 0; tileX < imageWidth; tileX += tileSize)
+        {
+            const GLuint tileWidth = std::min(tileSize, imageWidth - tileX);
+            SetUniform("camera.tileOffset", float(tileX), float(bandY));
+            glViewport(0, 0, tileWidth, bandHeight);
+
+            // Every tile accumulates all of its samples before it is read back
+            ResetAccumulation();
+            while (!IsConverged())
+                Render();
+
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, GetResultFramebuffer());
+            glReadPixels(0, 0, tileWidth, bandHeight, GL_RGB, GL_FLOAT, band.data() + 3 * size_t(tileX));
+        }
+
+        // The band was read back bottom-up
+        for (GLuint row = bandHeight; row-- > 0;)
+            exporter.WriteRows(band.data() + 3 * size_t(imageWidth) * row, 1);
+    }
+
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    SetUniform("camera.tileOffset", 0.f, 0.f);
+    SetUniform("camera.frameSize", float(width), float(height));
+    glViewport(0, 0, width, height);
+}
+
+void OpenGLView::ExportFrameAsync(const std::string& outFileLoc, unsigned int pngBitDepth)
+{
+    if (!readback)
+        readback.reset(new AsyncReadback());
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, GetResultFramebuffer());
+    readback->ReadFrame(width, height, outFileLoc, pngBitDepth);
+    readback->Poll();
+}
+
+void OpenGLView::SetInteractive(bool interactive, double frameBudget)
+{
+    this->interactive = interactive;
+    this->frameBudget = frameBudget;
+}
+
+void OpenGLView::MarkDirty()
+{
+    ResetAccumulation();
+    previewPending = interactive;
+    lastChange = std::chrono::steady_clock::now();
+}
+
+void OpenGLView::SetProfiling(bool profiling)
+{
+    if (this->profiling == profiling)
+        return;
+    this->profiling = profiling;
+
+    if (!window)
+        return;
+
+    if (profiling)
+    {
+        profiler.reset(new GpuProfiler(RAY_COUNTER_BINDING));
+    }
+    else
+    {
+        profiler->Report(std::cout);
+        profiler.reset();
+    }
+
+    // Only the variant changes, the scene buffers stay as they are
+    if (model)
+        UseSceneVariant();
+}
+
+void OpenGLView::ReportProfile()
+{
+    if (!profiler)
+        return;
+
+    profiler->Poll(true);
+    profiler->Report(std::cout);
+}
+
+double OpenGLView::FinishExports()
+{
+    if (!readback)
+        return 0;
+
+    readback->Finish();
+    return readback->GetTotalWriteTime();
+}
+
+size_t OpenGLView::GetFailedExportCount() const
+{
+    return readback ? readback->GetFailedWriteCount() : 0;
+}
+
+// Creates a context without a visible window. GLFW 3.4's null platform needs no display server,
+// so try it with a surfaceless EGL context and then OSMesa before falling back to a hidden window.
+static GLFWwindow* CreateHeadlessContext(GLuint width, GLuint height)
+{
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4)
+    if (glfwPlatformSupported(GLFW_PLATFORM_NULL))
+    {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+        if (glfwInit())
+        {
+            const int contextApis[] = { GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API };
+            for (int contextApi : contextApis)
+            {
+                glfwDefaultWindowHints();
+                glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApi);
+                GLFWwindow* window = glfwCreateWindow(width, height, "OpenGL Raytracer", NULL, NULL);
+                if (window)
+                    return window;
+            }
+            glfwTerminate();
+        }
+        glfwInitHint(GLFW_PLATFORM, GLFW_ANY_PLATFORM);
+    }
+#endif
+
     if (!glfwInit())
         throw std::runtime_error("GLFW could not be initialized.");
 
-    window = glfwCreateWindow(width, height, "OpenGL Raytracer", NULL, NULL);
+    glfwDefaultWindowHints();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    return glfwCreateWindow(width, height, "OpenGL Raytracer", NULL, NULL);
+}
+
+void OpenGLView::SetUpWindow(GLuint width, GLuint height, bool headless)
+{
+    this->headless = headless;
+
+    if (headless)
+    {
+        window = CreateHeadlessContext(width, height);
+    }
+    else
+    {
+        if (!glfwInit())
+            throw std::runtime_error("GLFW could not be initialized.");
+
+        window = glfwCreateWindow(width, height, "OpenGL Raytracer", NULL, NULL);
+    }
 
     if (!window)
     {
@@ -43,6 +423,33 @@ void OpenGLView::SetUpWindow(GLuint width, GLuint height)
 
             view->SetWindowSize(width, height);
         });
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow* window)
+        {
+            auto view = reinterpret_cast<OpenGLView*>(glfwGetWindowUserPointer(window));
+            if (!view)
+                return;
+
+            // Some platforms only call this during a live resize, the event loop is blocked until it ends
+            if (view->IsInteracting())
+            {
+                view->RenderPreview();
+                return;
+            }
+            if (!view->IsConverged())
+                return;
+
+            // Render() no longer draws a converged frame, show the accumulated image again or redraw a single sample
+            if (view->accumulationFBO[0])
+                view->Present();
+            else
+                view->ResetAccumulation();
+        });
+    glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods)
+        {
+            auto view = reinterpret_cast<OpenGLView*>(glfwGetWindowUserPointer(window));
+            if (view && key == GLFW_KEY_P && action == GLFW_PRESS)
+                view->SetProfiling(!view->IsProfiling());
+        });
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
@@ -50,27 +457,9 @@ void OpenGLView::SetUpWindow(GLuint width, GLuint height)
         return;
     }
 
-    shaderProgram = glCreateProgram();
-    GLuint vertShader = LoadShader(GL_VERTEX_SHADER, "vert_shader.glsl");
-    GLuint fragShader = LoadShader(GL_FRAGMENT_SHADER, "shade_and_reflect.glsl");
-    glAttachShader(shaderProgram, vertShader);
-    glAttachShader(shaderProgram, fragShader);
-    glLinkProgram(shaderProgram);
-
-    GLint result;
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &result);
-    if (result == GL_FALSE) {
-        GLint length;
-        glGetProgramiv(shaderProgram, GL_INFO_LOG_LENGTH, &length);
-
-        GLchar* infoLog = new GLchar[length + 1];
-        glGetProgramInfoLog(shaderProgram, length, &length, infoLog);
-
-        fprintf(stderr, "Unable to link shader program:\n\t%s\n", infoLog);
-        delete[] infoLog;
-    }
-    glDeleteShader(vertShader);
-    glDeleteShader(fragShader);
+    // Samples accumulate unclamped in float targets so light sampling stays unbiased, the image is clamped
+    // as it is read back. Cost output keeps its raw counts.
+    glClampColor(GL_CLAMP_READ_COLOR, costOutput ? GL_FALSE : GL_TRUE);
 
     // Setup quad
     float vertices[] = {
@@ -90,15 +479,112 @@ void OpenGLView::SetUpWindow(GLuint width, GLuint height)
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
     glEnableVertexAttribArray(0);
 
-    LoadScene();
+    if (sampleCount > 1)
+        CreateAccumulationTargets();
+    else if (headless)
+        CreateRenderTarget();
+    if (interactive && !headless)
+        CreatePreviewTarget();
+
+    if (profiling)
+        profiler.reset(new GpuProfiler(RAY_COUNTER_BINDING));
+
+    if (model)
+        LoadScene();
     SetWindowSize(width, height);
 }
 
+void OpenGLView::CreateRenderTarget()
+{
+    // 8 bit color like a default framebuffer keeps 8 bit output identical to the windowed path,
+    // float output formats get a float target instead
+    glGenFramebuffers(1, &renderTargetFBO);
+    glGenRenderbuffers(1, &renderTargetColor);
+    glBindFramebuffer(GL_FRAMEBUFFER, renderTargetFBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderTargetColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GetRenderTargetFormat(), 1, 1);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderTargetColor);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("Offscreen framebuffer could not be created.");
+}
+
+void OpenGLView::CreatePreviewTarget()
+{
+    // Previews are shown once and never accumulated, 8 bits like the window are enough
+    glGenFramebuffers(1, &previewFBO);
+    glGenRenderbuffers(1, &previewColor);
+    glBindFramebuffer(GL_FRAMEBUFFER, previewFBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, previewColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, previewColor);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("Preview framebuffer could not be created.");
+}
+
+void OpenGLView::CreateAccumulationTargets()
+{
+    // Always float, the running mean would lose precision in 8 bits
+    glGenFramebuffers(2, accumulationFBO);
+    glGenTextures(2, accumulationColor);
+    for (int ii = 0; ii < 2; ++ii)
+    {
+        glBindTexture(GL_TEXTURE_2D, accumulationColor[ii]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 1, 1, 0, GL_RGBA, GL_FLOAT, NULL);
+        // Only read with texelFetch, but a texture without mipmaps is incomplete under the default filter
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, accumulationFBO[ii]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulationColor[ii], 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("Accumulation framebuffer could not be created.");
+    }
+}
+
+GLuint OpenGLView::GetResultFramebuffer()
+{
+    // Right after a reset the targets still hold the previous frame
+    if (accumulatedSamples == 0)
+        RenderSample();
+
+    if (!accumulationFBO[0])
+        return renderTargetFBO;
+
+    // The target the last sample was written to
+    return accumulationFBO[(accumulatedSamples + 1) % 2];
+}
+
 void OpenGLView::TearDownWindow()
 {
+    // Flushes pending exports and releases the pixel buffers while the context is still current
+    readback.reset();
+    profiler.reset();
+    wavefrontPipeline.reset();
     glDeleteVertexArrays(1, &quadVAO);
     glDeleteBuffers(1, &quadVBO);
-    glDeleteProgram(shaderProgram);
+    glDeleteBuffers(1, &bvhNodeBuffer);
+    glDeleteBuffers(1, &bvhPrimitiveBuffer);
+    glDeleteBuffers(1, &objectBuffer);
+    glDeleteBuffers(1, &lightBuffer);
+    glDeleteBuffers(1, &materialBuffer);
+    glDeleteBuffers(1, &instanceBuffer);
+    glDeleteBuffers(1, &meshNodeBuffer);
+    glDeleteBuffers(1, &meshVertexBuffer);
+    glDeleteBuffers(1, &meshIndexBuffer);
+    glDeleteBuffers(1, &lightTreeNodeBuffer);
+    glDeleteFramebuffers(1, &renderTargetFBO);
+    glDeleteRenderbuffers(1, &renderTargetColor);
+    glDeleteFramebuffers(1, &previewFBO);
+    glDeleteRenderbuffers(1, &previewColor);
+    glDeleteFramebuffers(2, accumulationFBO);
+    glDeleteTextures(2, accumulationColor);
+    for (auto& variant : shaderVariants)
+        glDeleteProgram(variant.second);
+    shaderVariants.clear();
+    wavefrontPrograms = {};
     glfwTerminate();
 }
 
@@ -111,6 +597,7 @@ std::vector<float> OpenGLView::GetFrameAsPixels(GLuint& outWidth, GLuint& outHei
 {
     std::vector<float> pixels(3 * size_t(width) * height);
 
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, GetResultFramebuffer());
     glReadPixels(0, 0, width, height, GL_RGB, GL_FLOAT, pixels.data());
 
     outWidth = width;
@@ -122,8 +609,40 @@ void OpenGLView::SetWindowSize(GLuint width, GLuint height)
 {
     this->width = width;
     this->height = height;
+
+    if (renderTargetColor || accumulationColor[0])
+    {
+        GLint maxSize = 0;
+        glGetIntegerv(renderTargetColor ? GL_MAX_RENDERBUFFER_SIZE : GL_MAX_TEXTURE_SIZE, &maxSize);
+        if (GLint(width) > maxSize || GLint(height) > maxSize)
+            std::cerr << "Render target of " << width << "x" << height << " exceeds the driver limit of " << maxSize << " pixels, render in tiles instead." << std::endl;
+    }
+
+    if (renderTargetColor)
+    {
+        glBindRenderbuffer(GL_RENDERBUFFER, renderTargetColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GetRenderTargetFormat(), width, height);
+    }
+
+    if (previewColor)
+    {
+        glBindRenderbuffer(GL_RENDERBUFFER, previewColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    }
+
+    for (GLuint texture : accumulationColor)
+    {
+        if (!texture)
+            continue;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    }
+    // Earlier samples were taken at the old size
+    MarkDirty();
+
     glViewport(0, 0, width, height);
-    glUniform2f(glGetUniformLocation(shaderProgram, "camera.frameSize"), float(width), float(height));
+    SetUniform("camera.frameSize", float(width), float(height));
+    SetUniform("camera.tileOffset", 0.f, 0.f);
 }
 
 static std::string LoadShaderSourceFromFile(const std::string& sourceFile)
@@ -145,11 +664,10 @@ static std::string LoadShaderSourceFromFile(const std::string& sourceFile)
     return str;
 }
 
-GLuint OpenGLView::LoadShader(GLenum type, const std::string& sourceFile)
+GLuint OpenGLView::LoadShader(GLenum type, const std::string& sourceFile, const std::string& source)
 {
     GLuint shader = glCreateShader(type);
 
-    const std::string source = LoadShaderSourceFromFile(sourceFile);
     const GLchar* sourceStr = source.c_str();
     glShaderSource(shader, 1, &sourceStr, NULL);
     glCompileShader(shader);
@@ -171,52 +689,326 @@ GLuint OpenGLView::LoadShader(GLenum type, const std::string& sourceFile)
     return shader;
 }
 
-void OpenGLView::LoadScene()
+// Inserts the variant's defines after the '#version' directive, which must stay first
+static std::string InjectDefines(const std::string& source, const std::string& defines)
+{
+    size_t versionEnd = source.find('\n', source.find("#version"));
+    if (versionEnd == std::string::npos)
+        return defines + source;
+
+    return source.substr(0, versionEnd + 1) + defines + source.substr(versionEnd + 1);
+}
+
+GLuint OpenGLView::CreateShaderProgram(const ShaderVariant& variant)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // Wavefront stages are compute shaders made of the fragment shader's functions followed by wavefront.glsl
+    const bool compute = variant.wavefrontStage != 0;
+    const std::string vertSource = compute ? "" : LoadShaderSourceFromFile("vert_shader.glsl");
+    const std::string fragSource = LoadShaderSourceFromFile("shade_and_reflect.glsl");
+    const std::string wavefrontSource = compute ? LoadShaderSourceFromFile("wavefront.glsl") : "";
+    const std::string defines = variant.GetDefines();
+
+    ShaderCache shaderCache(shaderCacheDir);
+    const std::string cacheKey = shaderCache.GetKey({ vertSource, fragSource, wavefrontSource }, defines);
+
+    GLuint program = glCreateProgram();
+    const bool cacheHit = shaderCache.Load(cacheKey, program);
+    if (!cacheHit)
+    {
+        // A rejected binary can leave the program in an unknown state, start from a fresh one
+        glDeleteProgram(program);
+        program = glCreateProgram();
+
+        std::vector<GLuint> shaders;
+        if (compute)
+        {
+            shaders.push_back(LoadShader(GL_COMPUTE_SHADER, "wavefront.glsl", InjectDefines(fragSource, defines) + wavefrontSource));
+        }
+        else
+        {
+            shaders.push_back(LoadShader(GL_VERTEX_SHADER, "vert_shader.glsl", vertSource));
+            shaders.push_back(LoadShader(GL_FRAGMENT_SHADER, "shade_and_reflect.glsl", InjectDefines(fragSource, defines)));
+        }
+        for (GLuint shader : shaders)
+            glAttachShader(program, shader);
+        if (shaderCache.IsEnabled())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+
+        GLint result;
+        glGetProgramiv(program, GL_LINK_STATUS, &result);
+        if (result == GL_FALSE) {
+            GLint length;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+
+            GLchar* infoLog = new GLchar[length + 1];
+            glGetProgramInfoLog(program, length, &length, infoLog);
+
+            fprintf(stderr, "Unable to link shader program:\n\t%s\n", infoLog);
+            delete[] infoLog;
+        }
+        else {
+            shaderCache.Store(cacheKey, program);
+        }
+        for (GLuint shader : shaders)
+            glDeleteShader(shader);
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if (!shaderCache.IsEnabled())
+        std::cout << "Shader variant (" << variant.GetDescription() << ") compiled in " << duration.count() << "ms.\n";
+    else if (cacheHit)
+        std::cout << "Shader cache hit, variant (" << variant.GetDescription() << ") loaded in " << duration.count() << "ms.\n";
+    else
+        std::cout << "Shader cache miss, variant (" << variant.GetDescription() << ") compiled in " << duration.count() << "ms.\n";
+
+    return program;
+}
+
+GLuint OpenGLView::GetShaderProgram(const ShaderVariant& variant)
+{
+    // Variants stay linked for the lifetime of the context, batches often revisit the same features
+    const std::string key = variant.GetDefines();
+    auto found = shaderVariants.find(key);
+    if (found == shaderVariants.end())
+    {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        found = shaderVariants.emplace(key, CreateShaderProgram(variant)).first;
+        shaderCompileTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    }
+    return found->second;
+}
+
+std::array<GLuint, WAVEFRONT_STAGE_COUNT + 1> OpenGLView::GetPrograms() const
+{
+    std::array<GLuint, WAVEFRONT_STAGE_COUNT + 1> programs;
+    programs[0] = shaderProgram;
+    std::copy(wavefrontPrograms.begin(), wavefrontPrograms.end(), programs.begin() + 1);
+    return programs;
+}
+
+void OpenGLView::SetUniform(const char* name, GLint value)
+{
+    for (GLuint program : GetPrograms())
+        if (program)
+            glProgramUniform1i(program, glGetUniformLocation(program, name), value);
+}
+
+void OpenGLView::SetUniform(const char* name, GLuint value)
+{
+    for (GLuint program : GetPrograms())
+        if (program)
+            glProgramUniform1ui(program, glGetUniformLocation(program, name), value);
+}
+
+void OpenGLView::SetUniform(const char* name, float value)
+{
+    for (GLuint program : GetPrograms())
+        if (program)
+            glProgramUniform1f(program, glGetUniformLocation(program, name), value);
+}
+
+void OpenGLView::SetUniform(const char* name, float x, float y)
+{
+    for (GLuint program : GetPrograms())
+        if (program)
+            glProgramUniform2f(program, glGetUniformLocation(program, name), x, y);
+}
+
+void OpenGLView::SetUniform(const char* name, const glm::vec3& value)
 {
-    glUseProgram(shaderProgram);
-    glUniform2f(glGetUniformLocation(shaderProgram, "camera.frameSize"), float(width), float(height));
-    glUniform1f(glGetUniformLocation(shaderProgram, "camera.fov"), glm::radians(60.f) / 2.f);
+    for (GLuint program : GetPrograms())
+        if (program)
+            glProgramUniform3f(program, glGetUniformLocation(program, name), value.x, value.y, value.z);
+}
+
+void OpenGLView::SetUniform(const char* name, const glm::mat4& value)
+{
+    for (GLuint program : GetPrograms())
+        if (program)
+            glProgramUniformMatrix4fv(program, glGetUniformLocation(program, name), 1, GL_FALSE, &value[0][0]);
+}
 
-    glUniform1ui(glGetUniformLocation(shaderProgram, "MAX_BOUNCES"), model.MAX_BOUNCES);
+// Uploads the whole array in one call and binds it to a shader storage binding point
+static void UploadStorageBuffer(GLuint& buffer, GLuint binding, const void* data, size_t size)
+{
+    if (!buffer)
+        glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+
+    GLint64 maxBlockSize = 0;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+    if (GLint64(size) > maxBlockSize)
+        std::cerr << "Shader storage buffer of " << size << " bytes exceeds the driver limit of " << maxBlockSize << " bytes." << std::endl;
+
+    // Empty arrays still need a backing store to bind, the shader sees a length() of 0
+    const GLuint emptyData = 0;
+    if (size == 0)
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(emptyData), &emptyData, GL_STATIC_DRAW);
+    else
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_STATIC_DRAW);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
 
-    const GLuint MAX_OBJECTS = 16;
-    const GLuint MAX_LIGHTS = 16;
+// Changed elements closer than this many bytes are written as one range, every call costs more than the gap
+static const size_t UPLOAD_MERGE_GAP = 256;
+
+// Writes only the elements of data that differ from previous, which the buffer already holds. Arrays with nothing
+// to compare against or that changed length are uploaded whole.
+template<typename T>
+static void UpdateStorageBuffer(GLuint& buffer, GLuint binding, const std::vector<T>& data, const std::vector<T>* previous, OpenGLView::SceneUploadStats& stats)
+{
+    const size_t size = data.size() * sizeof(T);
+    stats.totalBytes += size;
+    if (!buffer || !previous || previous->size() != data.size())
+    {
+        UploadStorageBuffer(buffer, binding, data.data(), size);
+        stats.uploadedBytes += size;
+        ++stats.uploadedRanges;
+        return;
+    }
 
-    auto& objs = model.objs;
-    const GLuint objCount = GLuint(std::min(size_t(MAX_OBJECTS), objs.size()));
-    glUniform1ui(glGetUniformLocation(shaderProgram, "OBJECT_COUNT"), objCount);
-    std::string prefix = "objs[";
-    for (GLuint ii = 0; ii < objCount; ++ii)
+    // Padding of every uploaded type is zeroed, so unchanged elements compare equal bytewise
+    auto differs = [&](size_t ii) { return std::memcmp(&data[ii], &(*previous)[ii], sizeof(T)) != 0; };
+    const size_t maxGap = std::max(UPLOAD_MERGE_GAP / sizeof(T), size_t(1));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    for (size_t first = 0; first < data.size(); )
     {
-        auto& obj = objs[ii];
-        std::string objPrefix = prefix + std::to_string(ii) + "].";
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, (objPrefix + "mv").c_str()), 1, GL_FALSE, glm::value_ptr(obj.mv));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, (objPrefix + "mvInverse").c_str()), 1, GL_FALSE, glm::value_ptr(obj.mvInverse));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, (objPrefix + "mvInverseTranspose").c_str()), 1, GL_FALSE, glm::value_ptr(obj.mvInverseTranspose));
+        if (!differs(first))
+        {
+            ++first;
+            continue;
+        }
+
+        size_t last = first;
+        for (size_t ii = first + 1; ii < data.size() && ii - last <= maxGap; ++ii)
+            if (differs(ii))
+                last = ii;
+
+        const size_t rangeSize = (last + 1 - first) * sizeof(T);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(T), rangeSize, &data[first]);
+        stats.uploadedBytes += rangeSize;
+        ++stats.uploadedRanges;
+        first = last + 1;
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
 
-        glUniform1ui(glGetUniformLocation(shaderProgram, (objPrefix + "type").c_str()), GLuint(obj.type));
+void OpenGLView::UseSceneVariant()
+{
+    ShaderVariant variant = ShaderVariant::FromModel(*model, lightSamples);
+    variant.countRays = profiler != nullptr;
+    variant.costOutput = costOutput;
 
-        std::string matPrefix = objPrefix + "mat.";
-        glUniform3fv(glGetUniformLocation(shaderProgram, (matPrefix + "ambient").c_str()), 1, glm::value_ptr(obj.mat.ambient));
-        glUniform3fv(glGetUniformLocation(shaderProgram, (matPrefix + "diffuse").c_str()), 1, glm::value_ptr(obj.mat.diffuse));
-        glUniform3fv(glGetUniformLocation(shaderProgram, (matPrefix + "specular").c_str()), 1, glm::value_ptr(obj.mat.specular));
-        glUniform1f(glGetUniformLocation(shaderProgram, (matPrefix + "absorption").c_str()), obj.mat.absorption);
-        glUniform1f(glGetUniformLocation(shaderProgram, (matPrefix + "reflection").c_str()), obj.mat.reflection);
-        glUniform1f(glGetUniformLocation(shaderProgram, (matPrefix + "transparency").c_str()), obj.mat.transparency);
-        glUniform1f(glGetUniformLocation(shaderProgram, (matPrefix + "shininess").c_str()), obj.mat.shininess);
+    shaderCompileTime = 0;
+    if (UsesWavefront())
+    {
+        shaderProgram = 0;
+        for (GLuint stage = 1; stage <= WAVEFRONT_STAGE_COUNT; ++stage)
+        {
+            ShaderVariant stageVariant = variant;
+            stageVariant.wavefrontStage = stage;
+            wavefrontPrograms[stage - 1] = GetShaderProgram(stageVariant);
+        }
+
+        // Every light is tested from each hit unless the variant samples them
+        const GLuint shadowRaysPerHit = variant.lightSamples > 0 ? variant.lightSamples : variant.lightCount;
+        if (!wavefrontPipeline)
+            wavefrontPipeline.reset(new WavefrontPipeline());
+        wavefrontPipeline->SetPrograms(wavefrontPrograms, variant.hasReflections ? variant.maxBounces : 0, shadowRaysPerHit);
+    }
+    else
+    {
+        shaderProgram = GetShaderProgram(variant);
+        wavefrontPrograms = {};
+        glUseProgram(shaderProgram);
     }
 
-    auto& lights = model.lights;
-    const GLuint lightCount = GLuint(std::min(size_t(MAX_LIGHTS), lights.size()));
-    glUniform1ui(glGetUniformLocation(shaderProgram, "LIGHT_COUNT"), lightCount);
-    prefix = "lights[";
-    for (GLuint ii = 0; ii < lightCount; ++ii)
+    // Uniforms belong to the program, so they are set again whenever the variant changes
+    SetUniform("camera.frameSize", float(width), float(height));
+    SetUniform("camera.tileOffset", 0.f, 0.f);
+    SetCameraUniforms();
+    SetUniform("accumulation", 0);
+    ResetAccumulation();
+
+    // Only the unspecialized shader reads this, variants bake it in as FIXED_MAX_BOUNCES
+    SetUniform("MAX_BOUNCES", model->MAX_BOUNCES);
+
+    // Only read by variants that sample lights
+    SetUniform("ambientLight", model->lightTree.GetAmbient());
+}
+
+void OpenGLView::SetCameraUniforms()
+{
+    SetUniform("camera.toWorld", model->camera.GetCameraToWorld());
+    SetUniform("camera.fov", model->camera.GetHalfFov());
+}
+
+void OpenGLView::LoadScene(const OpenGLModel* previous)
+{
+    UseSceneVariant();
+    MarkDirty();
+    uploadStats = SceneUploadStats();
+
+    std::vector<PackedMaterial> materials(model->materials.begin(), model->materials.end());
+    std::vector<PackedMaterial> previousMaterials;
+    if (previous)
+        previousMaterials.assign(previous->materials.begin(), previous->materials.end());
+    UpdateStorageBuffer(materialBuffer, MATERIAL_BINDING, materials, previous ? &previousMaterials : nullptr, uploadStats);
+
+    // Objects are already in the shader's layout
+    UpdateStorageBuffer(objectBuffer, OBJECT_BINDING, model->objs, previous ? &previous->objs : nullptr, uploadStats);
+
+    std::vector<PackedLight> lights(model->lights.begin(), model->lights.end());
+    std::vector<PackedLight> previousLights;
+    if (previous)
+        previousLights.assign(previous->lights.begin(), previous->lights.end());
+    UpdateStorageBuffer(lightBuffer, LIGHT_BINDING, lights, previous ? &previousLights : nullptr, uploadStats);
+
+    auto& lightTree = model->lightTree;
+    UpdateStorageBuffer(lightTreeNodeBuffer, LIGHT_TREE_NODE_BINDING, lightTree.GetNodes(),
+        previous ? &previous->lightTree.GetNodes() : nullptr, uploadStats);
+
+    // Each level is walked with its own stack
+    auto& bvh = model->bvh;
+    auto& meshes = model->meshes;
+    const GLuint depth = std::max({ bvh.GetTopLevelDepth(), bvh.GetBottomLevelDepth(), meshes.GetDepth() });
+    if (depth > BVH_STACK_SIZE)
+        std::cerr << "BVH depth " << depth << " exceeds the shader traversal stack, some objects may be skipped." << std::endl;
+
+    UpdateStorageBuffer(instanceBuffer, INSTANCE_BINDING, bvh.GetInstances(), previous ? &previous->bvh.GetInstances() : nullptr, uploadStats);
+    UpdateStorageBuffer(bvhNodeBuffer, BVH_NODE_BINDING, bvh.GetNodes(), previous ? &previous->bvh.GetNodes() : nullptr, uploadStats);
+    UpdateStorageBuffer(bvhPrimitiveBuffer, BVH_PRIMITIVE_BINDING, bvh.GetPrimitiveIndices(),
+        previous ? &previous->bvh.GetPrimitiveIndices() : nullptr, uploadStats);
+
+    UpdateStorageBuffer(meshNodeBuffer, MESH_NODE_BINDING, meshes.GetNodes(), previous ? &previous->meshes.GetNodes() : nullptr, uploadStats);
+    UpdateStorageBuffer(meshVertexBuffer, MESH_VERTEX_BINDING, meshes.GetVertices(), previous ? &previous->meshes.GetVertices() : nullptr, uploadStats);
+    UpdateStorageBuffer(meshIndexBuffer, MESH_INDEX_BINDING, meshes.GetIndices(), previous ? &previous->meshes.GetIndices() : nullptr, uploadStats);
+}
+
+void OpenGLView::UploadFrame()
+{
+    MarkDirty();
+
+    // Whole buffers are respecified rather than updated, so the driver can give them new storage instead of
+    // waiting for the previous frame to stop reading them
+    auto& animation = model->animation;
+    if (animation.HasAnimatedObjects())
+        UploadStorageBuffer(objectBuffer, OBJECT_BINDING, model->objs.data(), model->objs.size() * sizeof(ObjectData));
+    if (animation.HasAnimatedLights())
     {
-        auto& light = lights[ii];
-        std::string lightPrefix = prefix + std::to_string(ii) + "].";
-        glUniform3fv(glGetUniformLocation(shaderProgram, (lightPrefix + "ambient").c_str()), 1, glm::value_ptr(light.ambient));
-        glUniform3fv(glGetUniformLocation(shaderProgram, (lightPrefix + "diffuse").c_str()), 1, glm::value_ptr(light.diffuse));
-        glUniform3fv(glGetUniformLocation(shaderProgram, (lightPrefix + "specular").c_str()), 1, glm::value_ptr(light.specular));
-        glUniform4fv(glGetUniformLocation(shaderProgram, (lightPrefix + "position").c_str()), 1, glm::value_ptr(light.lightPosition));
+        std::vector<PackedLight> lights(model->lights.begin(), model->lights.end());
+        UploadStorageBuffer(lightBuffer, LIGHT_BINDING, lights.data(), lights.size() * sizeof(PackedLight));
+        auto& lightTreeNodes = model->lightTree.GetNodes();
+        UploadStorageBuffer(lightTreeNodeBuffer, LIGHT_TREE_NODE_BINDING, lightTreeNodes.data(), lightTreeNodes.size() * sizeof(LightTreeNode));
     }
+
+    auto& instances = model->bvh.GetInstances();
+    UploadStorageBuffer(instanceBuffer, INSTANCE_BINDING, instances.data(), instances.size() * sizeof(InstanceData));
+    auto& nodes = model->bvh.GetNodes();
+    UploadStorageBuffer(bvhNodeBuffer, BVH_NODE_BINDING, nodes.data(), nodes.size() * sizeof(BVHNode));
 }
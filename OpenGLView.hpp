@@ -3,18 +3,108 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
 #include <vector>
 #include <string>
+#include "AsyncReadback.hpp"
+#include "GpuProfiler.hpp"
+#include "ImageExporter.hpp"
 #include "OpenGLModel.h"
+#include "ShaderVariant.hpp"
+#include "WavefrontPipeline.hpp"
 
 class OpenGLView
 {
 public:
+    // What the last scene upload wrote to the GPU
+    struct SceneUploadStats
+    {
+        size_t uploadedBytes = 0, totalBytes = 0;
+        GLuint uploadedRanges = 0;
+    };
+
+    OpenGLView() = default;
     OpenGLView(OpenGLModel& model);
 
+    // Uploads a new scene, reusing the window, context and shader program if they are already set up
+    void SetModel(OpenGLModel& model);
+    // Uploads an edited version of the current scene, writing only the ranges of each buffer that differ from the
+    // current model's. The current model must stay alive until this returns.
+    void UpdateModel(OpenGLModel& model);
+    const SceneUploadStats& GetSceneUploadStats() const { return uploadStats; }
+    // Uploads what OpenGLModel::SetFrame moved, the animated objects and lights, the instances and the BVH nodes,
+    // and starts the frame's samples over
+    void UploadFrame();
+    // Moves the model's camera. Only the camera uniforms change, the scene buffers stay as they are.
+    void SetCamera(const Camera& camera);
+
+    // Renders the next sample of the frame, or only waits for window events once it has converged.
+    // Interactive windows show a reduced resolution preview instead while changes keep coming in.
     void Render();
+    // Blocks until the last rendered frame has finished on the GPU
+    void WaitForFrame();
+
+    // Renders an imageWidth x imageHeight frame as tileSize x tileSize tiles through a tile-sized render target,
+    // writing each finished band of rows to the exporter, which must already have begun. Only one band is held
+    // in memory, so the frame may exceed the driver's render target size. Headless views only.
+    void RenderTiled(GLuint imageWidth, GLuint imageHeight, GLuint tileSize, ImageExporter& exporter);
+
+    // Queues the last rendered frame for export without waiting for the GPU, see AsyncReadback
+    void ExportFrameAsync(const std::string& outFileLoc, unsigned int pngBitDepth = 8);
+    // Waits for every queued export, returns the total time spent writing files
+    double FinishExports();
+    // Queued exports whose file could not be written, only stable after FinishExports()
+    size_t GetFailedExportCount() const;
+
+    // A headless view draws into an offscreen framebuffer and never shows a window
+    void SetUpWindow(GLuint width, GLuint height, bool headless = false);
+
+    // Headless frames render into a 32 bit float target instead of 8 bit color. Set before SetUpWindow.
+    void SetFloatRenderTarget(bool useFloat) { floatRenderTarget = useFloat; }
+
+    // Samples per pixel. Above 1 each Render() jitters the ray within the pixel and blends into a pair of
+    // ping-pong float accumulation textures, which readback and export then use. Set before SetUpWindow.
+    void SetSampleCount(GLuint sampleCount) { this->sampleCount = std::max(sampleCount, 1u); }
+    // Whether every sample of the current frame has been rendered
+    bool IsConverged() const { return accumulatedSamples >= sampleCount; }
+    // Renders the frame from its first sample again, done whenever the scene or size changes
+    void ResetAccumulation() { accumulatedSamples = 0; }
+
+    // Point lights sampled per hit in scenes with more lights than this, see LightTree. Set before the scene loads.
+    void SetLightSampleCount(GLuint lightSamples) { this->lightSamples = lightSamples; }
+    // Renders each pixel's intersection tests, bounces and shadow rays instead of its colour into a float target,
+    // see CostHeatmap. Set before SetUpWindow.
+    void SetCostOutput(bool costOutput) { this->costOutput = costOutput; }
+
+    // Traces through the compute stages of wavefront.glsl instead of the fragment shader, see WavefrontPipeline.
+    // Cost output is only rendered by the fragment shader. Set before SetUpWindow.
+    void SetWavefront(bool wavefront) { this->wavefront = wavefront; }
+
+    // Previews every change at a reduced resolution picked to render within frameBudget milliseconds, upscaled to
+    // the window, and only starts on full resolution samples once no change has come in for a moment. Windows only,
+    // set before SetUpWindow.
+    void SetInteractive(bool interactive, double frameBudget = 33.3);
+    // Redraws the frame from a preview, call after changing the camera or scene. Resizes and SetModel call it.
+    void MarkDirty();
+    // When a frame was last handed to the window
+    std::chrono::steady_clock::time_point GetLastPresentTime() const { return lastPresentTime; }
+
+    // Directory for cached program binaries, empty to always compile from source. Set before SetUpWindow.
+    void SetShaderCacheDirectory(const std::string& cacheDir) { shaderCacheDir = cacheDir; }
+    // Milliseconds the last scene upload spent compiling or loading its shader variant, 0 if it was already linked
+    double GetShaderCompileTime() const { return shaderCompileTime; }
 
-    void SetUpWindow(GLuint width, GLuint height);
+    // Times each frame's phases on the GPU and counts its rays, see GpuProfiler. Switches to a shader variant that
+    // counts rays, and while a window is open keeps rendering converged frames and prints a report every second.
+    // Can be toggled at any time, also with the P key.
+    void SetProfiling(bool profiling);
+    bool IsProfiling() const { return profiling; }
+    // Waits for the frames still being measured and prints their report
+    void ReportProfile();
     void TearDownWindow();
 
     bool ShouldWindowClose();
@@ -23,16 +113,85 @@ public:
     void SetWindowSize(GLuint width, GLuint height);
 
 private:
-    GLuint LoadShader(GLenum type, const std::string& source);
+    GLuint CreateShaderProgram(const ShaderVariant& variant);
+    // Links the variant on first use, adding the time it took to shaderCompileTime
+    GLuint GetShaderProgram(const ShaderVariant& variant);
+    GLuint LoadShader(GLenum type, const std::string& sourceFile, const std::string& source);
 
-    void LoadScene();
+    // Uploads every scene buffer, or with the model the buffers currently hold only what changed since
+    void LoadScene(const OpenGLModel* previous = nullptr);
+    // Switches to the scene's shader variant and sets its uniforms
+    void UseSceneVariant();
+    void SetCameraUniforms();
+    // The fragment program and every wavefront stage, the ones not in use are 0
+    std::array<GLuint, WAVEFRONT_STAGE_COUNT + 1> GetPrograms() const;
+    // Sets a uniform on every program in use, the wavefront stages declare the same uniforms as the fragment shader
+    void SetUniform(const char* name, GLint value);
+    void SetUniform(const char* name, GLuint value);
+    void SetUniform(const char* name, float value);
+    void SetUniform(const char* name, float x, float y);
+    void SetUniform(const char* name, const glm::vec3& value);
+    void SetUniform(const char* name, const glm::mat4& value);
+    bool UsesWavefront() const { return wavefront && !costOutput; }
+    void CreateRenderTarget();
+    void CreatePreviewTarget();
+    void CreateAccumulationTargets();
+    // Shows the last finished image in the window
+    void Present();
+    // Whether a change came in too recently to start on full resolution samples
+    bool IsInteracting() const;
+    // Renders and shows a single sample at previewScale of the window size, then adapts the scale to the frame
+    // budget from how long it took
+    void RenderPreview();
+    // Draws the next sample of the frame into its accumulation target
+    void RenderSample();
+    // The framebuffer holding the last finished image, rendering the frame's first sample if it has none yet
+    GLuint GetResultFramebuffer();
+    GLenum GetRenderTargetFormat() const { return floatRenderTarget || costOutput ? GL_RGBA32F : GL_RGBA8; }
 
-    OpenGLModel& model;
+    OpenGLModel* model = NULL;
 
-    GLuint width, height;
+    GLuint width = 0, height = 0;
     GLFWwindow* window = NULL;
+    bool headless = false;
 
-    GLuint shaderProgram;
+    std::string shaderCacheDir;
+    // Linked programs keyed by their variant's defines, shaderProgram is the one in use
+    std::map<std::string, GLuint> shaderVariants;
+    // 0 when tracing with the wavefront stages instead
+    GLuint shaderProgram = 0;
+    double shaderCompileTime = 0;
     GLuint quadVAO, quadVBO;
+    // Offscreen color target for headless rendering, 0 when drawing to the window
+    GLuint renderTargetFBO = 0, renderTargetColor = 0;
+    bool floatRenderTarget = false;
+    // Ping-pong accumulation targets, each sample reads one and writes the other. 0 for single sample frames.
+    GLuint accumulationFBO[2] = { 0, 0 }, accumulationColor[2] = { 0, 0 };
+    GLuint sampleCount = 1, accumulatedSamples = 0;
+    GLuint lightSamples = 0;
+    bool costOutput = false;
+    bool wavefront = false;
+    std::array<GLuint, WAVEFRONT_STAGE_COUNT> wavefrontPrograms = {};
+    std::unique_ptr<WavefrontPipeline> wavefrontPipeline;
+    GLuint bvhNodeBuffer = 0, bvhPrimitiveBuffer = 0;
+    GLuint objectBuffer = 0, lightBuffer = 0, materialBuffer = 0, instanceBuffer = 0;
+    GLuint meshNodeBuffer = 0, meshVertexBuffer = 0, meshIndexBuffer = 0;
+    GLuint lightTreeNodeBuffer = 0;
+    SceneUploadStats uploadStats;
+    std::chrono::steady_clock::time_point lastPresentTime;
+    bool interactive = false;
+    // Milliseconds a preview may take
+    double frameBudget = 33.3;
+    // Fraction of the window's width and height previews render at
+    float previewScale = 0.5f;
+    bool previewPending = false;
+    std::chrono::steady_clock::time_point lastChange;
+    // Window-sized color target previews render into the lower left corner of, 0 unless interactive.
+    // The wavefront pipeline previews into its own output instead.
+    GLuint previewFBO = 0, previewColor = 0;
+    std::unique_ptr<AsyncReadback> readback;
+    bool profiling = false;
+    // Created with the context while profiling
+    std::unique_ptr<GpuProfiler> profiler;
 };
 
@@ -0,0 +1,40 @@
+#include "PFMExporter.hpp"
+#include <cstring>
+#include <stdexcept>
+
+void PFMExporter::Begin(const std::string& outFileLoc, unsigned int width, unsigned int height)
+{
+    this->outFileLoc = outFileLoc;
+    this->width = width;
+    this->height = height;
+    rowsWritten = 0;
+
+    // A negative scale marks the data as little-endian
+    const std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+    dataOffset = header.size();
+
+    file = MappedFile::Create(outFileLoc, dataOffset + 3 * sizeof(float) * size_t(width) * height);
+    std::memcpy(file.GetWritableData(), header.data(), header.size());
+}
+
+void PFMExporter::WriteRows(const float* pixelData, unsigned int rowCount)
+{
+    if (rowsWritten + rowCount > height)
+        throw std::runtime_error("Too many rows written to '" + outFileLoc + "'.");
+
+    const size_t rowSize = 3 * sizeof(float) * size_t(width);
+    for (unsigned int row = 0; row < rowCount; ++row, pixelData += size_t(width) * 3) {
+        const size_t fileRow = height - 1 - (rowsWritten + row);
+        std::memcpy(file.GetWritableData() + dataOffset + fileRow * rowSize, pixelData, rowSize);
+    }
+
+    rowsWritten += rowCount;
+}
+
+void PFMExporter::End()
+{
+    if (rowsWritten != height)
+        throw std::runtime_error("Only " + std::to_string(rowsWritten) + " of " + std::to_string(height) + " rows were written to '" + outFileLoc + "'.");
+
+    file.Close();
+}
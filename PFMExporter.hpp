@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include "ImageExporter.hpp"
+#include "MappedFile.hpp"
+
+// Writes little-endian color Portable Float Maps. PFM stores rows bottom-up, so the file is
+// sized up front and mapped, letting each incoming top-down row land directly at its final position.
+class PFMExporter : public ImageExporter
+{
+public:
+    void Begin(const std::string& outFileLoc, unsigned int width, unsigned int height) override;
+    void WriteRows(const float* pixelData, unsigned int rowCount) override;
+    void End() override;
+
+private:
+    unsigned int width = 0, height = 0, rowsWritten = 0;
+
+    std::string outFileLoc;
+    MappedFile file;
+    size_t dataOffset = 0;
+};
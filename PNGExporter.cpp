@@ -1,25 +1,145 @@
 #include "PNGExporter.h"
-#include <opencv2/opencv.hpp>
-#include <opencv2/core/utils/logger.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
 
-void PNGExporter::Export(const std::string& outFileLoc, unsigned int width, unsigned int height, const std::vector<float>& pixelData)
+static const size_t DEFLATE_BUFFER_SIZE = 1 << 16;
+
+static void WriteBigEndian32(unsigned char* dst, uint32_t value)
+{
+    dst[0] = (unsigned char)(value >> 24);
+    dst[1] = (unsigned char)(value >> 16);
+    dst[2] = (unsigned char)(value >> 8);
+    dst[3] = (unsigned char)(value);
+}
+
+PNGExporter::PNGExporter(unsigned int bitDepth) : bitDepth(bitDepth)
+{
+    if (bitDepth != 8 && bitDepth != 16)
+        throw std::runtime_error("PNG bit depth must be 8 or 16, found " + std::to_string(bitDepth) + ".");
+}
+
+PNGExporter::~PNGExporter()
+{
+    if (streamOpen)
+        deflateEnd(&stream);
+}
+
+void PNGExporter::Begin(const std::string& outFileLoc, unsigned int width, unsigned int height)
+{
+    this->outFileLoc = outFileLoc;
+    this->width = width;
+    this->height = height;
+    rowsWritten = 0;
+
+    file.open(outFileLoc, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("Unable to open '" + outFileLoc + "' for writing.");
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    unsigned char header[13];
+    WriteBigEndian32(header, width);
+    WriteBigEndian32(header + 4, height);
+    header[8] = (unsigned char)bitDepth;
+    header[9] = 2; // truecolor RGB
+    header[10] = 0; // deflate
+    header[11] = 0; // adaptive filtering, every row uses filter type 0
+    header[12] = 0; // not interlaced
+    WriteChunk("IHDR", header, sizeof(header));
+
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+        throw std::runtime_error("Unable to initialize deflate for '" + outFileLoc + "'.");
+    streamOpen = true;
+
+    // One filter type byte leads every row
+    rowBuffer.resize(1 + size_t(width) * 3 * (bitDepth / 8));
+    deflateBuffer.resize(DEFLATE_BUFFER_SIZE);
+    stream.next_out = deflateBuffer.data();
+    stream.avail_out = uInt(deflateBuffer.size());
+}
+
+void PNGExporter::WriteRows(const float* pixelData, unsigned int rowCount)
 {
-    std::vector<unsigned char> pixelsUnsigned(pixelData.size());
-    for (size_t i = 0; i < pixelData.size(); ++i) {
-        pixelsUnsigned[i] = static_cast<unsigned char>(pixelData[i] * 255.0f);
+    if (rowsWritten + rowCount > height)
+        throw std::runtime_error("Too many rows written to '" + outFileLoc + "'.");
+
+    for (unsigned int row = 0; row < rowCount; ++row, pixelData += size_t(width) * 3) {
+        rowBuffer[0] = 0;
+        unsigned char* dst = rowBuffer.data() + 1;
+        if (bitDepth == 8) {
+            for (size_t ii = 0; ii < size_t(width) * 3; ++ii)
+                dst[ii] = static_cast<unsigned char>(std::min(std::max(pixelData[ii], 0.0f), 1.0f) * 255.0f);
+        }
+        else {
+            for (size_t ii = 0; ii < size_t(width) * 3; ++ii) {
+                unsigned short value = static_cast<unsigned short>(std::min(std::max(pixelData[ii], 0.0f), 1.0f) * 65535.0f + 0.5f);
+                dst[2 * ii] = (unsigned char)(value >> 8);
+                dst[2 * ii + 1] = (unsigned char)(value & 0xFF);
+            }
+        }
+
+        stream.next_in = rowBuffer.data();
+        stream.avail_in = uInt(rowBuffer.size());
+        Deflate(Z_NO_FLUSH);
     }
 
-    cv::Mat image(height, width, CV_8UC3);
-    std::memcpy(image.data, pixelsUnsigned.data(), pixelsUnsigned.size() * sizeof(unsigned char));
+    rowsWritten += rowCount;
+}
+
+void PNGExporter::End()
+{
+    if (rowsWritten != height)
+        throw std::runtime_error("Only " + std::to_string(rowsWritten) + " of " + std::to_string(height) + " rows were written to '" + outFileLoc + "'.");
+
+    stream.next_in = nullptr;
+    stream.avail_in = 0;
+    Deflate(Z_FINISH);
+    deflateEnd(&stream);
+    streamOpen = false;
 
-    cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_ERROR); // ignore info logs about parallelism
-    cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
-    cv::flip(image, image, 0);
+    WriteChunk("IEND", nullptr, 0);
+    file.close();
+    if (file.fail())
+        throw std::runtime_error("Unable to finish writing '" + outFileLoc + "'.");
+}
+
+void PNGExporter::Deflate(int flush)
+{
+    while (true) {
+        int result = deflate(&stream, flush);
+        if (result == Z_STREAM_ERROR)
+            throw std::runtime_error("Deflate failed while writing '" + outFileLoc + "'.");
+
+        const bool bufferFull = stream.avail_out == 0;
+        const bool finished = flush == Z_FINISH && result == Z_STREAM_END;
+        if (bufferFull || finished) {
+            size_t length = deflateBuffer.size() - stream.avail_out;
+            if (length > 0)
+                WriteChunk("IDAT", deflateBuffer.data(), length);
+            stream.next_out = deflateBuffer.data();
+            stream.avail_out = uInt(deflateBuffer.size());
+        }
 
-    if (!cv::imwrite(outFileLoc, image)) {
-        std::cerr << "Error writing file: " << outFileLoc << std::endl;
-        return;
+        if (finished || (flush != Z_FINISH && stream.avail_in == 0 && !bufferFull))
+            return;
     }
+}
+
+void PNGExporter::WriteChunk(const char* type, const unsigned char* data, size_t length)
+{
+    unsigned char lengthBytes[4], crcBytes[4];
+    WriteBigEndian32(lengthBytes, uint32_t(length));
+
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+    if (length > 0)
+        crc = crc32(crc, data, uInt(length));
+    WriteBigEndian32(crcBytes, uint32_t(crc));
 
-    std::cout << "Exported to '" << outFileLoc << "'" << std::endl;
+    file.write(reinterpret_cast<const char*>(lengthBytes), 4);
+    file.write(type, 4);
+    if (length > 0)
+        file.write(reinterpret_cast<const char*>(data), length);
+    file.write(reinterpret_cast<const char*>(crcBytes), 4);
 }
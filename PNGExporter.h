@@ -1,9 +1,33 @@
 #pragma once
+#include <fstream>
 #include <string>
 #include <vector>
-class PNGExporter
+#include <zlib.h>
+#include "ImageExporter.hpp"
+
+// Streams RGB PNGs at 8 or 16 bits per channel, deflating each row as it arrives.
+// Values are clamped to [0, 1], so this is the one lossy format for HDR results.
+class PNGExporter : public ImageExporter
 {
 public:
-    static void Export(const std::string& outFileLoc, unsigned int width, unsigned int height, const std::vector<float>& pixelData);
-};
+    explicit PNGExporter(unsigned int bitDepth = 8);
+    ~PNGExporter();
+
+    void Begin(const std::string& outFileLoc, unsigned int width, unsigned int height) override;
+    void WriteRows(const float* pixelData, unsigned int rowCount) override;
+    void End() override;
 
+private:
+    void WriteChunk(const char* type, const unsigned char* data, size_t length);
+    // Runs deflate over the pending input, writing an IDAT chunk whenever the output buffer fills
+    void Deflate(int flush);
+
+    unsigned int bitDepth;
+    unsigned int width = 0, height = 0, rowsWritten = 0;
+
+    std::string outFileLoc;
+    std::ofstream file;
+    z_stream stream{};
+    bool streamOpen = false;
+    std::vector<unsigned char> rowBuffer, deflateBuffer;
+};
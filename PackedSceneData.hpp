@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Material.hpp"
+#include "ObjectData.hpp"
+#include "Light.hpp"
+
+// Host mirrors of the std430 structs in shade_and_reflect.glsl, uploaded to shader storage buffers as-is.
+// vec3 members are 16 byte aligned in std430, so each one is followed by a scalar or explicit padding.
+// ObjectData already has the shader's layout and needs no mirror.
+
+struct PackedMaterial
+{
+    PackedMaterial(const Material& mat) :
+        ambient(mat.ambient),
+        absorption(mat.absorption),
+        diffuse(mat.diffuse),
+        reflection(mat.reflection),
+        specular(mat.specular),
+        transparency(mat.transparency),
+        shininess(mat.shininess)
+    {
+    }
+
+    Material ToMaterial() const
+    {
+        Material mat;
+        mat.ambient = ambient;
+        mat.diffuse = diffuse;
+        mat.specular = specular;
+        mat.absorption = absorption;
+        mat.reflection = reflection;
+        mat.transparency = transparency;
+        mat.shininess = shininess;
+        return mat;
+    }
+
+    glm::vec3 ambient;
+    GLfloat absorption;
+    glm::vec3 diffuse;
+    GLfloat reflection;
+    glm::vec3 specular;
+    GLfloat transparency;
+    GLfloat shininess;
+    GLfloat padding[3] = { 0.f, 0.f, 0.f };
+};
+static_assert(sizeof(PackedMaterial) == 64, "PackedMaterial must match the std430 'Material' struct");
+
+struct PackedLight
+{
+    PackedLight(const Light& light) :
+        ambient(light.ambient),
+        diffuse(light.diffuse),
+        specular(light.specular),
+        position(light.lightPosition)
+    {
+    }
+
+    Light ToLight() const
+    {
+        LightProperties props;
+        props.ambient = ambient;
+        props.diffuse = diffuse;
+        props.specular = specular;
+
+        // Already transformed, the identity keeps the position as stored
+        Light light(props, glm::mat4(1.f));
+        light.lightPosition = position;
+        return light;
+    }
+
+    glm::vec3 ambient;
+    GLfloat padding0 = 0.f;
+    glm::vec3 diffuse;
+    GLfloat padding1 = 0.f;
+    glm::vec3 specular;
+    GLfloat padding2 = 0.f;
+    glm::vec4 position;
+};
+static_assert(sizeof(PackedLight) == 64, "PackedLight must match the std430 'Light' struct");
@@ -0,0 +1,36 @@
+#include "RawFrameExporter.hpp"
+#include <cstring>
+#include <stdexcept>
+
+void RawFrameExporter::Begin(const std::string& outFileLoc, unsigned int width, unsigned int height)
+{
+    this->outFileLoc = outFileLoc;
+    this->width = width;
+    this->height = height;
+    rowsWritten = 0;
+
+    RawFrameHeader header;
+    header.width = width;
+    header.height = height;
+
+    file = MappedFile::Create(outFileLoc, size_t(header.dataOffset) + 3 * sizeof(float) * size_t(width) * height);
+    std::memcpy(file.GetWritableData(), &header, sizeof(header));
+}
+
+void RawFrameExporter::WriteRows(const float* pixelData, unsigned int rowCount)
+{
+    if (rowsWritten + rowCount > height)
+        throw std::runtime_error("Too many rows written to '" + outFileLoc + "'.");
+
+    const size_t rowSize = 3 * sizeof(float) * size_t(width);
+    std::memcpy(file.GetWritableData() + sizeof(RawFrameHeader) + rowsWritten * rowSize, pixelData, rowCount * rowSize);
+    rowsWritten += rowCount;
+}
+
+void RawFrameExporter::End()
+{
+    if (rowsWritten != height)
+        throw std::runtime_error("Only " + std::to_string(rowsWritten) + " of " + std::to_string(height) + " rows were written to '" + outFileLoc + "'.");
+
+    file.Close();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "ImageExporter.hpp"
+#include "MappedFile.hpp"
+
+// Header of a .rtfb file. Pixel data follows at dataOffset as top-down rows of
+// interleaved 32 bit float RGB, so readers can map the file and use the rows in place.
+struct RawFrameHeader
+{
+    char magic[4] = { 'R', 'T', 'F', 'B' };
+    uint32_t version = 1;
+    uint32_t width = 0, height = 0;
+    uint32_t channelCount = 3;
+    uint32_t bytesPerChannel = sizeof(float);
+    uint64_t dataOffset = 64;
+    uint8_t reserved[32] = {};
+};
+static_assert(sizeof(RawFrameHeader) == 64, "RawFrameHeader must stay 64 bytes so the pixel data is aligned");
+
+// Writes the raw framebuffer format through a memory mapping, rows are copied straight into the mapped file.
+class RawFrameExporter : public ImageExporter
+{
+public:
+    void Begin(const std::string& outFileLoc, unsigned int width, unsigned int height) override;
+    void WriteRows(const float* pixelData, unsigned int rowCount) override;
+    void End() override;
+
+private:
+    unsigned int width = 0, height = 0, rowsWritten = 0;
+
+    std::string outFileLoc;
+    MappedFile file;
+};
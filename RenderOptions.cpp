@@ -0,0 +1,229 @@
+#include "RenderOptions.hpp"
+#include "BinaryScene.hpp"
+#include <stdexcept>
+
+void RenderOptions::OverrideCamera(Camera& camera) const
+{
+    if (fovDegrees > 0.f)
+        camera.fovDegrees = fovDegrees;
+}
+
+static std::string GetFlagValue(int argc, char** argv, int& ii)
+{
+    std::string flag = argv[ii];
+    if (ii + 1 >= argc)
+        throw std::runtime_error("Missing value for '" + flag + "'.");
+
+    return argv[++ii];
+}
+
+static GLuint ParseCount(const std::string& flag, const std::string& value, const std::string& expected, unsigned long maxValue, unsigned long minValue = 1)
+{
+    size_t end = 0;
+    unsigned long count = 0;
+    try {
+        count = std::stoul(value, &end);
+    }
+    catch (const std::exception&) {
+        end = 0;
+    }
+
+    if (end != value.size() || count < minValue || count > maxValue)
+        throw std::runtime_error("Invalid value '" + value + "' for '" + flag + "', expected " + expected + " between "
+            + std::to_string(minValue) + " and " + std::to_string(maxValue) + ".");
+
+    return GLuint(count);
+}
+
+static GLuint ParseDimension(const std::string& flag, const std::string& value)
+{
+    // Frames beyond the driver's render target size are possible with '--tile-size'
+    return ParseCount(flag, value, "a size", 65536);
+}
+
+static float ParseFov(const std::string& flag, const std::string& value)
+{
+    size_t end = 0;
+    float fov = 0.f;
+    try {
+        fov = std::stof(value, &end);
+    }
+    catch (const std::exception&) {
+        end = 0;
+    }
+
+    if (end != value.size() || !(fov > 0.f && fov < 180.f))
+        throw std::runtime_error("Invalid value '" + value + "' for '" + flag + "', expected degrees between 0 and 180.");
+
+    return fov;
+}
+
+RenderOptions RenderOptions::Parse(int argc, char** argv)
+{
+    RenderOptions options;
+
+    for (int ii = 1; ii < argc; ++ii) {
+        std::string arg = argv[ii];
+        if (arg == "--cpu") {
+            options.useCPU = true;
+        }
+        else if (arg == "--headless") {
+            options.headless = true;
+        }
+        else if (arg == "--width") {
+            options.width = ParseDimension(arg, GetFlagValue(argc, argv, ii));
+        }
+        else if (arg == "--height") {
+            options.height = ParseDimension(arg, GetFlagValue(argc, argv, ii));
+        }
+        else if (arg == "--samples") {
+            options.samples = ParseCount(arg, GetFlagValue(argc, argv, ii), "a sample count", 65536);
+        }
+        else if (arg == "--light-samples") {
+            options.lightSamples = ParseCount(arg, GetFlagValue(argc, argv, ii), "a light count", 65536, 0);
+        }
+        else if (arg == "--tile-size") {
+            // Tiles are only rendered offscreen
+            options.tileSize = ParseDimension(arg, GetFlagValue(argc, argv, ii));
+            options.headless = true;
+        }
+        else if (arg == "--heatmap") {
+            // Costs are read back as floats, which only the offscreen target holds
+            options.heatmap = ParseCostMetric(GetFlagValue(argc, argv, ii));
+            options.headless = true;
+        }
+        else if (arg == "--wavefront") {
+            options.wavefront = true;
+        }
+        else if (arg == "--interactive") {
+            options.interactive = true;
+        }
+        else if (arg == "--frame-budget") {
+            options.frameBudgetMs = ParseCount(arg, GetFlagValue(argc, argv, ii), "milliseconds", 1000);
+            options.interactive = true;
+        }
+        else if (arg == "--watch") {
+            options.watch = true;
+        }
+        else if (arg == "--profile") {
+            options.profile = true;
+        }
+        else if (arg == "--fov") {
+            options.fovDegrees = ParseFov(arg, GetFlagValue(argc, argv, ii));
+        }
+        else if (arg == "--output" || arg == "-o") {
+            options.outFileLoc = GetFlagValue(argc, argv, ii);
+        }
+        else if (arg == "--shader-cache") {
+            options.shaderCacheDir = GetFlagValue(argc, argv, ii);
+        }
+        else if (arg == "--no-shader-cache") {
+            options.shaderCacheDir.clear();
+        }
+        else if (arg == "--png-depth") {
+            std::string value = GetFlagValue(argc, argv, ii);
+            if (value != "8" && value != "16")
+                throw std::runtime_error("Invalid value '" + value + "' for '" + arg + "', expected 8 or 16.");
+            options.pngBitDepth = value == "8" ? 8 : 16;
+        }
+        else if (arg == "--compile") {
+            options.compileOutFileLoc = GetFlagValue(argc, argv, ii);
+            if (!BinaryScene::IsBinaryScene(options.compileOutFileLoc))
+                throw std::runtime_error("Invalid value '" + options.compileOutFileLoc + "' for '" + arg + "', expected a .rtscene file.");
+        }
+        else if (arg == "--batch") {
+            options.batchManifestLoc = GetFlagValue(argc, argv, ii);
+        }
+        else if (arg == "--benchmark") {
+            // Benchmarks never open a window, vsync and event handling would be timed with the frames
+            options.benchmarkOutFileLoc = GetFlagValue(argc, argv, ii);
+            options.headless = true;
+        }
+        else if (arg == "--benchmark-frames") {
+            options.benchmarkFrames = ParseCount(arg, GetFlagValue(argc, argv, ii), "a frame count", 1000);
+        }
+        else if (arg.size() > 1 && arg[0] == '-') {
+            throw std::runtime_error("Unknown option '" + arg + "'.");
+        }
+        else if (options.sceneFileLoc.empty()) {
+            options.sceneFileLoc = arg;
+        }
+        else {
+            throw std::runtime_error("Unexpected argument '" + arg + "'.");
+        }
+    }
+
+    if (!options.batchManifestLoc.empty() && !options.sceneFileLoc.empty())
+        throw std::runtime_error("A scene file cannot be given together with '--batch'.");
+    if (!options.batchManifestLoc.empty() && !options.compileOutFileLoc.empty())
+        throw std::runtime_error("'--compile' cannot be used together with '--batch'.");
+    if (!options.batchManifestLoc.empty() && options.tileSize > 0)
+        throw std::runtime_error("'--tile-size' cannot be used together with '--batch'.");
+    if (options.heatmap != CostMetric::none && (!options.batchManifestLoc.empty() || !options.benchmarkOutFileLoc.empty() || !options.compileOutFileLoc.empty() || options.tileSize > 0))
+        throw std::runtime_error("'--heatmap' cannot be used together with '--batch', '--benchmark', '--compile' or '--tile-size'.");
+    if (options.wavefront && (options.useCPU || options.heatmap != CostMetric::none))
+        throw std::runtime_error("'--wavefront' cannot be used together with '--cpu' or '--heatmap'.");
+    if (options.interactive && (options.useCPU || options.headless || !options.batchManifestLoc.empty() || !options.compileOutFileLoc.empty()))
+        throw std::runtime_error("'--interactive' needs a window, it cannot be used together with '--cpu', '--headless' or options that render offscreen.");
+    if (options.watch && (options.useCPU || options.headless || !options.batchManifestLoc.empty() || !options.compileOutFileLoc.empty() || !options.benchmarkOutFileLoc.empty()))
+        throw std::runtime_error("'--watch' needs a window, it cannot be used together with '--cpu', '--headless' or options that render offscreen.");
+    if (options.profile && options.useCPU)
+        throw std::runtime_error("'--profile' measures the OpenGL renderer, it cannot be used together with '--cpu'.");
+    if (!options.benchmarkOutFileLoc.empty()) {
+        if (!options.sceneFileLoc.empty())
+            throw std::runtime_error("A scene file cannot be given together with '--benchmark', it generates its own scenes.");
+        if (!options.batchManifestLoc.empty() || !options.compileOutFileLoc.empty() || options.tileSize > 0)
+            throw std::runtime_error("'--benchmark' cannot be used together with '--batch', '--compile' or '--tile-size'.");
+    }
+
+    return options;
+}
+
+std::string RenderOptions::Usage(const std::string& program)
+{
+    return "Usage: " + program + " [options] [scene file]\n"
+        "  --cpu                 Render on the CPU instead of through OpenGL\n"
+        "  --headless            Render one frame offscreen and exit, without a window\n"
+        "  --width <pixels>      Image width (default 1920)\n"
+        "  --height <pixels>     Image height (default 1080)\n"
+        "  --fov <degrees>       Vertical field of view, replacing the scene camera's (default 60)\n"
+        "  --samples <count>     Jittered samples per pixel, accumulated until the count is\n"
+        "                        reached (default 1)\n"
+        "  --light-samples <count>\n"
+        "                        Lights sampled per hit by importance in scenes with more\n"
+        "                        lights than this, every light is shaded otherwise. 0 always\n"
+        "                        shades every light (default 8)\n"
+        "  --tile-size <pixels>  Render offscreen in square tiles, streaming rows to the output,\n"
+        "                        for frames larger than the GPU or memory allows\n"
+        "  --heatmap <tests|bounces|shadow-rays>\n"
+        "                        Write a false-colour heatmap of the intersection tests,\n"
+        "                        reflection bounces or shadow rays per pixel instead of the\n"
+        "                        image, offscreen, and print a histogram of the cost\n"
+        "  --wavefront           Trace with separate compute dispatches for ray generation,\n"
+        "                        intersection, shading and shadow rays instead of one\n"
+        "                        fragment shader, works with --benchmark\n"
+        "  --interactive         Redraw the window only when it changes, at a reduced resolution\n"
+        "                        while it keeps changing and at full resolution once it stops\n"
+        "  --frame-budget <ms>   Milliseconds an interactive redraw may take, which picks its\n"
+        "                        resolution (default 33), implies --interactive\n"
+        "  --watch               Reload the scene whenever its file is saved, uploading only\n"
+        "                        what changed, and print how long the edit took to show\n"
+        "  --profile             Time the render phases on the GPU and count rays and\n"
+        "                        intersection tests, reported every second in a window and\n"
+        "                        after the frame offscreen. Press P to toggle it in a window.\n"
+        "  -o, --output <file>   Output image, .png, .exr, .pfm or .rtfb (default render.png)\n"
+        "                        Scenes with an 'animation' block render a sequence offscreen or\n"
+        "                        with --cpu, numbering each frame's file as in render_0001.png\n"
+        "  --png-depth <8|16>    Bits per channel for .png output (default 8)\n"
+        "  --compile <file>      Compile the scene to a .rtscene file that loads without parsing,\n"
+        "                        check the round trip and compare load times\n"
+        "  --batch <manifest>    Render each '<scene file> <output file>' line of the manifest\n"
+        "                        offscreen, reusing one context\n"
+        "  --benchmark <file>    Render generated scenes of increasing size offscreen and write\n"
+        "                        the parse, build, upload, shader, frame and export times to\n"
+        "                        the file as JSON. Scenes and images are written beside it.\n"
+        "  --benchmark-frames <count>\n"
+        "                        Timed frames per benchmark scene (default 5)\n"
+        "  --shader-cache <dir>  Directory for cached shader binaries (default shader_cache)\n"
+        "  --no-shader-cache     Always compile the shaders from source\n";
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include "Camera.hpp"
+#include "CostHeatmap.hpp"
+
+// Settings taken from the command line, see RenderOptions::Usage for the flags.
+struct RenderOptions
+{
+    std::string sceneFileLoc;
+    // The extension picks the format, see ImageExporter::ForFile
+    std::string outFileLoc = "render.png";
+    // 8 or 16 bits per channel for .png output
+    unsigned int pngBitDepth = 8;
+    // Writes the scene as a compiled '.rtscene' file here instead of rendering, see BinaryScene
+    std::string compileOutFileLoc;
+    // Renders every job in this manifest with one context, see LoadBatchManifest
+    std::string batchManifestLoc;
+    // Renders a suite of generated scenes and writes their timings here as JSON, see BenchmarkReport
+    std::string benchmarkOutFileLoc;
+    // Timed frames per benchmark scene, after one warm-up frame
+    GLuint benchmarkFrames = 5;
+
+    GLuint width = 1920, height = 1080;
+    // Replaces the full vertical field of view of the scene's camera, in degrees. 0 keeps the scene's.
+    float fovDegrees = 0.f;
+
+    // Program binaries are cached here between runs, empty to disable the cache
+    std::string shaderCacheDir = "shader_cache";
+
+    // Render on the CPU instead of through OpenGL, for machines without a GPU
+    bool useCPU = false;
+    // Render a single frame offscreen and exit, without opening a window
+    bool headless = false;
+    // Jittered samples per pixel, averaged progressively. 1 traces through the pixel centers only.
+    GLuint samples = 1;
+    // Point lights sampled from the light tree per shading point, when the scene has more lights than this.
+    // Scenes with fewer lights shade every one. See LightTree.
+    GLuint lightSamples = 8;
+    // Render in tiles of this many pixels a side, streaming rows to the output, 0 to render the frame at once
+    GLuint tileSize = 0;
+    // Trace with separate compute dispatches per stage instead of one fragment shader, see WavefrontPipeline
+    bool wavefront = false;
+    // Windows redraw at a reduced resolution while they change and refine once the changes stop, see
+    // OpenGLView::SetInteractive
+    bool interactive = false;
+    // Milliseconds an interactive preview may take
+    GLuint frameBudgetMs = 33;
+    // Reload the scene whenever its file changes, uploading only what the edit changed, see FileWatcher
+    bool watch = false;
+    // Time render phases on the GPU and count rays, see GpuProfiler. Windows can also toggle this with P.
+    bool profile = false;
+    // Writes a heatmap of this per-pixel cost instead of the shaded image and prints a summary, see CostHeatmap
+    CostMetric heatmap = CostMetric::none;
+
+    // Applies the options that change how a loaded scene is viewed
+    void OverrideCamera(Camera& camera) const;
+
+    // Throws std::runtime_error if the arguments cannot be parsed
+    static RenderOptions Parse(int argc, char** argv);
+    static std::string Usage(const std::string& program);
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Sub-pixel offset of a progressive sample from the pixel center, in pixels within [-0.5, 0.5).
+// Follows the R2 low-discrepancy sequence, so any prefix of the samples covers the pixel evenly.
+// The first sample is the pixel center, a single sample renders exactly like gl_FragCoord.
+// Shared by OpenGLView and CPURenderer so both paths sample the same positions.
+inline glm::vec2 GetSampleJitter(unsigned int sampleIndex)
+{
+    // 1 / g and 1 / g^2 for the plastic number g, the 2D generalization of the golden ratio
+    const double alpha1 = 0.7548776662466927, alpha2 = 0.5698402909980532;
+
+    return glm::vec2(float(glm::fract(0.5 + alpha1 * sampleIndex) - 0.5), float(glm::fract(0.5 + alpha2 * sampleIndex) - 0.5));
+}
@@ -0,0 +1,94 @@
+#include "SceneAnimation.hpp"
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <stdexcept>
+
+glm::mat4 SceneAnimation::Evaluate(TransformType type, const std::vector<Keyframe>& keys, float frame)
+{
+    // Keys are sorted by frame, find the pair around this one. Outside the keys both are the nearest key.
+    auto next = std::upper_bound(keys.begin(), keys.end(), frame, [](float value, const Keyframe& key) { return value < key.frame; });
+    const Keyframe& previous = next == keys.begin() ? keys.front() : *(next - 1);
+    const Keyframe& following = next == keys.end() ? keys.back() : *next;
+    const float t = &previous == &following ? 0.f : (frame - previous.frame) / (following.frame - previous.frame);
+
+    switch (type)
+    {
+    case TransformType::translate:
+        return glm::translate(glm::mat4(1.f), glm::mix(glm::vec3(previous.values), glm::vec3(following.values), t));
+    case TransformType::scale:
+        return glm::scale(glm::mat4(1.f), glm::mix(glm::vec3(previous.values), glm::vec3(following.values), t));
+    default:
+    {
+        // Static and held rotations build the same matrix as before they were keyframed
+        if (&previous == &following)
+            return glm::rotate(glm::mat4(1.f), glm::radians(previous.values.x), glm::normalize(glm::vec3(previous.values.y, previous.values.z, previous.values.w)));
+
+        // Lerping the axis would pass through zero between opposite axes
+        auto toRotation = [](const glm::vec4& values) {
+            return glm::angleAxis(glm::radians(values.x), glm::normalize(glm::vec3(values.y, values.z, values.w)));
+        };
+        return glm::mat4_cast(glm::slerp(toRotation(previous.values), toRotation(following.values), t));
+    }
+    }
+}
+
+void SceneAnimation::SetFrameRange(GLuint firstFrame, GLuint lastFrame)
+{
+    if (lastFrame < firstFrame)
+        throw std::runtime_error("The last frame of an animation cannot come before its first.");
+
+    hasFrameRange = true;
+    this->firstFrame = firstFrame;
+    this->lastFrame = lastFrame;
+}
+
+GLuint SceneAnimation::AddTransform(TransformNode transform)
+{
+    transforms.push_back(std::move(transform));
+    return GLuint(transforms.size() - 1);
+}
+
+void SceneAnimation::AddObject(GLuint objectIndex, GLuint prototype, GLuint node)
+{
+    objectTargets.push_back({ objectIndex, node });
+    auto position = std::lower_bound(animatedPrototypes.begin(), animatedPrototypes.end(), prototype);
+    if (position == animatedPrototypes.end() || *position != prototype)
+        animatedPrototypes.insert(position, prototype);
+}
+
+void SceneAnimation::AddLight(GLuint lightIndex, GLuint node)
+{
+    lightTargets.push_back({ lightIndex, node });
+}
+
+void SceneAnimation::AddInstance(GLuint instanceIndex, GLuint node)
+{
+    instanceTargets.push_back({ instanceIndex, node });
+}
+
+void SceneAnimation::Apply(float frame, std::vector<ObjectData>& objs, std::vector<Light>& lights, std::vector<InstanceData>& instances) const
+{
+    // Parents come first, so one pass evaluates every chain from the top
+    std::vector<glm::mat4> modelview(transforms.size());
+    for (size_t ii = 0; ii < transforms.size(); ++ii)
+    {
+        const TransformNode& transform = transforms[ii];
+        const glm::mat4& parent = transform.parent < 0 ? transform.parentTransform : modelview[transform.parent];
+        modelview[ii] = parent * Evaluate(transform.type, transform.keys, frame);
+    }
+
+    for (const Target& target : objectTargets)
+    {
+        const ObjectData& obj = objs[target.index];
+        objs[target.index] = ObjectData(obj.type, obj.materialIndex, modelview[target.node], obj.meshRoot);
+    }
+    for (const Target& target : lightTargets)
+        lights[target.index].lightPosition = modelview[target.node] * glm::vec4(0.f, 0.f, 0.f, 1.f);
+    for (const Target& target : instanceTargets)
+    {
+        InstanceData& instance = instances[target.index];
+        instance.transform = modelview[target.node];
+        instance.transformInverse = glm::inverse(instance.transform);
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Light.hpp"
+#include "ObjectData.hpp"
+#include "TwoLevelBVH.hpp"
+
+// Keyframed transforms of a scene, see the header's 'animation' block and the 'key' form of the body's transforms
+// in SceneLoader. Only the transforms at or below an animated one are kept, together with the objects, lights and
+// instances they place, so moving to another frame recomputes nothing that stays still.
+class SceneAnimation
+{
+public:
+    enum class TransformType { translate, scale, rotate };
+
+    // A transform's values at a frame, x y z for translate and scale, the angle in degrees and then the axis for rotate
+    struct Keyframe
+    {
+        float frame;
+        glm::vec4 values;
+    };
+
+    // One transform line at or below an animated one, static lines below an animated one have a single key
+    struct TransformNode
+    {
+        // Node this transform is applied inside, -1 for the first animated transform of a chain
+        GLint parent;
+        // The static transforms above the first animated transform of a chain, unused below it
+        glm::mat4 parentTransform;
+        TransformType type;
+        std::vector<Keyframe> keys;
+    };
+
+    // Values between keys are interpolated linearly, before the first key and after the last they are held.
+    // Rotations are interpolated as quaternions, which take the shorter way round, so keys of a rotation must be
+    // less than 180 degrees apart. Rotation axes must not be zero.
+    static glm::mat4 Evaluate(TransformType type, const std::vector<Keyframe>& keys, float frame);
+
+    // Frames rendered by a sequence, inclusive. Scenes without a frame range render a single image.
+    void SetFrameRange(GLuint firstFrame, GLuint lastFrame);
+    bool HasFrameRange() const { return hasFrameRange; }
+    GLuint GetFirstFrame() const { return firstFrame; }
+    GLuint GetLastFrame() const { return lastFrame; }
+    GLuint GetFrameCount() const { return lastFrame - firstFrame + 1; }
+
+    // Whether anything in the scene moves between frames
+    bool IsAnimated() const { return !objectTargets.empty() || !lightTargets.empty() || !instanceTargets.empty(); }
+
+    // Returns the index to parent later transforms and targets to
+    GLuint AddTransform(TransformNode transform);
+    size_t GetTransformCount() const { return transforms.size(); }
+    // Placed by the transform node, prototype is the one holding the object
+    void AddObject(GLuint objectIndex, GLuint prototype, GLuint node);
+    void AddLight(GLuint lightIndex, GLuint node);
+    void AddInstance(GLuint instanceIndex, GLuint node);
+
+    // Moves every animated object, light and instance to where it is at frame
+    void Apply(float frame, std::vector<ObjectData>& objs, std::vector<Light>& lights, std::vector<InstanceData>& instances) const;
+
+    // Prototypes with animated objects, in increasing order. Their BLAS needs a refit after Apply.
+    const std::vector<GLuint>& GetAnimatedPrototypes() const { return animatedPrototypes; }
+    bool HasAnimatedObjects() const { return !objectTargets.empty(); }
+    bool HasAnimatedLights() const { return !lightTargets.empty(); }
+
+private:
+    struct Target
+    {
+        GLuint index, node;
+    };
+
+    bool hasFrameRange = false;
+    GLuint firstFrame = 0, lastFrame = 0;
+    // Parents always come before their children
+    std::vector<TransformNode> transforms;
+    std::vector<Target> objectTargets, lightTargets, instanceTargets;
+    std::vector<GLuint> animatedPrototypes;
+};
@@ -0,0 +1,112 @@
+#include "SceneGenerator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+// xorshift32, the standard library's distributions are not required to agree between implementations
+class SceneRandom
+{
+public:
+    explicit SceneRandom(unsigned int seed) : state(seed ? seed : 1u) {}
+
+    // Uniform in [min, max)
+    float Range(float min, float max)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return min + (max - min) * float(state >> 8) * (1.f / 16777216.f);
+    }
+
+private:
+    uint32_t state;
+};
+
+static std::string FormatFloats(float x, float y, float z)
+{
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.3f %.3f %.3f", x, y, z);
+    return buffer;
+}
+
+static const char* MATTE_MATERIALS[] = { "matteRed", "matteGreen", "matteBlue", "matteWhite" };
+static const char* REFLECTIVE_MATERIALS[] = { "shinyGold", "shinySilver", "mirror" };
+
+void GenerateScene(const std::string& sceneFileLoc, const GeneratedSceneParams& params)
+{
+    std::ofstream out(sceneFileLoc);
+    if (!out.is_open())
+        throw std::runtime_error("Unable to write generated scene '" + sceneFileLoc + "'.");
+
+    out << "# Generated: " << params.sphereCount << " spheres, " << params.boxCount << " boxes, " << params.lightCount
+        << " lights, " << params.reflectiveFraction << " reflective, seed " << params.seed << "\n";
+
+    out << "material matteRed\n  ambient .2 .05 .05\n  diffuse .8 .2 .2\n  specular .3 .3 .3\n  shininess 10\n\n";
+    out << "material matteGreen\n  ambient .05 .2 .05\n  diffuse .2 .8 .2\n  specular .3 .3 .3\n  shininess 10\n\n";
+    out << "material matteBlue\n  ambient .05 .05 .2\n  diffuse .2 .2 .8\n  specular .3 .3 .3\n  shininess 10\n\n";
+    out << "material matteWhite\n  ambient .2 .2 .2\n  diffuse .8 .8 .8\n  specular .3 .3 .3\n  shininess 10\n\n";
+    // Increasingly reflective, each costs more bounces
+    out << "material shinyGold\n  ambient .2 .15 .05\n  diffuse .8 .6 .2\n  specular 1 1 1\n  shininess 50\n  absorption .7\n  reflection .3\n\n";
+    out << "material shinySilver\n  ambient .15 .15 .15\n  diffuse .6 .6 .6\n  specular 1 1 1\n  shininess 80\n  absorption .4\n  reflection .6\n\n";
+    out << "material mirror\n  ambient .05 .05 .05\n  diffuse .2 .2 .2\n  specular 1 1 1\n  shininess 100\n  absorption .1\n  reflection .9\n\n";
+
+    const float lightScale = 1.f / float(std::max(params.lightCount, 1u));
+    out << "light generatedLight\n"
+        << "  ambient " << FormatFloats(.2f * lightScale, .2f * lightScale, .2f * lightScale) << "\n"
+        << "  diffuse " << FormatFloats(lightScale, lightScale, lightScale) << "\n"
+        << "  specular " << FormatFloats(lightScale, lightScale, lightScale) << "\n\n";
+
+    out << "===\n";
+
+    SceneRandom random(params.seed);
+
+    // Deeper for larger scenes so the density stays about the same. The default camera sits at z = 10
+    // looking down -z with a 60 degree vertical field of view, objects are kept within it.
+    const unsigned int objectCount = params.sphereCount + params.boxCount;
+    const float nearZ = -5.f, depth = 10.f * std::cbrt(float(std::max(objectCount, 1u)));
+    const float halfHeightPerDistance = 0.5f, halfWidthPerDistance = 0.85f;
+
+    for (unsigned int ii = 0; ii < objectCount; ++ii)
+    {
+        const float z = random.Range(nearZ - depth, nearZ);
+        const float distance = 10.f - z;
+        const float x = random.Range(-halfWidthPerDistance, halfWidthPerDistance) * distance;
+        const float y = random.Range(-halfHeightPerDistance, halfHeightPerDistance) * distance;
+        const float size = random.Range(.5f, 2.f);
+
+        const char* material;
+        if (random.Range(0.f, 1.f) < params.reflectiveFraction)
+            material = REFLECTIVE_MATERIALS[std::min(int(random.Range(0.f, 3.f)), 2)];
+        else
+            material = MATTE_MATERIALS[std::min(int(random.Range(0.f, 4.f)), 3)];
+
+        out << "translate " << FormatFloats(x, y, z) << "\n";
+        if (ii < params.sphereCount)
+        {
+            out << "  scale " << FormatFloats(size, size, size) << "\n";
+            out << "    primative sphere " << material << "\n";
+        }
+        else
+        {
+            const float angle = random.Range(0.f, 180.f);
+            out << "  rotate " << FormatFloats(angle, random.Range(-1.f, 1.f), random.Range(-1.f, 1.f)) << " 1\n";
+            out << "    scale " << FormatFloats(size, random.Range(.5f, 2.f), random.Range(.5f, 2.f)) << "\n";
+            out << "      primative box " << material << "\n";
+        }
+    }
+
+    // Spread over the width of the scene, above and in front of it
+    for (unsigned int ii = 0; ii < params.lightCount; ++ii)
+    {
+        const float z = random.Range(nearZ - depth, 5.f);
+        const float x = random.Range(-halfWidthPerDistance, halfWidthPerDistance) * (10.f - z);
+        out << "translate " << FormatFloats(x, random.Range(20.f, 40.f), z) << "\n";
+        out << "  light generatedLight\n";
+    }
+
+    if (!out)
+        throw std::runtime_error("Unable to write generated scene '" + sceneFileLoc + "'.");
+}
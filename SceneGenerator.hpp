@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+// Size and makeup of a procedurally generated scene, see GenerateScene
+struct GeneratedSceneParams
+{
+    unsigned int sphereCount = 0, boxCount = 0;
+    unsigned int lightCount = 1;
+    // Share of the objects given one of the reflective materials, between 0 and 1
+    float reflectiveFraction = 0.f;
+    unsigned int seed = 1;
+};
+
+// Writes a scene in the text scene format with the objects scattered through the default camera's view and the
+// lights above them. Light intensities are divided by the light count so scenes of any size are lit alike.
+// The same parameters always produce the same file, on every platform.
+// Throws std::runtime_error if the file cannot be written.
+void GenerateScene(const std::string& sceneFileLoc, const GeneratedSceneParams& params);
@@ -1,75 +1,125 @@
 #include "SceneLoader.hpp"
-#include <stack>
-#include <fstream>
-#include <sstream>
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 using namespace std;
 
+const string_view SceneLoader::SectionDelimiter = "===";
+
 void SceneLoader::Init(const std::string& sceneFileLoc) {
     // Clean out any data from previous loads
     lines.clear();
+    materials.clear();
+    materialIndices.clear();
+    lightProperties.clear();
+    lightIndices.clear();
+    camera = Camera();
+    animation = SceneAnimation();
+    groupIndices.clear();
+    meshRoots.clear();
+    sceneDirectory = filesystem::path(sceneFileLoc).parent_path().string();
+
+    try {
+        file = MappedFile::OpenRead(sceneFileLoc);
+    }
+    catch (const exception&) {
+        throw runtime_error(string_format("Scene file '%s' could not be found.", sceneFileLoc.c_str()));
+    }
 
-    std::map<std::string, Material> materials;
-    std::map<std::string, LightProperties> lightProperties;
+    string_view contents(file.GetData(), file.GetSize());
+    size_t lineNum = 0;
+    bodyStart = SIZE_MAX;
 
-    // Load scene file into memory
-    ifstream infile(sceneFileLoc);
+    while (!contents.empty()) {
+        ++lineNum;
+        size_t lineEnd = contents.find('\n');
+        string_view line = contents.substr(0, lineEnd);
+        contents.remove_prefix(lineEnd == string_view::npos ? contents.size() : lineEnd + 1);
 
-    if (!infile.is_open()) {
-        throw runtime_error(string_format("Scene file '%s' could not be found.", sceneFileLoc.c_str()));
-    }
+        size_t firstChar = line.find_first_not_of(' ');
+        // Line is empty or all whitespace
+        if (firstChar == string_view::npos) continue;
+        line.remove_prefix(firstChar);
+        while (!line.empty() && LineTokenizer::IsSpace(line.back())) line.remove_suffix(1);
+        if (line.empty()) continue;
+
+        // Line is a comment
+        if (line[0] == '#') continue;
+
+        if (bodyStart == SIZE_MAX && firstChar == 0 && line == SectionDelimiter) {
+            bodyStart = lines.size();
+            continue;
+        }
 
-    string line;
-    while (getline(infile, line)) {
-        lines.push_back(line);
+        lines.push_back({ line, firstChar, lineNum });
     }
 
-    infile.close();
+    // Without a delimiter the whole file is header
+    if (bodyStart == SIZE_MAX) bodyStart = lines.size();
 }
 
-void SceneLoader::Load(const std::string& i_sceneFileLoc, std::vector<ObjectData>& o_objects, std::vector<Light>& o_lights)
+void SceneLoader::Load(const std::string& i_sceneFileLoc, std::vector<Material>& o_materials, std::vector<ObjectData>& o_objects, std::vector<Light>& o_lights,
+    MeshLibrary& o_meshes, std::vector<Prototype>& o_prototypes, std::vector<InstanceData>& o_instances, Camera& o_camera, SceneAnimation& o_animation)
 {
     Init(i_sceneFileLoc);
 
-    size_t lineNum = 0;
-    stringstream stream;
-
     ParseHeader();
-    ParseBody(o_objects, o_lights);
+    ParseBody(o_objects, o_lights, o_meshes, o_prototypes, o_instances);
+    o_materials = materials;
+    o_camera = camera;
+    o_animation = std::move(animation);
+
+    // The scene's lines point into the file, release them together
+    lines.clear();
+    materialIndices.clear();
+    lightIndices.clear();
+    groupIndices.clear();
+    meshRoots.clear();
+    file.Close();
+}
+
+void SceneLoader::CheckIndent(const SceneLine& line, size_t lastIndent) {
+    if (line.indent % 2 != 0) {
+        throw runtime_error(string_format("Error parsing scene file at line %d:\n\tline does not have proper indentation, must be multiples of two", int(line.lineNum)));
+    }
+    if (line.indent > lastIndent) {
+        throw runtime_error(string_format("Error parsing scene file at line %d:\n\tline is indented too far", int(line.lineNum)));
+    }
 }
 
 enum class HeaderParseItem {
     none,
     material,
     light,
-    //camera
+    camera,
+    animation
 };
 
 void SceneLoader::ParseHeader() {
-    string line;
-    size_t currentIndent;
-    stringstream stream;
-    string command;
+    size_t lastIndent = 0;
+    string_view command;
     glm::vec4 floats{ 0.f, 0.f, 0.f, 0.f };
 
     HeaderParseItem parseState = HeaderParseItem::none;
-    string propName;
-
-    while (GetNextLine(line, currentIndent)) {
-        if (line == "===") break;
+    string_view propName;
+    size_t propIndex = 0;
 
-        stream = stringstream(line);
+    for (size_t lineIndex = 0; lineIndex < bodyStart; ++lineIndex) {
+        const SceneLine& line = lines[lineIndex];
+        const int lineNum = int(line.lineNum);
+        CheckIndent(line, lastIndent);
 
-        while (lastIndent > currentIndent) {
+        while (lastIndent > line.indent) {
             lastIndent -= 2;
             parseState = HeaderParseItem::none;
         }
 
-        stream = stringstream(line);
-
-        stream >> command;
+        LineTokenizer stream(line.text);
+        stream.Next(command);
 
         switch (parseState) {
         case HeaderParseItem::none:
@@ -79,10 +129,13 @@ void SceneLoader::ParseHeader() {
                 // Indent future lines to supply material properties
                 lastIndent += 2;
 
-                if (!(stream >> propName)) {
+                if (!stream.Next(propName)) {
                     throw runtime_error(string_format("Error parsing scene file at line %d:\n\tmaterial expects 1 argument, found 0\n\tmaterial <material name>", lineNum));
                 }
-                materials.emplace(propName, Material());
+                // Declaring a name again continues the existing material
+                auto inserted = materialIndices.emplace(propName, materials.size());
+                if (inserted.second) materials.emplace_back();
+                propIndex = inserted.first->second;
             }
             else if (command == "light") {
                 parseState = HeaderParseItem::light;
@@ -90,242 +143,556 @@ void SceneLoader::ParseHeader() {
                 // Indent future lines to supply light properties
                 lastIndent += 2;
 
-                if (!(stream >> propName)) {
+                if (!stream.Next(propName)) {
                     throw runtime_error(string_format("Error parsing scene file at line %d:\n\tlight expects 1 argument, found 0\n\tlight <light name>", lineNum));
                 }
-                lightProperties.emplace(propName, LightProperties());
+                auto inserted = lightIndices.emplace(propName, lightProperties.size());
+                if (inserted.second) lightProperties.emplace_back();
+                propIndex = inserted.first->second;
+            }
+            else if (command == "camera") {
+                parseState = HeaderParseItem::camera;
+
+                // Indent future lines to supply camera properties, there is only one camera
+                lastIndent += 2;
+            }
+            else if (command == "animation") {
+                parseState = HeaderParseItem::animation;
+
+                // Indent future lines to supply animation properties
+                lastIndent += 2;
             }
             else {
-                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' in header\n\tif you are trying to specify properties, ensure the correct level of indentation", lineNum, command.c_str()));
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' in header\n\tif you are trying to specify properties, ensure the correct level of indentation", lineNum, string(command).c_str()));
             }
             break;
 
         case HeaderParseItem::material:
             if (command == "ambient") {
                 for (int ii = 0; ii < 3; ++ii) {
-                    if (!(stream >> floats[ii])) {
+                    if (!stream.NextFloat(floats[ii])) {
                         throw runtime_error(string_format("Error parsing scene file at line %d:\n\tambient expects 3 arguments, found %d\n\tambient <r> <g> <b>", lineNum, ii + 1));
                     }
                 }
 
-                materials[propName].ambient = glm::vec3(floats);
+                materials[propIndex].ambient = glm::vec3(floats);
             }
             else if (command == "diffuse") {
                 for (int ii = 0; ii < 3; ++ii) {
-                    if (!(stream >> floats[ii])) {
+                    if (!stream.NextFloat(floats[ii])) {
                         throw runtime_error(string_format("Error parsing scene file at line %d:\n\tdiffuse expects 3 arguments, found %d\n\tdiffuse <r> <g> <b>", lineNum, ii + 1));
                     }
                 }
 
-                materials[propName].diffuse = glm::vec3(floats);
+                materials[propIndex].diffuse = glm::vec3(floats);
             }
             else if (command == "specular") {
                 for (int ii = 0; ii < 3; ++ii) {
-                    if (!(stream >> floats[ii])) {
+                    if (!stream.NextFloat(floats[ii])) {
                         throw runtime_error(string_format("Error parsing scene file at line %d:\n\tspecular expects 3 arguments, found %d\n\tspecular <r> <g> <b>", lineNum, ii + 1));
                     }
                 }
 
-                materials[propName].specular = glm::vec3(floats);
+                materials[propIndex].specular = glm::vec3(floats);
             }
             else if (command == "absorption") {
-                if (!(stream >> floats[0])) {
+                if (!stream.NextFloat(floats[0])) {
                     throw runtime_error(string_format("Error parsing scene file at line %d:\n\tabsorption expects 1 argument, found 0\n\tabsorption <absorption ratio>", lineNum));
                 }
 
-                materials[propName].absorption = floats[0];
+                materials[propIndex].absorption = floats[0];
             }
             else if (command == "reflection") {
-                if (!(stream >> floats[0])) {
+                if (!stream.NextFloat(floats[0])) {
                     throw runtime_error(string_format("Error parsing scene file at line %d:\n\treflection expects 1 argument, found 0\n\treflection <reflection ratio>", lineNum));
                 }
 
-                materials[propName].reflection = floats[0];
+                materials[propIndex].reflection = floats[0];
             }
             else if (command == "transparency") {
-                if (!(stream >> floats[0])) {
+                if (!stream.NextFloat(floats[0])) {
                     throw runtime_error(string_format("Error parsing scene file at line %d:\n\ttransparency expects 1 argument, found 0\n\ttransparency <transparency ratio>", lineNum));
                 }
 
-                materials[propName].transparency = floats[0];
+                materials[propIndex].transparency = floats[0];
             }
             else if (command == "shininess") {
-                if (!(stream >> floats[0])) {
+                if (!stream.NextFloat(floats[0])) {
                     throw runtime_error(string_format("Error parsing scene file at line %d:\n\tshininess expects 1 argument, found 0\n\tshininess <shininess value>", lineNum));
                 }
 
-                materials[propName].shininess = floats[0];
+                materials[propIndex].shininess = floats[0];
             }
             else {
-                if (command == "material" || command == "light") {
-                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\ttried to declare a %s in a nested scope, unindent to declare a new %s", lineNum, command.c_str(), command.c_str()));
+                if (command == "material" || command == "light" || command == "camera" || command == "animation") {
+                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\ttried to declare a %s in a nested scope, unindent to declare a new %s", lineNum, string(command).c_str(), string(command).c_str()));
                 }
 
-                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' while parsing material", lineNum, command.c_str()));
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' while parsing material", lineNum, string(command).c_str()));
             }
             break;
 
         case HeaderParseItem::light:
             if (command == "ambient") {
                 for (int ii = 0; ii < 3; ++ii) {
-                    if (!(stream >> floats[ii])) {
+                    if (!stream.NextFloat(floats[ii])) {
                         throw runtime_error(string_format("Error parsing scene file at line %d:\n\tambient expects 3 arguments, found %d\n\tambient <r> <g> <b>", lineNum, ii + 1));
                     }
                 }
 
-                lightProperties[propName].ambient = glm::vec3(floats);
+                lightProperties[propIndex].ambient = glm::vec3(floats);
             }
             else if (command == "diffuse") {
                 for (int ii = 0; ii < 3; ++ii) {
-                    if (!(stream >> floats[ii])) {
+                    if (!stream.NextFloat(floats[ii])) {
                         throw runtime_error(string_format("Error parsing scene file at line %d:\n\tdiffuse expects 3 arguments, found %d\n\tdiffuse <r> <g> <b>", lineNum, ii + 1));
                     }
                 }
 
-                lightProperties[propName].diffuse = glm::vec3(floats);
+                lightProperties[propIndex].diffuse = glm::vec3(floats);
             }
             else if (command == "specular") {
                 for (int ii = 0; ii < 3; ++ii) {
-                    if (!(stream >> floats[ii])) {
+                    if (!stream.NextFloat(floats[ii])) {
                         throw runtime_error(string_format("Error parsing scene file at line %d:\n\tspecular expects 3 arguments, found %d\n\tspecular <r> <g> <b>", lineNum, ii + 1));
                     }
                 }
 
-                lightProperties[propName].specular = glm::vec3(floats);
+                lightProperties[propIndex].specular = glm::vec3(floats);
             }
             else {
-                if (command == "material" || command == "light") {
-                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\ttried to declare a %s in a nested scope, unindent to declare a new %s", lineNum, command.c_str(), command.c_str()));
+                if (command == "material" || command == "light" || command == "camera" || command == "animation") {
+                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\ttried to declare a %s in a nested scope, unindent to declare a new %s", lineNum, string(command).c_str(), string(command).c_str()));
                 }
 
-                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' while parsing light", lineNum, command.c_str()));
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' while parsing light", lineNum, string(command).c_str()));
+            }
+            break;
+
+        case HeaderParseItem::camera:
+            if (command == "position" || command == "target" || command == "up") {
+                for (int ii = 0; ii < 3; ++ii) {
+                    if (!stream.NextFloat(floats[ii])) {
+                        throw runtime_error(string_format("Error parsing scene file at line %d:\n\t%s expects 3 arguments, found %d\n\t%s <x> <y> <z>", lineNum, string(command).c_str(), ii + 1, string(command).c_str()));
+                    }
+                }
+
+                if (command == "position") camera.position = glm::vec3(floats);
+                else if (command == "target") camera.target = glm::vec3(floats);
+                else camera.up = glm::vec3(floats);
+            }
+            else if (command == "fov") {
+                if (!stream.NextFloat(floats[0])) {
+                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\tfov expects 1 argument, found 0\n\tfov <vertical field of view in degrees>", lineNum));
+                }
+                if (!(floats[0] > 0.f && floats[0] < 180.f)) {
+                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\tfov must be between 0 and 180 degrees", lineNum));
+                }
+
+                camera.fovDegrees = floats[0];
+            }
+            else {
+                if (command == "material" || command == "light" || command == "camera" || command == "animation") {
+                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\ttried to declare a %s in a nested scope, unindent to declare a new %s", lineNum, string(command).c_str(), string(command).c_str()));
+                }
+
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' while parsing camera", lineNum, string(command).c_str()));
+            }
+            break;
+
+        case HeaderParseItem::animation:
+            if (command == "frames") {
+                for (int ii = 0; ii < 2; ++ii) {
+                    if (!stream.NextFloat(floats[ii])) {
+                        throw runtime_error(string_format("Error parsing scene file at line %d:\n\tframes expects 2 arguments, found %d\n\tframes <first frame> <last frame>", lineNum, ii));
+                    }
+                    if (!(floats[ii] >= 0.f && floats[ii] <= 1e6f && floats[ii] == float(int(floats[ii])))) {
+                        throw runtime_error(string_format("Error parsing scene file at line %d:\n\tframes must be whole numbers between 0 and 1000000", lineNum));
+                    }
+                }
+                if (floats[1] < floats[0]) {
+                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\tthe last frame cannot come before the first", lineNum));
+                }
+
+                animation.SetFrameRange(GLuint(floats[0]), GLuint(floats[1]));
+            }
+            else {
+                if (command == "material" || command == "light" || command == "camera" || command == "animation") {
+                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\ttried to declare a %s in a nested scope, unindent to declare a new %s", lineNum, string(command).c_str(), string(command).c_str()));
+                }
+
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' while parsing animation", lineNum, string(command).c_str()));
             }
             break;
         }
     }
 
+    // lookAt has no orientation to give a camera looking at itself or along its up vector
+    const glm::vec3 viewDirection = camera.target - camera.position;
+    if (glm::dot(viewDirection, viewDirection) == 0.f) {
+        throw runtime_error("Error parsing scene file:\n\tcamera target must differ from its position");
+    }
+    const glm::vec3 side = glm::cross(viewDirection, camera.up);
+    if (glm::dot(side, side) == 0.f) {
+        throw runtime_error("Error parsing scene file:\n\tcamera up must not be parallel to the direction it looks in");
+    }
+
     // TODO: add validation step for defined materials
 }
 
-void SceneLoader::ParseBody(std::vector<ObjectData>& o_objects, std::vector<Light>& o_lights) {
-    stack<glm::mat4> modelview;
-    modelview.push(glm::mat4(1.f));
+void SceneLoader::ParseBody(std::vector<ObjectData>& o_objects, std::vector<Light>& o_lights, MeshLibrary& o_meshes, std::vector<Prototype>& o_prototypes, std::vector<InstanceData>& o_instances) {
+    const size_t bodyEnd = lines.size();
+
+    // Number the groups and load the meshes up front, prototype 0 is the body itself
+    string_view command, groupName, primativeType, materialName, meshFile;
+    for (size_t lineIndex = bodyStart; lineIndex < bodyEnd; ++lineIndex) {
+        const SceneLine& line = lines[lineIndex];
+        LineTokenizer stream(line.text);
+        if (!stream.Next(command)) continue;
+
+        // Argument errors are left to the body parse
+        if (command == "primative" && stream.Next(primativeType) && primativeType == "mesh"
+            && stream.Next(materialName) && stream.Next(meshFile) && meshRoots.count(meshFile) == 0) {
+            try {
+                meshRoots.emplace(meshFile, o_meshes.Add((filesystem::path(sceneDirectory) / meshFile).string()));
+            }
+            catch (const exception& e) {
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\t%s", int(line.lineNum), e.what()));
+            }
+        }
 
-    // TODO: replace with camera setup
-    modelview.top() *= glm::lookAt(glm::vec3(0, 0, 10), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-    modelview.push(modelview.top());
+        if (line.indent != 0 || command != "define") continue;
 
-    string line;
-    size_t currentIndent;
-    stringstream stream;
-    string command;
-    glm::vec4 floats{ 0.f, 0.f, 0.f, 0.f };
-    string primativeType, propName;
+        if (!stream.Next(groupName)) {
+            throw runtime_error(string_format("Error parsing scene file at line %d:\n\tdefine expects 1 argument, found 0\n\tdefine <group name>", int(line.lineNum)));
+        }
+        if (!groupIndices.emplace(groupName, GLuint(groupIndices.size() + 1)).second) {
+            throw runtime_error(string_format("Error parsing scene file at line %d:\n\tgroup '%s' is already defined", int(line.lineNum), string(groupName).c_str()));
+        }
+    }
 
-    while (GetNextLine(line, currentIndent)) {
-        stream = stringstream(line);
+    vector<BodyChunk> chunks;
+    auto addChunk = [&chunks](size_t firstLine, size_t endLine) {
+        chunks.emplace_back();
+        chunks.back().firstLine = firstLine;
+        chunks.back().endLine = endLine;
+    };
+    if (bodyEnd - bodyStart < ParallelLineThreshold) {
+        addChunk(bodyStart, bodyEnd);
+        ParseBodyChunk(chunks.back());
+    }
+    else {
+        // Top-level blocks only share the header's materials and lights, so they can be parsed independently.
+        // Group them into a few chunks per thread, a block is often a single transform and primitive.
+        ThreadPool pool;
+        const size_t targetChunkLines = max(ParallelLineThreshold / 4, (bodyEnd - bodyStart) / (4 * size_t(pool.GetThreadCount())));
+
+        size_t chunkStart = bodyStart;
+        for (size_t ii = bodyStart + 1; ii < bodyEnd; ++ii) {
+            if (lines[ii].indent == 0 && ii - chunkStart >= targetChunkLines) {
+                addChunk(chunkStart, ii);
+                chunkStart = ii;
+            }
+        }
+        addChunk(chunkStart, bodyEnd);
 
-        while (lastIndent > currentIndent) {
-            lastIndent -= 2;
-            modelview.pop();
+        for (BodyChunk& chunk : chunks) {
+            pool.Submit([this, &chunk]() {
+                try {
+                    ParseBodyChunk(chunk);
+                }
+                catch (...) {
+                    chunk.error = current_exception();
+                }
+                });
+        }
+        pool.Wait();
+    }
+
+    // Report the error a sequential parse would have stopped at
+    for (BodyChunk& chunk : chunks) {
+        if (chunk.error) rethrow_exception(chunk.error);
+    }
+
+    // Gather the animated transforms, each chunk's parent links are offset by the transforms before it
+    vector<GLuint> transformOffsets;
+    transformOffsets.reserve(chunks.size());
+    for (BodyChunk& chunk : chunks) {
+        transformOffsets.push_back(GLuint(animation.GetTransformCount()));
+        for (auto& transform : chunk.transforms) {
+            if (transform.parent >= 0) transform.parent += GLint(transformOffsets.back());
+            animation.AddTransform(std::move(transform));
+        }
+    }
+
+    // Gather each prototype's objects, keeping the file's order since the BVH build and light indices depend on it
+    vector<Definition*> prototypeObjects(groupIndices.size() + 1, nullptr);
+    vector<GLuint> prototypeTransformOffsets(groupIndices.size() + 1, 0);
+    for (size_t ii = 0; ii < chunks.size(); ++ii) {
+        for (Definition& definition : chunks[ii].definitions) {
+            prototypeObjects[definition.prototype] = &definition;
+            prototypeTransformOffsets[definition.prototype] = transformOffsets[ii];
+        }
+    }
+
+    size_t objectCount = o_objects.size(), lightCount = o_lights.size(), instanceCount = o_instances.size() + 1;
+    for (BodyChunk& chunk : chunks) {
+        objectCount += chunk.objects.size();
+        lightCount += chunk.lights.size();
+        instanceCount += chunk.instances.size();
+    }
+    for (auto* definition : prototypeObjects) {
+        if (definition) objectCount += definition->objects.size();
+    }
+    o_objects.reserve(objectCount);
+    o_lights.reserve(lightCount);
+    o_instances.reserve(instanceCount);
+
+    // Animated objects, lights and instances are recorded by where they end up
+    auto addAnimatedObjects = [&](const vector<GLint>& objectNodes, GLuint prototype, GLuint transformOffset) {
+        const GLuint firstObject = GLuint(o_objects.size() - objectNodes.size());
+        for (size_t ii = 0; ii < objectNodes.size(); ++ii) {
+            if (objectNodes[ii] >= 0) animation.AddObject(firstObject + GLuint(ii), prototype, GLuint(objectNodes[ii]) + transformOffset);
+        }
+    };
+
+    const GLuint firstObject = GLuint(o_objects.size());
+    const GLuint bodyPrototype = GLuint(o_prototypes.size());
+    for (size_t ii = 0; ii < chunks.size(); ++ii) {
+        BodyChunk& chunk = chunks[ii];
+        o_objects.insert(o_objects.end(), chunk.objects.begin(), chunk.objects.end());
+        addAnimatedObjects(chunk.objectNodes, bodyPrototype, transformOffsets[ii]);
+
+        o_lights.insert(o_lights.end(), chunk.lights.begin(), chunk.lights.end());
+        const GLuint firstLight = GLuint(o_lights.size() - chunk.lights.size());
+        for (size_t jj = 0; jj < chunk.lightNodes.size(); ++jj) {
+            if (chunk.lightNodes[jj] >= 0) animation.AddLight(firstLight + GLuint(jj), GLuint(chunk.lightNodes[jj]) + transformOffsets[ii]);
+        }
+    }
+    o_prototypes.push_back({ firstObject, GLuint(o_objects.size()) - firstObject });
+
+    for (size_t ii = 1; ii < prototypeObjects.size(); ++ii) {
+        Prototype prototype{ GLuint(o_objects.size()), 0 };
+        if (prototypeObjects[ii]) {
+            const Definition& definition = *prototypeObjects[ii];
+            o_objects.insert(o_objects.end(), definition.objects.begin(), definition.objects.end());
+            prototype.objectCount = GLuint(definition.objects.size());
+            addAnimatedObjects(definition.objectNodes, GLuint(o_prototypes.size()), prototypeTransformOffsets[ii]);
+        }
+        o_prototypes.push_back(prototype);
+    }
+
+    // Primitives outside of any group are already in world space, instances of empty groups would place nothing
+    const GLuint prototypeOffset = GLuint(o_prototypes.size() - prototypeObjects.size());
+    if (o_prototypes[prototypeOffset].objectCount > 0)
+        o_instances.emplace_back(prototypeOffset, glm::mat4(1.f));
+    for (size_t ii = 0; ii < chunks.size(); ++ii) {
+        BodyChunk& chunk = chunks[ii];
+        for (size_t jj = 0; jj < chunk.instances.size(); ++jj) {
+            InstanceData& instance = chunk.instances[jj];
+            instance.prototype += prototypeOffset;
+            if (o_prototypes[instance.prototype].objectCount == 0) continue;
+
+            if (chunk.instanceNodes[jj] >= 0) animation.AddInstance(GLuint(o_instances.size()), GLuint(chunk.instanceNodes[jj]) + transformOffsets[ii]);
+            o_instances.push_back(instance);
+        }
+    }
+}
+
+vector<SceneAnimation::Keyframe> SceneLoader::ParseTransformKeys(LineTokenizer& stream, string_view command, int lineNum) {
+    const bool isRotate = command == "rotate";
+    const int valueCount = isRotate ? 4 : 3;
+    const string name(command);
+    const char* valueUsage = isRotate ? "<angle in degrees> <axis x> <axis y> <axis z>" : "<x> <y> <z>";
+
+    // A zero axis has no rotation, and would turn every matrix it reaches into NaN
+    auto checkAxis = [&](const SceneAnimation::Keyframe& key) {
+        const glm::vec3 axis(key.values.y, key.values.z, key.values.w);
+        if (isRotate && !(glm::dot(axis, axis) > 0.f)) {
+            throw runtime_error(string_format("Error parsing scene file at line %d:\n\trotate needs a nonzero axis\n\trotate %s", lineNum, valueUsage));
+        }
+    };
+
+    vector<SceneAnimation::Keyframe> keys;
+    string_view token;
+    LineTokenizer peek = stream;
+    if (!peek.Next(token) || token != "key") {
+        SceneAnimation::Keyframe key{ 0.f, glm::vec4(0.f) };
+        for (int ii = 0; ii < valueCount; ++ii) {
+            if (!stream.NextFloat(key.values[ii])) {
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\t%s expects %d arguments, found %d\n\t%s %s", lineNum, name.c_str(), valueCount, ii + 1, name.c_str(), valueUsage));
+            }
+        }
+        checkAxis(key);
+        keys.push_back(key);
+        return keys;
+    }
+
+    if (!animation.HasFrameRange()) {
+        throw runtime_error(string_format("Error parsing scene file at line %d:\n\tkeyframed transforms need a frame range, add an 'animation' block with 'frames <first frame> <last frame>' to the header", lineNum));
+    }
+
+    while (stream.Next(token)) {
+        if (token != "key") {
+            throw runtime_error(string_format("Error parsing scene file at line %d:\n\texpected 'key' before each keyframe, found '%s'\n\t%s key <frame> %s [key <frame> %s ...]", lineNum, string(token).c_str(), name.c_str(), valueUsage, valueUsage));
+        }
+
+        SceneAnimation::Keyframe key{ 0.f, glm::vec4(0.f) };
+        bool complete = stream.NextFloat(key.frame);
+        for (int ii = 0; complete && ii < valueCount; ++ii) complete = stream.NextFloat(key.values[ii]);
+        if (!complete) {
+            throw runtime_error(string_format("Error parsing scene file at line %d:\n\teach key expects a frame and %d values\n\t%s key <frame> %s [key <frame> %s ...]", lineNum, valueCount, name.c_str(), valueUsage, valueUsage));
         }
+        if (!keys.empty() && key.frame <= keys.back().frame) {
+            throw runtime_error(string_format("Error parsing scene file at line %d:\n\tkeys must be given in increasing frame order", lineNum));
+        }
+        checkAxis(key);
+        keys.push_back(key);
+    }
+    return keys;
+}
 
-        stream = stringstream(line);
+void SceneLoader::ParseBodyChunk(BodyChunk& chunk) {
+    // One entry per open transform, grows to the deepest nesting and is then reused. The body starts in world
+    // space, the camera is applied to the rays instead so it can move without reloading the scene.
+    vector<glm::mat4> modelview;
+    modelview.push_back(glm::mat4(1.f));
+    // The chunk's transform node of each open transform, -1 until a keyframed one is opened
+    vector<GLint> transformNodes;
+    transformNodes.push_back(-1);
+
+    size_t lastIndent = 0;
+    string_view command;
+    glm::vec4 floats{ 0.f, 0.f, 0.f, 0.f };
+    string_view primativeType, propName;
+    // Primitives go to the body, or to the group being defined
+    vector<ObjectData>* objects = &chunk.objects;
+    vector<GLint>* objectNodes = &chunk.objectNodes;
+    bool inDefinition = false;
+
+    for (size_t lineIndex = chunk.firstLine; lineIndex < chunk.endLine; ++lineIndex) {
+        const SceneLine& line = lines[lineIndex];
+        const int lineNum = int(line.lineNum);
+        CheckIndent(line, lastIndent);
+
+        while (lastIndent > line.indent) {
+            lastIndent -= 2;
+            modelview.pop_back();
+            transformNodes.pop_back();
+        }
+        if (line.indent == 0) {
+            objects = &chunk.objects;
+            objectNodes = &chunk.objectNodes;
+            inDefinition = false;
+        }
 
-        stream >> command;
+        LineTokenizer stream(line.text);
+        stream.Next(command);
 
         // TODO: throw errors for TOO MANY arguments
 
         if (command == "primative") {
-            if (!(stream >> primativeType)) {
+            if (!stream.Next(primativeType)) {
                 throw runtime_error(string_format("Error parsing scene file at line %d:\n\tprimative expects 2 argument, found 0\n\tprimative <primative type> <material name>", lineNum));
             }
-            if (!(stream >> propName)) {
+            if (!stream.Next(propName)) {
                 throw runtime_error(string_format("Error parsing scene file at line %d:\n\tprimative expects 2 argument, found 1\n\tprimative <primative type> <material name>", lineNum));
             }
 
             ObjectData::PrimativeType type;
+            GLuint meshRoot = 0;
             if (primativeType == "sphere") type = ObjectData::PrimativeType::sphere;
             else if (primativeType == "box") type = ObjectData::PrimativeType::box;
+            else if (primativeType == "mesh") {
+                type = ObjectData::PrimativeType::mesh;
+                string_view meshFile;
+                if (!stream.Next(meshFile)) {
+                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\tprimative mesh expects 3 arguments, found 2\n\tprimative mesh <material name> <obj file>", lineNum));
+                }
+                // Loaded before the body was parsed
+                meshRoot = meshRoots.at(meshFile);
+            }
             else {
-                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported primative type '%s'", lineNum, primativeType.c_str()));
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported primative type '%s'", lineNum, string(primativeType).c_str()));
             }
 
-            o_objects.emplace_back(type, materials.at(propName), modelview.top());
+            auto material = materialIndices.find(propName);
+            if (material == materialIndices.end()) {
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tundefined material '%s'", lineNum, string(propName).c_str()));
+            }
+
+            objects->emplace_back(type, GLuint(material->second), modelview.back(), meshRoot);
+            objectNodes->push_back(transformNodes.back());
         }
         else if (command == "light") {
-            if (!(stream >> propName)) {
+            if (!stream.Next(propName)) {
                 throw runtime_error(string_format("Error parsing scene file at line %d:\n\tlight expects 1 argument, found 0\n\tlight <light name>", lineNum));
             }
+            if (inDefinition) {
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tlights cannot be placed inside a group definition", lineNum));
+            }
 
-            o_lights.emplace_back(lightProperties.at(propName), modelview.top());
-        }
-        else if (command == "translate") {
-            for (int ii = 0; ii < 3; ++ii) {
-                if (!(stream >> floats[ii])) {
-                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\ttranslate expects 3 arguments, found %d\n\ttranslate <x> <y> <z>", lineNum, ii + 1));
-                }
+            auto light = lightIndices.find(propName);
+            if (light == lightIndices.end()) {
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tundefined light '%s'", lineNum, string(propName).c_str()));
             }
-            modelview.push(modelview.top());
-            modelview.top() *= glm::translate(glm::mat4(1.f), glm::vec3(floats));
 
-            // Indent future lines to apply this transstring_formation
+            chunk.lights.emplace_back(lightProperties[light->second], modelview.back());
+            chunk.lightNodes.push_back(transformNodes.back());
+        }
+        else if (command == "define") {
+            if (line.indent != 0) {
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tgroups can only be defined at the top level", lineNum));
+            }
+            // The name was checked when the groups were numbered
+            stream.Next(propName);
+            chunk.definitions.emplace_back();
+            chunk.definitions.back().prototype = groupIndices.at(propName);
+            objects = &chunk.definitions.back().objects;
+            objectNodes = &chunk.definitions.back().objectNodes;
+            inDefinition = true;
+
+            // Indent future lines to add primitives to the group, relative to the group's origin
+            modelview.push_back(glm::mat4(1.f));
+            transformNodes.push_back(-1);
             lastIndent += 2;
         }
-        else if (command == "scale") {
-            for (int ii = 0; ii < 3; ++ii) {
-                if (!(stream >> floats[ii])) {
-                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\tscale expects 3 arguments, found %d\n\tscale <x> <y> <z>", lineNum, ii + 1));
-                }
+        else if (command == "instance") {
+            if (!stream.Next(propName)) {
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tinstance expects 1 argument, found 0\n\tinstance <group name>", lineNum));
+            }
+            if (inDefinition) {
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tinstances cannot be placed inside a group definition", lineNum));
             }
-            modelview.push(modelview.top());
-            modelview.top() *= glm::scale(glm::mat4(1.f), glm::vec3(floats));
 
-            // Indent future lines to apply this transstring_formation
-            lastIndent += 2;
+            auto group = groupIndices.find(propName);
+            if (group == groupIndices.end()) {
+                throw runtime_error(string_format("Error parsing scene file at line %d:\n\tundefined group '%s'", lineNum, string(propName).c_str()));
+            }
+
+            chunk.instances.emplace_back(group->second, modelview.back());
+            chunk.instanceNodes.push_back(transformNodes.back());
         }
-        else if (command == "rotate") {
-            for (int ii = 0; ii < 4; ++ii) {
-                if (!(stream >> floats[ii])) {
-                    throw runtime_error(string_format("Error parsing scene file at line %d:\n\trotate expects 4 arguments, found %d\n\trotate <angle in degrees> <axis x> <axis y> <axis z>", lineNum, ii + 1));
-                }
+        else if (command == "translate" || command == "scale" || command == "rotate") {
+            const SceneAnimation::TransformType type = command == "translate" ? SceneAnimation::TransformType::translate
+                : command == "scale" ? SceneAnimation::TransformType::scale : SceneAnimation::TransformType::rotate;
+            vector<SceneAnimation::Keyframe> keys = ParseTransformKeys(stream, command, lineNum);
+            modelview.push_back(modelview.back() * SceneAnimation::Evaluate(type, keys, float(animation.GetFirstFrame())));
+
+            // Keyframed transforms and every transform inside one are evaluated again for each frame
+            GLint node = -1;
+            if (keys.size() > 1 || transformNodes.back() >= 0) {
+                node = GLint(chunk.transforms.size());
+                const glm::mat4 parentTransform = transformNodes.back() < 0 ? modelview[modelview.size() - 2] : glm::mat4(1.f);
+                chunk.transforms.push_back({ transformNodes.back(), parentTransform, type, std::move(keys) });
             }
-            modelview.push(modelview.top());
-            modelview.top() *= glm::rotate(glm::mat4(1.f), glm::radians(floats.x), glm::normalize(glm::vec3(floats.y, floats.z, floats.w)));
+            transformNodes.push_back(node);
 
-            // Indent future lines to apply this transstring_formation
+            // Indent future lines to apply this transformation
             lastIndent += 2;
         }
         else {
-            throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' in body", lineNum, command.c_str()));
+            throw runtime_error(string_format("Error parsing scene file at line %d:\n\tunsupported command '%s' in body", lineNum, string(command).c_str()));
         }
     }
 }
-
-bool SceneLoader::GetNextLine(string& o_line, size_t& o_indent) {
-    for (auto lineIt = lines.begin() + lineNum; lineIt != lines.end(); ++lineIt) {
-        ++lineNum;
-
-        if (lineIt->empty()) continue;
-
-        size_t firstChar = lineIt->find_first_not_of(' ');
-        // Line is all whitespace
-        if (firstChar == string::npos) continue;
-
-        // Line is a comment
-        if (lineIt->at(firstChar) == '#') continue;
-
-        if (firstChar % 2 != 0) {
-            throw runtime_error(string_format("Error parsing scene file at line %d:\n\tline does not have proper indentation, must be multiples of two", lineNum));
-        }
-        if (firstChar > lastIndent) {
-            throw runtime_error(string_format("Error parsing scene file at line %d:\n\tline is indented too far", lineNum));
-        }
-
-        o_line = *lineIt;
-        o_indent = firstChar;
-        return true;
-    }
-
-    return false;
-}
\ No newline at end of file
@@ -1,26 +1,85 @@
 #pragma once
 
+#include <exception>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
+#include "Camera.hpp"
+#include "LineTokenizer.hpp"
 #include "ObjectData.hpp"
 #include "Light.hpp"
-#include <map>
+#include "MappedFile.hpp"
+#include "MeshLibrary.hpp"
+#include "SceneAnimation.hpp"
+#include "TwoLevelBVH.hpp"
 
 class SceneLoader
 {
 public:
-    void Load(const std::string& i_sceneFileLoc, std::vector<ObjectData>& o_objects, std::vector<Light>& o_lights);
+    // Objects refer to the loaded materials by index. Prototype 0 holds the body's own primitives and is placed
+    // by an identity instance, every 'define' adds a prototype that its 'instance' commands place.
+    // Mesh files are loaded once however many objects use them, paths are relative to the scene file.
+    // Objects and lights are placed in world space, the camera is the header's 'camera' block or the default one.
+    // Keyframed transforms are evaluated at the first frame of the header's 'animation' block, o_animation holds
+    // them and what they place so other frames can be evaluated later.
+    void Load(const std::string& i_sceneFileLoc, std::vector<Material>& o_materials, std::vector<ObjectData>& o_objects, std::vector<Light>& o_lights,
+        MeshLibrary& o_meshes, std::vector<Prototype>& o_prototypes, std::vector<InstanceData>& o_instances, Camera& o_camera, SceneAnimation& o_animation);
 
 private:
+    // A line with something to parse, blank lines and comments are dropped when the file is split
+    struct SceneLine
+    {
+        // Points into the mapped file, without the indentation
+        std::string_view text;
+        size_t indent;
+        size_t lineNum;
+    };
+
+    // Objects of a group defined in the body
+    struct Definition
+    {
+        GLuint prototype;
+        std::vector<ObjectData> objects;
+        // See BodyChunk::objectNodes
+        std::vector<GLint> objectNodes;
+    };
+
+    // Consecutive top-level blocks of the body, parsed by one task
+    struct BodyChunk
+    {
+        size_t firstLine, endLine;
+        std::vector<ObjectData> objects;
+        std::vector<Light> lights;
+        std::vector<InstanceData> instances;
+        // Objects of each group defined in the chunk
+        std::vector<Definition> definitions;
+        // Transforms at or below a keyframed one, their parents index this chunk's transforms
+        std::vector<SceneAnimation::TransformNode> transforms;
+        // Innermost transform of the chunk's transforms placing each object, light and instance, -1 for those
+        // placed only by static transforms
+        std::vector<GLint> objectNodes, lightNodes, instanceNodes;
+        // The first error in the chunk, the chunk stops parsing there
+        std::exception_ptr error;
+    };
+
     void Init(const std::string& i_sceneFileLoc);
 
     void ParseHeader();
 
-    void ParseBody(std::vector<ObjectData>& o_objects, std::vector<Light>& o_lights);
+    void ParseBody(std::vector<ObjectData>& o_objects, std::vector<Light>& o_lights, MeshLibrary& o_meshes, std::vector<Prototype>& o_prototypes, std::vector<InstanceData>& o_instances);
+
+    // Parses the chunk's lines, which must start at a top-level block.
+    // Only reads the loader's state, so chunks of the body can be parsed concurrently.
+    void ParseBodyChunk(BodyChunk& io_chunk);
+
+    void CheckIndent(const SceneLine& i_line, size_t i_lastIndent);
 
-    bool GetNextLine(std::string& o_line, size_t& o_indent);
+    // Reads the values of a translate, scale or rotate line, or with 'key' its values at each keyframe.
+    // Static transforms have a single key.
+    std::vector<SceneAnimation::Keyframe> ParseTransformKeys(LineTokenizer& io_stream, std::string_view i_command, int i_lineNum);
 
     // Under CC0 1.0: From https://stackoverflow.com/questions/2342162/stdstring-formatting-like-sprintf
     template<typename ... Args>
@@ -35,20 +94,31 @@ private:
     }
 
 private:
-    static const std::vector<std::string> HeaderCommands;
-    static const std::string SectionDelimiter;
-    static const std::vector<std::string> BodyCommands;
+    static const std::string_view SectionDelimiter;
+    // Bodies with fewer lines are parsed on the calling thread
+    static const size_t ParallelLineThreshold = 16384;
 
-    // File loaded into memory
-    std::vector<std::string> lines;
+    // Scene file mapped into memory, every string_view below points into it
+    MappedFile file;
+    // Directory mesh paths are resolved against
+    std::string sceneDirectory;
+    std::vector<SceneLine> lines;
+    // Index of the first line after the section delimiter
+    size_t bodyStart = 0;
 
-    // Material properties scraped from scene header
-    std::map<std::string, Material> materials;
+    // Material properties scraped from scene header, names are interned to indices into the vector
+    std::vector<Material> materials;
+    std::unordered_map<std::string_view, size_t> materialIndices;
     // Light properties scraped from scene header
-    std::map<std::string, LightProperties> lightProperties;
-
-    // Parsing/formatting data
-    size_t lineNum = 0;
-    size_t lastIndent = 0;
+    std::vector<LightProperties> lightProperties;
+    std::unordered_map<std::string_view, size_t> lightIndices;
+    // Camera scraped from scene header
+    Camera camera;
+    // Frame range scraped from scene header, the body adds its keyframed transforms
+    SceneAnimation animation;
+    // Prototype index of every group the body defines, found before the body is parsed so groups can be
+    // instanced anywhere in the file
+    std::unordered_map<std::string_view, GLuint> groupIndices;
+    // Root node in the MeshLibrary of every mesh file the body uses, loaded with the groups
+    std::unordered_map<std::string_view, GLuint> meshRoots;
 };
-
@@ -0,0 +1,143 @@
+#include "ShaderCache.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// Identifies cache entries written by this version of the cache, bump when the entry layout changes
+static const uint32_t ENTRY_MAGIC = 0x42505452; // "RTPB"
+static const uint32_t ENTRY_VERSION = 1;
+
+struct EntryHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t binaryFormat;
+    uint32_t keyLength;
+    uint32_t binaryLength;
+};
+
+// 64 bit FNV-1a, only used to name entries; the full key is stored and compared on load
+static uint64_t HashString(const std::string& str)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : str)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string GetGLString(GLenum name)
+{
+    const GLubyte* str = glGetString(name);
+    return str ? reinterpret_cast<const char*>(str) : "";
+}
+
+ShaderCache::ShaderCache(const std::string& cacheDir) : cacheDir(cacheDir), enabled(!cacheDir.empty())
+{
+    if (!enabled)
+        return;
+
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount <= 0)
+    {
+        std::cerr << "Shader cache disabled, the driver does not support program binaries." << std::endl;
+        enabled = false;
+        return;
+    }
+
+    std::error_code err;
+    std::filesystem::create_directories(cacheDir, err);
+    if (err)
+    {
+        std::cerr << "Shader cache disabled, unable to create '" << cacheDir << "': " << err.message() << std::endl;
+        enabled = false;
+    }
+}
+
+std::string ShaderCache::GetKey(const std::vector<std::string>& sources, const std::string& defines) const
+{
+    std::string key = GetGLString(GL_VENDOR) + '\n' + GetGLString(GL_RENDERER) + '\n' + GetGLString(GL_VERSION) + '\n';
+    key += "defines " + std::to_string(defines.size()) + '\n' + defines;
+    for (auto& source : sources)
+        key += "source " + std::to_string(source.size()) + '\n' + source;
+    return key;
+}
+
+std::string ShaderCache::GetEntryPath(const std::string& key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(HashString(key)));
+    return (std::filesystem::path(cacheDir) / name).string();
+}
+
+bool ShaderCache::Load(const std::string& key, GLuint program) const
+{
+    if (!enabled)
+        return false;
+
+    std::ifstream infile(GetEntryPath(key), std::ios::binary);
+    if (!infile.is_open())
+        return false;
+
+    EntryHeader header;
+    if (!infile.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || header.magic != ENTRY_MAGIC || header.version != ENTRY_VERSION || header.keyLength != key.size())
+        return false;
+
+    std::string storedKey(header.keyLength, '\0');
+    std::vector<char> binary(header.binaryLength);
+    if (!infile.read(&storedKey[0], storedKey.size()) || storedKey != key
+        || !infile.read(binary.data(), binary.size()))
+        return false;
+
+    glProgramBinary(program, header.binaryFormat, binary.data(), GLsizei(binary.size()));
+
+    // Drivers may refuse binaries from other builds even when the version string matches
+    GLint result;
+    glGetProgramiv(program, GL_LINK_STATUS, &result);
+    if (result == GL_FALSE)
+        std::cerr << "Cached shader program was rejected by the driver, recompiling." << std::endl;
+    return result == GL_TRUE;
+}
+
+void ShaderCache::Store(const std::string& key, GLuint program) const
+{
+    if (!enabled)
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+    EntryHeader header{ ENTRY_MAGIC, ENTRY_VERSION, binaryFormat, uint32_t(key.size()), uint32_t(length) };
+
+    // Write to a temporary file first so a concurrent or interrupted run never sees a partial entry
+    const std::string entryPath = GetEntryPath(key);
+    const std::string tempPath = entryPath + ".tmp";
+    {
+        std::ofstream outfile(tempPath, std::ios::binary | std::ios::trunc);
+        outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        outfile.write(key.data(), key.size());
+        outfile.write(binary.data(), length);
+        if (!outfile)
+        {
+            std::cerr << "Unable to write shader cache entry '" << tempPath << "'" << std::endl;
+            return;
+        }
+    }
+
+    std::error_code err;
+    std::filesystem::rename(tempPath, entryPath, err);
+    if (err)
+        std::cerr << "Unable to write shader cache entry '" << entryPath << "': " << err.message() << std::endl;
+}
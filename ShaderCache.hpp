@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+// Persists linked program binaries on disk so later launches can skip compiling the shaders.
+// Entries are keyed by the shader sources, any injected defines and the driver that produced them,
+// a driver update or shader edit simply misses and recompiles.
+class ShaderCache
+{
+public:
+    // An empty directory disables the cache
+    explicit ShaderCache(const std::string& cacheDir);
+
+    // Returns the key for a program built from these sources on the current context's driver
+    std::string GetKey(const std::vector<std::string>& sources, const std::string& defines) const;
+
+    // Loads a cached binary into program. Returns false on a miss, or if the driver rejects the binary.
+    bool Load(const std::string& key, GLuint program) const;
+
+    // Saves the binary of a linked program, must be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    void Store(const std::string& key, GLuint program) const;
+
+    bool IsEnabled() const { return enabled; }
+
+private:
+    std::string GetEntryPath(const std::string& key) const;
+
+    std::string cacheDir;
+    bool enabled;
+};
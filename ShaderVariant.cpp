@@ -0,0 +1,69 @@
+#include "ShaderVariant.hpp"
+
+ShaderVariant ShaderVariant::FromModel(const OpenGLModel& model, GLuint lightSamples)
+{
+    ShaderVariant variant;
+    variant.hasSpheres = false;
+    variant.hasBoxes = false;
+    variant.hasMeshes = false;
+    variant.hasReflections = false;
+
+    for (auto& obj : model.objs)
+    {
+        switch (obj.type)
+        {
+        case ObjectData::PrimativeType::sphere: variant.hasSpheres = true; break;
+        case ObjectData::PrimativeType::box: variant.hasBoxes = true; break;
+        case ObjectData::PrimativeType::mesh: variant.hasMeshes = true; break;
+        }
+
+        // Matches the threshold the shader uses before tracing a reflection ray
+        if (model.materials[obj.materialIndex].absorption <= 0.999f)
+            variant.hasReflections = true;
+    }
+
+    variant.maxBounces = model.MAX_BOUNCES;
+    variant.lightCount = GLuint(model.lights.size());
+    if (model.lightTree.ShouldSample(lightSamples))
+        variant.lightSamples = lightSamples;
+    return variant;
+}
+
+std::string ShaderVariant::GetDefines() const
+{
+    return "#define HAS_SPHERES " + std::to_string(hasSpheres) + "\n"
+        "#define HAS_BOXES " + std::to_string(hasBoxes) + "\n"
+        "#define HAS_MESHES " + std::to_string(hasMeshes) + "\n"
+        "#define HAS_REFLECTIONS " + std::to_string(hasReflections) + "\n"
+        "#define FIXED_MAX_BOUNCES " + std::to_string(maxBounces) + "u\n"
+        "#define FIXED_LIGHT_COUNT " + std::to_string(lightCount) + "u\n"
+        "#define LIGHT_SAMPLES " + std::to_string(lightSamples) + "\n"
+        "#define COUNT_RAYS " + std::to_string(countRays) + "\n"
+        "#define COST_OUTPUT " + std::to_string(costOutput) + "\n"
+        "#define WAVEFRONT_STAGE " + std::to_string(wavefrontStage) + "\n";
+}
+
+std::string ShaderVariant::GetDescription() const
+{
+    std::string description;
+    if (hasSpheres)
+        description += "spheres, ";
+    if (hasBoxes)
+        description += "boxes, ";
+    if (hasMeshes)
+        description += "meshes, ";
+    description += std::to_string(lightCount) + " lights, ";
+    if (lightSamples > 0)
+        description += std::to_string(lightSamples) + " sampled per hit, ";
+    if (hasReflections)
+        description += std::to_string(maxBounces) + " bounces";
+    else
+        description += "no reflections";
+    if (countRays)
+        description += ", counting rays";
+    if (costOutput)
+        description += ", cost output";
+    if (wavefrontStage)
+        description += ", wavefront stage " + std::to_string(wavefrontStage);
+    return description;
+}
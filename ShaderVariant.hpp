@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include "OpenGLModel.h"
+
+// Scene features baked into shade_and_reflect.glsl as #defines, so the compiler can unroll the
+// light and bounce loops and drop code for primitives and reflections the scene never uses.
+struct ShaderVariant
+{
+    bool hasSpheres = true, hasBoxes = true, hasMeshes = true;
+    // Whether any material is partially reflective, i.e. absorbs less than all of the light
+    bool hasReflections = true;
+    GLuint maxBounces = 0;
+    GLuint lightCount = 0;
+    // Point lights sampled from the light tree at each hit, 0 shades every light
+    GLuint lightSamples = 0;
+    // Counts rays and intersection tests into the buffer GpuProfiler reads, only while profiling
+    bool countRays = false;
+    // Outputs each pixel's intersection tests, bounces and shadow rays instead of its colour, see CostHeatmap
+    bool costOutput = false;
+    // Compiles a compute stage of wavefront.glsl instead of the fragment shader, see WavefrontStage. 0 for fragments.
+    GLuint wavefrontStage = 0;
+
+    // lightSamples is the requested count, the variant only samples if LightTree::ShouldSample agrees
+    static ShaderVariant FromModel(const OpenGLModel& model, GLuint lightSamples);
+
+    // Lines to insert after the '#version' directive, also used as the variant's cache key
+    std::string GetDefines() const;
+    // Short human readable summary for logging
+    std::string GetDescription() const;
+};
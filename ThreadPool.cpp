@@ -0,0 +1,115 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount, Order order) :
+    order(order)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int ii = 0; ii < threadCount; ++ii)
+        queues.emplace_back(new WorkQueue());
+
+    for (unsigned int ii = 0; ii < threadCount; ++ii)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this, size_t(ii));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+    ++pendingTasks;
+
+    WorkQueue& queue = *queues[nextQueue++ % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        ++queuedTasks;
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // Taking the lock orders this wake-up after any worker's predicate check
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wakeCondition.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    idleCondition.wait(lock, [this]() { return pendingTasks == 0; });
+}
+
+void ThreadPool::WorkerLoop(size_t workerIndex)
+{
+    std::function<void()> task;
+
+    while (true)
+    {
+        if (PopLocal(workerIndex, task) || Steal(workerIndex, task))
+        {
+            --queuedTasks;
+            task();
+            task = nullptr;
+
+            if (--pendingTasks == 0)
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                idleCondition.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeCondition.wait(lock, [this]() { return stopping || queuedTasks > 0; });
+        if (stopping && queuedTasks == 0)
+            return;
+    }
+}
+
+bool ThreadPool::PopLocal(size_t workerIndex, std::function<void()>& o_task)
+{
+    WorkQueue& queue = *queues[workerIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+        return false;
+
+    if (order == Order::oldestFirst)
+    {
+        o_task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+    }
+    else
+    {
+        o_task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+    }
+    return true;
+}
+
+bool ThreadPool::Steal(size_t thiefIndex, std::function<void()>& o_task)
+{
+    for (size_t offset = 1; offset < queues.size(); ++offset)
+    {
+        WorkQueue& queue = *queues[(thiefIndex + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+
+        o_task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of workers that each own a task deque. Workers pop their own
+// newest task first and steal the oldest task from a sibling when they run dry,
+// so uneven tasks (e.g. tiles full of reflective objects) balance themselves.
+class ThreadPool
+{
+public:
+    // Which of its own tasks a worker pops first. A single worker popping oldest first runs tasks in the
+    // order they were submitted, e.g. writes that must land in frame order.
+    enum class Order
+    {
+        newestFirst,
+        oldestFirst
+    };
+
+    // A thread count of 0 uses every hardware thread.
+    explicit ThreadPool(unsigned int threadCount = 0, Order order = Order::newestFirst);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished running.
+    void Wait();
+
+    unsigned int GetThreadCount() const { return static_cast<unsigned int>(workers.size()); }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void WorkerLoop(size_t workerIndex);
+    bool PopLocal(size_t workerIndex, std::function<void()>& o_task);
+    bool Steal(size_t thiefIndex, std::function<void()>& o_task);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable idleCondition;
+
+    const Order order;
+    std::atomic<size_t> nextQueue{ 0 };
+    // Tasks sitting in a queue, not yet picked up by a worker
+    std::atomic<size_t> queuedTasks{ 0 };
+    // Tasks submitted but not yet finished (queued or running)
+    std::atomic<size_t> pendingTasks{ 0 };
+    bool stopping = false;
+};
@@ -0,0 +1,185 @@
+#include "TwoLevelBVH.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// World space bounds of an object, mesh objects are bounded by their mesh
+static AABB GetObjectBounds(const ObjectData& obj, const MeshLibrary& meshes)
+{
+    if (obj.type == ObjectData::PrimativeType::mesh)
+        return meshes.GetBounds(obj.meshRoot).Transformed(obj.mv);
+    return AABB::FromObject(obj);
+}
+
+// Recomputes the bounds of count nodes starting at first from their primitives' bounds. Children always follow
+// their parent, so walking the nodes backwards visits both children before the parent.
+template<typename PrimitiveBounds>
+static void RefitNodes(std::vector<BVHNode>& nodes, GLuint first, GLuint count, const std::vector<GLuint>& primIndices, PrimitiveBounds getBounds)
+{
+    for (GLuint ii = first + count; ii-- > first; )
+    {
+        BVHNode& node = nodes[ii];
+        AABB bounds;
+        if (node.primCount > 0)
+        {
+            for (GLuint prim = node.leftOrFirst; prim < node.leftOrFirst + node.primCount; ++prim)
+                bounds.Grow(getBounds(primIndices[prim]));
+        }
+        else
+        {
+            for (GLuint child = node.leftOrFirst; child < node.leftOrFirst + 2; ++child)
+            {
+                bounds.Grow(nodes[child].boundsMin);
+                bounds.Grow(nodes[child].boundsMax);
+            }
+        }
+        node.boundsMin = bounds.min;
+        node.boundsMax = bounds.max;
+    }
+}
+
+bool TwoLevelBVH::CanReuse(const PreviousBVHBuild& previous, size_t index, const std::vector<ObjectData>& objs, const MeshLibrary& meshes, const Prototype& prototype)
+{
+    if (!previous.bvh || !previous.objs || !previous.meshes || index >= previous.bvh->bottomLevels.size())
+        return false;
+
+    const Prototype& oldPrototype = previous.bvh->bottomLevels[index].prototype;
+    if (oldPrototype.objectCount != prototype.objectCount)
+        return false;
+
+    // Padding of ObjectData is zeroed, so equal objects compare equal bytewise
+    const ObjectData* oldObjs = previous.objs->data() + oldPrototype.firstObject;
+    const ObjectData* newObjs = objs.data() + prototype.firstObject;
+    if (prototype.objectCount > 0 && std::memcmp(oldObjs, newObjs, prototype.objectCount * sizeof(ObjectData)) != 0)
+        return false;
+
+    // The same mesh root may now index a different mesh
+    for (GLuint ii = 0; ii < prototype.objectCount; ++ii)
+    {
+        if (newObjs[ii].type != ObjectData::PrimativeType::mesh)
+            continue;
+        const AABB oldBounds = previous.meshes->GetBounds(oldObjs[ii].meshRoot);
+        const AABB newBounds = meshes.GetBounds(newObjs[ii].meshRoot);
+        if (oldBounds.min != newBounds.min || oldBounds.max != newBounds.max)
+            return false;
+    }
+    return true;
+}
+
+TwoLevelBVH::TwoLevelBVH(const std::vector<ObjectData>& objs, const MeshLibrary& meshes, const std::vector<Prototype>& prototypes, std::vector<InstanceData> instances,
+    const PreviousBVHBuild& previous) :
+    instances(std::move(instances))
+{
+    // Each BLAS with links relative to its own first node and primitive indices relative to its prototype
+    std::vector<std::vector<BVHNode>> blasNodes(prototypes.size());
+    std::vector<std::vector<GLuint>> blasPrims(prototypes.size());
+    std::vector<GLuint> blasDepths(prototypes.size());
+    for (size_t ii = 0; ii < prototypes.size(); ++ii)
+    {
+        const Prototype& prototype = prototypes[ii];
+        if (CanReuse(previous, ii, objs, meshes, prototype))
+        {
+            const BottomLevel& old = previous.bvh->bottomLevels[ii];
+            const auto firstNode = previous.bvh->nodes.begin() + old.firstNode;
+            blasNodes[ii].assign(firstNode, firstNode + old.nodeCount);
+            for (BVHNode& node : blasNodes[ii])
+                node.leftOrFirst -= node.primCount > 0 ? old.firstPrimitive : old.firstNode;
+
+            const auto firstPrim = previous.bvh->primIndices.begin() + old.firstPrimitive;
+            blasPrims[ii].assign(firstPrim, firstPrim + old.prototype.objectCount);
+            for (GLuint& objIndex : blasPrims[ii])
+                objIndex -= old.prototype.firstObject;
+            blasDepths[ii] = old.depth;
+        }
+        else
+        {
+            std::vector<AABB> primBounds;
+            primBounds.reserve(prototype.objectCount);
+            for (GLuint jj = prototype.firstObject; jj < prototype.firstObject + prototype.objectCount; ++jj)
+                primBounds.push_back(GetObjectBounds(objs[jj], meshes));
+
+            BVH blas(primBounds);
+            blasNodes[ii] = blas.GetNodes();
+            blasPrims[ii] = blas.GetPrimitiveIndices();
+            blasDepths[ii] = blas.GetDepth();
+            ++rebuiltBottomLevels;
+        }
+        bottomLevelDepth = std::max(bottomLevelDepth, blasDepths[ii]);
+    }
+
+    std::vector<AABB> instanceBounds;
+    instanceBounds.reserve(this->instances.size());
+    for (auto& instance : this->instances)
+    {
+        const BVHNode& root = blasNodes[instance.prototype][0];
+        AABB rootBounds;
+        rootBounds.min = root.boundsMin;
+        rootBounds.max = root.boundsMax;
+        instanceBounds.push_back(rootBounds.Transformed(instance.transform));
+    }
+
+    // Instances move freely between edits and the TLAS is small, it is always built again
+    BVH topLevel(instanceBounds);
+    topLevelDepth = topLevel.GetDepth();
+    nodes = topLevel.GetNodes();
+    primIndices = topLevel.GetPrimitiveIndices();
+
+    // Append each BLAS, rebasing its child links and leaf ranges onto the combined arrays
+    bottomLevels.reserve(prototypes.size());
+    for (size_t ii = 0; ii < prototypes.size(); ++ii)
+    {
+        const GLuint nodeOffset = GLuint(nodes.size());
+        const GLuint primOffset = GLuint(primIndices.size());
+        bottomLevels.push_back({ prototypes[ii], nodeOffset, GLuint(blasNodes[ii].size()), primOffset, blasDepths[ii] });
+
+        for (BVHNode node : blasNodes[ii])
+        {
+            node.leftOrFirst += node.primCount > 0 ? primOffset : nodeOffset;
+            nodes.push_back(node);
+        }
+        for (GLuint objIndex : blasPrims[ii])
+            primIndices.push_back(prototypes[ii].firstObject + objIndex);
+    }
+
+    for (auto& instance : this->instances)
+        instance.blasRoot = bottomLevels[instance.prototype].firstNode;
+}
+
+TwoLevelBVH::TwoLevelBVH(std::vector<InstanceData> instances, std::vector<BVHNode> nodes, std::vector<GLuint> primIndices, GLuint topLevelDepth, GLuint bottomLevelDepth) :
+    instances(std::move(instances)), nodes(std::move(nodes)), primIndices(std::move(primIndices)), topLevelDepth(topLevelDepth), bottomLevelDepth(bottomLevelDepth)
+{
+}
+
+void TwoLevelBVH::Refit(const std::vector<ObjectData>& objs, const MeshLibrary& meshes, const std::vector<InstanceData>& instances, const std::vector<GLuint>& prototypes)
+{
+    if (bottomLevels.empty() && !this->instances.empty())
+        throw std::runtime_error("Only BVHs built from the scene's objects can be refit.");
+
+    // Empty prototypes are never instanced and their BLAS has no bounds to move
+    for (GLuint prototype : prototypes)
+    {
+        const BottomLevel& bottomLevel = bottomLevels[prototype];
+        if (bottomLevel.prototype.objectCount > 0)
+            RefitNodes(nodes, bottomLevel.firstNode, bottomLevel.nodeCount, primIndices,
+                [&](GLuint objIndex) { return GetObjectBounds(objs[objIndex], meshes); });
+    }
+
+    for (size_t ii = 0; ii < this->instances.size(); ++ii)
+    {
+        this->instances[ii].transform = instances[ii].transform;
+        this->instances[ii].transformInverse = instances[ii].transformInverse;
+    }
+
+    // The TLAS comes before every BLAS, its leaves bound the instances' BLAS roots
+    if (!this->instances.empty())
+    {
+        RefitNodes(nodes, 0, bottomLevels.front().firstNode, primIndices, [&](GLuint instanceIndex) {
+            const InstanceData& instance = this->instances[instanceIndex];
+            const BVHNode& root = nodes[instance.blasRoot];
+            AABB rootBounds;
+            rootBounds.min = root.boundsMin;
+            rootBounds.max = root.boundsMax;
+            return rootBounds.Transformed(instance.transform);
+            });
+    }
+}
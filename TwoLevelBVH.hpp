@@ -0,0 +1,102 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "BVH.hpp"
+#include "MeshLibrary.hpp"
+#include "ObjectData.hpp"
+
+// A run of objects defined once and placed by instances, see 'define' in SceneLoader.
+// Object transforms are relative to the prototype, not the world.
+struct Prototype
+{
+    GLuint firstObject, objectCount;
+};
+
+// One placement of a prototype, laid out like the std430 'Instance' struct in shade_and_reflect.glsl
+struct InstanceData
+{
+    InstanceData(GLuint prototype, glm::mat4 transform) :
+        transform(transform),
+        transformInverse(glm::inverse(transform)),
+        prototype(prototype)
+    {
+    }
+
+    // Prototype space to world space
+    glm::mat4 transform, transformInverse;
+    // Root of the prototype's bottom level in the combined node array, set by TwoLevelBVH
+    GLuint blasRoot = 0;
+    GLuint prototype;
+    GLuint padding[2] = { 0, 0 };
+};
+static_assert(sizeof(InstanceData) == 144, "InstanceData must match the std430 'Instance' struct");
+
+class TwoLevelBVH;
+
+// A structure built earlier and the objects and meshes it was built over, all null for none
+struct PreviousBVHBuild
+{
+    const TwoLevelBVH* bvh = nullptr;
+    const std::vector<ObjectData>* objs = nullptr;
+    const MeshLibrary* meshes = nullptr;
+};
+
+// Two-level acceleration structure. Each prototype gets a bottom-level BVH (BLAS) over its objects,
+// built once however often it is placed, and a top-level BVH (TLAS) spans the instances' bounds.
+// Both levels share one node array and one index array so they upload as single buffers:
+// the TLAS comes first with its root at node 0 and its leaves indexing instances, then every BLAS
+// with its leaves indexing objects.
+class TwoLevelBVH
+{
+public:
+    TwoLevelBVH() = default;
+    // Instances must not place empty prototypes, their BLAS would have no bounds.
+    // Mesh objects are bounded by their mesh in meshes.
+    // Rebuilding an edited scene over a previous build copies the BLAS of every prototype whose objects and mesh
+    // bounds are unchanged, only the TLAS and the other BLASes are built again.
+    TwoLevelBVH(const std::vector<ObjectData>& objs, const MeshLibrary& meshes, const std::vector<Prototype>& prototypes, std::vector<InstanceData> instances,
+        const PreviousBVHBuild& previous = PreviousBVHBuild());
+    // Adopts a structure built earlier, e.g. one stored in a compiled scene file
+    TwoLevelBVH(std::vector<InstanceData> instances, std::vector<BVHNode> nodes, std::vector<GLuint> primIndices, GLuint topLevelDepth, GLuint bottomLevelDepth);
+
+    const std::vector<InstanceData>& GetInstances() const { return instances; }
+    const std::vector<BVHNode>& GetNodes() const { return nodes; }
+    const std::vector<GLuint>& GetPrimitiveIndices() const { return primIndices; }
+
+    // Deepest root to leaf paths of the TLAS and of any BLAS, traversal stacks must hold this many entries
+    GLuint GetTopLevelDepth() const { return topLevelDepth; }
+    GLuint GetBottomLevelDepth() const { return bottomLevelDepth; }
+
+    // Moves the node bounds to the objects' and instances' current transforms without changing the tree. Much
+    // cheaper than a build, but the tree loosens as things move away from where it was built.
+    // Only the BLAS of the listed prototypes is refit. Instances are in the order of GetInstances(), only their
+    // transforms are read. Structures adopted from a compiled scene cannot be refit.
+    void Refit(const std::vector<ObjectData>& objs, const MeshLibrary& meshes, const std::vector<InstanceData>& instances, const std::vector<GLuint>& prototypes);
+
+    // Prototypes whose BLAS was built rather than copied from a previous build
+    GLuint GetRebuiltBottomLevelCount() const { return rebuiltBottomLevels; }
+    GLuint GetBottomLevelCount() const { return GLuint(bottomLevels.size()); }
+
+private:
+    // Where a prototype's BLAS lies in the combined arrays
+    struct BottomLevel
+    {
+        Prototype prototype;
+        GLuint firstNode, nodeCount;
+        GLuint firstPrimitive;
+        GLuint depth;
+    };
+
+    // Whether the previous build's BLAS for prototype index still bounds its objects
+    static bool CanReuse(const PreviousBVHBuild& previous, size_t index, const std::vector<ObjectData>& objs, const MeshLibrary& meshes, const Prototype& prototype);
+
+    std::vector<InstanceData> instances;
+    std::vector<BVHNode> nodes;
+    std::vector<GLuint> primIndices;
+    GLuint topLevelDepth = 0, bottomLevelDepth = 0;
+    // One per prototype, empty for structures adopted from a compiled scene
+    std::vector<BottomLevel> bottomLevels;
+    GLuint rebuiltBottomLevels = 0;
+};
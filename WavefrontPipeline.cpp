@@ -0,0 +1,167 @@
+#include "WavefrontPipeline.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// Shader storage bindings and layouts, must match wavefront.glsl
+static const GLuint QUEUE_BINDING = 12;
+static const GLuint PATH_BINDING = 13;
+static const GLuint SHADOW_RAY_BINDING = 14;
+static const GLuint WAVEFRONT_GROUP_SIZE = 64;
+// Two ray queues, the hit queue and the shadow ray queue, each headed by its indirect dispatch arguments and count
+static const GLuint QUEUE_COUNT = 4, QUEUE_HEADER_SIZE = 4 * sizeof(GLuint);
+static const GLuint HIT_QUEUE = 2, SHADOW_QUEUE = 3;
+// std430 sizes of PathState and ShadowRay
+static const GLuint PATH_STATE_SIZE = 208, SHADOW_RAY_SIZE = 48;
+
+// Bounds the memory of a wave: 256k paths take 52MB and 2M shadow rays 96MB, whatever the frame size
+static const GLuint MAX_WAVE_SIZE = 1u << 18, MAX_SHADOW_RAYS = 1u << 21;
+
+WavefrontPipeline::~WavefrontPipeline()
+{
+    glDeleteBuffers(1, &queueBuffer);
+    glDeleteBuffers(1, &pathBuffer);
+    glDeleteBuffers(1, &shadowRayBuffer);
+    glDeleteFramebuffers(1, &outputFBO);
+    glDeleteTextures(1, &outputTexture);
+}
+
+void WavefrontPipeline::SetPrograms(const std::array<GLuint, WAVEFRONT_STAGE_COUNT>& programs, GLuint maxBounces, GLuint shadowRaysPerHit)
+{
+    this->programs = programs;
+    this->maxBounces = maxBounces;
+    this->shadowRaysPerHit = std::max(shadowRaysPerHit, 1u);
+}
+
+void WavefrontPipeline::Reserve(GLuint width, GLuint height)
+{
+    // Scenes with many lights per hit get smaller waves rather than more memory
+    const GLuint pixelCount = width * height;
+    const GLuint waveSize = std::min({ pixelCount, MAX_WAVE_SIZE, std::max(MAX_SHADOW_RAYS / shadowRaysPerHit, WAVEFRONT_GROUP_SIZE) });
+    const GLuint shadowRays = waveSize * shadowRaysPerHit;
+
+    if (waveSize > waveCapacity)
+    {
+        waveCapacity = waveSize;
+        if (!queueBuffer)
+            glGenBuffers(1, &queueBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, queueBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, QUEUE_COUNT * QUEUE_HEADER_SIZE + 3 * sizeof(GLuint) * size_t(waveCapacity), NULL, GL_DYNAMIC_COPY);
+
+        if (!pathBuffer)
+            glGenBuffers(1, &pathBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, pathBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, PATH_STATE_SIZE * size_t(waveCapacity), NULL, GL_DYNAMIC_COPY);
+    }
+
+    if (shadowRays > shadowRayCapacity)
+    {
+        shadowRayCapacity = shadowRays;
+        if (!shadowRayBuffer)
+            glGenBuffers(1, &shadowRayBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowRayBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, SHADOW_RAY_SIZE * size_t(shadowRayCapacity), NULL, GL_DYNAMIC_COPY);
+    }
+
+    // Only grows, smaller frames such as interactive previews render into the lower left corner
+    if (width > outputWidth || height > outputHeight)
+    {
+        outputWidth = std::max(width, outputWidth);
+        outputHeight = std::max(height, outputHeight);
+        if (!outputFBO)
+            glGenFramebuffers(1, &outputFBO);
+
+        // Image stores need immutable storage, which cannot be resized
+        glDeleteTextures(1, &outputTexture);
+        glGenTextures(1, &outputTexture);
+        glBindTexture(GL_TEXTURE_2D, outputTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, outputWidth, outputHeight);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("Wavefront output framebuffer could not be created.");
+    }
+}
+
+void WavefrontPipeline::ResetQueue(GLuint queue)
+{
+    // No groups until the first entry arrives, the other two dimensions stay 1
+    const GLuint header[4] = { 0, 1, 1, 0 };
+    glBufferSubData(GL_DISPATCH_INDIRECT_BUFFER, queue * QUEUE_HEADER_SIZE, sizeof(header), header);
+}
+
+// Each stage reads what the previous one wrote, including the group counts it dispatches with
+static void WaitForStage()
+{
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void WavefrontPipeline::Dispatch(WavefrontStage stage, GLuint groupCount)
+{
+    glUseProgram(programs[GLuint(stage) - 1]);
+    glDispatchCompute(groupCount, 1, 1);
+    WaitForStage();
+}
+
+void WavefrontPipeline::DispatchQueue(WavefrontStage stage, GLuint queue)
+{
+    glUseProgram(programs[GLuint(stage) - 1]);
+    glDispatchComputeIndirect(queue * QUEUE_HEADER_SIZE);
+    WaitForStage();
+}
+
+void WavefrontPipeline::Render(GLuint width, GLuint height)
+{
+    Reserve(width, height);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, QUEUE_BINDING, queueBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PATH_BINDING, pathBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SHADOW_RAY_BINDING, shadowRayBuffer);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, queueBuffer);
+    glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+    for (GLuint program : programs)
+    {
+        glProgramUniform1ui(program, glGetUniformLocation(program, "waveCapacity"), waveCapacity);
+        glProgramUniform1ui(program, glGetUniformLocation(program, "shadowRayCapacity"), shadowRayCapacity);
+        glProgramUniform2ui(program, glGetUniformLocation(program, "renderSize"), width, height);
+    }
+
+    const GLuint pixelCount = width * height;
+    for (GLuint waveStart = 0; waveStart < pixelCount; waveStart += waveCapacity)
+    {
+        const GLuint waveSize = std::min(waveCapacity, pixelCount - waveStart);
+        const GLuint waveGroups = (waveSize + WAVEFRONT_GROUP_SIZE - 1) / WAVEFRONT_GROUP_SIZE;
+        for (GLuint program : programs)
+        {
+            glProgramUniform1ui(program, glGetUniformLocation(program, "waveStart"), waveStart);
+            glProgramUniform1ui(program, glGetUniformLocation(program, "waveSize"), waveSize);
+        }
+
+        ResetQueue(0);
+        Dispatch(WavefrontStage::rayGeneration, waveGroups);
+
+        // The primary rays, then every bounce. Once all paths have ended the dispatches are empty.
+        for (GLuint bounce = 0; bounce <= maxBounces; ++bounce)
+        {
+            const GLuint parity = bounce % 2;
+            ResetQueue(1 - parity);
+            ResetQueue(HIT_QUEUE);
+            ResetQueue(SHADOW_QUEUE);
+            for (WavefrontStage stage : { WavefrontStage::extension, WavefrontStage::shading })
+            {
+                const GLuint program = programs[GLuint(stage) - 1];
+                glProgramUniform1ui(program, glGetUniformLocation(program, "rayQueueParity"), parity);
+            }
+
+            DispatchQueue(WavefrontStage::extension, parity);
+            DispatchQueue(WavefrontStage::shading, HIT_QUEUE);
+            DispatchQueue(WavefrontStage::shadows, SHADOW_QUEUE);
+        }
+
+        Dispatch(WavefrontStage::resolve, waveGroups);
+    }
+
+    // The output is blit or read back next
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
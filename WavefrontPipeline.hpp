@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+
+// Stages of wavefront.glsl, the value of WAVEFRONT_STAGE each is compiled with
+enum class WavefrontStage : GLuint { rayGeneration = 1, extension, shading, shadows, resolve };
+static const GLuint WAVEFRONT_STAGE_COUNT = 5;
+
+// Renders frames as a sequence of compute dispatches instead of one fragment shader per pixel, see wavefront.glsl.
+// The frame is traced in waves of paths, sized so the queues fit in a bounded amount of memory, and every bounce
+// of a wave extends, shades and shadow-tests only the paths still alive.
+// Every method, including the destructor, must be called on the thread that owns the GL context.
+class WavefrontPipeline
+{
+public:
+    WavefrontPipeline() = default;
+    ~WavefrontPipeline();
+
+    WavefrontPipeline(const WavefrontPipeline&) = delete;
+    WavefrontPipeline& operator=(const WavefrontPipeline&) = delete;
+
+    // The linked program of each stage, indexed by stage - 1, for a scene tracing up to maxBounces reflections and
+    // casting up to shadowRaysPerHit shadow rays from each hit
+    void SetPrograms(const std::array<GLuint, WAVEFRONT_STAGE_COUNT>& programs, GLuint maxBounces, GLuint shadowRaysPerHit);
+
+    // Traces one sample of every pixel of a width x height target into the lower left corner of the output
+    // framebuffer's color attachment.
+    // The camera and accumulation uniforms must already be set on every stage program.
+    void Render(GLuint width, GLuint height);
+
+    // Float framebuffer holding the last rendered sample, blit it to the render target
+    GLuint GetOutputFramebuffer() const { return outputFBO; }
+
+private:
+    void Reserve(GLuint width, GLuint height);
+    // Empties a queue ahead of the stage that fills it
+    void ResetQueue(GLuint queue);
+    void Dispatch(WavefrontStage stage, GLuint groupCount);
+    void DispatchQueue(WavefrontStage stage, GLuint queue);
+
+    std::array<GLuint, WAVEFRONT_STAGE_COUNT> programs = {};
+    GLuint maxBounces = 0, shadowRaysPerHit = 1;
+
+    GLuint waveCapacity = 0, shadowRayCapacity = 0;
+    GLuint queueBuffer = 0, pathBuffer = 0, shadowRayBuffer = 0;
+    GLuint outputWidth = 0, outputHeight = 0;
+    GLuint outputTexture = 0, outputFBO = 0;
+};
@@ -2,8 +2,14 @@
 #extension GL_NV_shader_buffer_load : enable
 
 struct CameraProps {
+    // Takes rays from camera space, looking down -z from the origin, into the world space the scene is stored in
+    mat4x4 toWorld;
     vec2 frameSize;
     float fov;
+    // Position of this render target's bottom-left pixel in the full frame when rendering in tiles
+    vec2 tileOffset;
+    // Sub-pixel offset of this frame's sample from the pixel center
+    vec2 jitter;
 };
 
 struct Ray {
@@ -11,9 +17,14 @@ struct Ray {
     vec4 direction;
 };
 
+// Scalars fill the padding after each vec3, see PackedMaterial
 struct Material {
-    vec3 ambient, diffuse, specular;
-    float absorption, reflection, transparency;
+    vec3 ambient;
+    float absorption;
+    vec3 diffuse;
+    float reflection;
+    vec3 specular;
+    float transparency;
     float shininess;
 };
 
@@ -26,9 +37,23 @@ struct HitRecord {
 };
 
 struct ObjectData {
-    Material mat;
     mat4x4 mv, mvInverse, mvInverseTranspose;
     uint type;
+    uint materialIndex;
+    uint meshRoot; // root of a mesh object's BVH in meshNodes
+};
+
+// A zero normal means the mesh file had none, the face normal is used instead
+struct MeshVertex {
+    vec3 position;
+    vec3 normal;
+};
+
+// One placement of a prototype's objects, see TwoLevelBVH
+struct Instance {
+    mat4x4 transform, transformInverse;
+    uint blasRoot;
+    uint prototype;
 };
 
 struct Light {
@@ -36,198 +61,822 @@ struct Light {
     vec4 position;
 };
 
+struct BVHNode {
+    vec3 boundsMin;
+    uint leftOrFirst; // left child index for interior nodes, first primitive index for leaves
+    vec3 boundsMax;
+    uint primCount; // 0 for interior nodes
+};
+
+// Bounds and summed power of a subtree of point lights, see LightTree
+struct LightTreeNode {
+    vec3 boundsMin;
+    uint leftOrFirst; // left child index for interior nodes, light index for leaves
+    vec3 boundsMax;
+    uint lightCount; // 1 for leaves, 0 for interior nodes
+    float power;
+};
+
+// Scene specialization, OpenGLView injects these after '#version' (see ShaderVariant).
+// The defaults below keep every feature so the shader also compiles on its own.
+#ifndef HAS_SPHERES
+#define HAS_SPHERES 1
+#endif
+#ifndef HAS_BOXES
+#define HAS_BOXES 1
+#endif
+#ifndef HAS_MESHES
+#define HAS_MESHES 1
+#endif
+#ifndef HAS_REFLECTIONS
+#define HAS_REFLECTIONS 1
+#endif
+// Point lights sampled from the light tree per hit, 0 shades every light. Unsuffixed for use in #if.
+#ifndef LIGHT_SAMPLES
+#define LIGHT_SAMPLES 0
+#endif
+#ifndef COUNT_RAYS
+#define COUNT_RAYS 0
+#endif
+#ifndef COST_OUTPUT
+#define COST_OUTPUT 0
+#endif
+// Compiles one compute stage of wavefront.glsl, which is appended after this file, instead of the fragment shader
+#ifndef WAVEFRONT_STAGE
+#define WAVEFRONT_STAGE 0
+#endif
+
 uniform CameraProps camera;
+// Progressive rendering: the mean of the samples rendered so far, and how many there were
+uniform sampler2D accumulation;
+uniform uint accumulatedSamples;
+// Summed ambient term of every light, added without sampling when LIGHT_SAMPLES is set
+uniform vec3 ambientLight;
+#ifdef FIXED_MAX_BOUNCES
+const uint MAX_BOUNCES = FIXED_MAX_BOUNCES;
+#else
 uniform uint MAX_BOUNCES;
-const uint MAX_OBJECT_COUNT = 16;
-uniform uint OBJECT_COUNT;
-uniform ObjectData[MAX_OBJECT_COUNT] objs;
-const uint MAX_LIGHT_COUNT = 16;
-uniform uint LIGHT_COUNT;
-uniform Light[MAX_LIGHT_COUNT] lights;
+#endif
+
+layout(std430, binding = 0) readonly buffer BVHNodeBuffer {
+    BVHNode bvhNodes[];
+};
+layout(std430, binding = 1) readonly buffer BVHPrimitiveBuffer {
+    uint bvhPrimIndices[];
+};
+layout(std430, binding = 2) readonly buffer ObjectBuffer {
+    ObjectData objs[];
+};
+layout(std430, binding = 3) readonly buffer LightBuffer {
+    Light lights[];
+};
+layout(std430, binding = 4) readonly buffer MaterialBuffer {
+    Material materials[];
+};
+layout(std430, binding = 5) readonly buffer InstanceBuffer {
+    Instance instances[];
+};
+// Every mesh's BVH, leaves index triangles directly: triangle i uses meshIndices[3i .. 3i+2]
+layout(std430, binding = 6) readonly buffer MeshNodeBuffer {
+    BVHNode meshNodes[];
+};
+layout(std430, binding = 7) readonly buffer MeshVertexBuffer {
+    MeshVertex meshVertices[];
+};
+layout(std430, binding = 8) readonly buffer MeshIndexBuffer {
+    uint meshIndices[];
+};
+layout(std430, binding = 9) readonly buffer LightTreeNodeBuffer {
+    LightTreeNode lightTreeNodes[];
+};
+// Ray statistics of the frame for GpuProfiler, only in variants that count rays.
+// Each fragment counts locally and adds its totals once at the end, instead of an atomic per test.
+#if COUNT_RAYS
+// 64 bit totals as pairs of a low and a high word, a single frame can make more node tests than 32 bits hold
+layout(std430, binding = 11) buffer RayCounterBuffer {
+    uint rayCounters[];
+};
+// In the order of GpuProfiler::Counter
+const uint PRIMARY_RAYS = 0u, SHADOW_RAYS = 1u, BOUNCE_RAYS = 2u, NODE_TESTS = 3u, PRIMITIVE_TESTS = 4u;
+
+void addRayCount(uint counter, uint count)
+{
+    // Carry into the high word whenever the low word wraps
+    if (atomicAdd(rayCounters[2u * counter], count) > 0xffffffffu - count)
+        atomicAdd(rayCounters[2u * counter + 1u], 1u);
+}
+#endif
+// Cost output variants write the same counts to the pixel instead
+#if COUNT_RAYS || COST_OUTPUT
+uint countedRaycasts = 0u, countedShadowRays = 0u, countedNodeTests = 0u, countedPrimitiveTests = 0u;
+#define COUNT(counter) ++counter
+#else
+#define COUNT(counter)
+#endif
+
+const uint BVH_STACK_SIZE = 64;
 
 const float MAX_FLOAT = 3.402823466e+38;
 
 bool intersectsWithBoxSide(inout float tMin, inout float tMax, float start, float dir);
+void intersectMesh(in const ObjectData obj, in const Ray ray, inout HitRecord hit);
 
-bool raycast(in const Ray viewspaceRay, inout HitRecord hit)
+// Ray time of the hit on the unit sphere, negative if there is none
+float intersectSphere(in const Ray ray)
+{
+    COUNT(countedPrimitiveTests);
+    // Solve quadratic
+    float A = ray.direction.x * ray.direction.x +
+        ray.direction.y * ray.direction.y +
+        ray.direction.z * ray.direction.z;
+    float B = 2.0 *
+        (ray.direction.x * ray.start.x + ray.direction.y * ray.start.y +
+            ray.direction.z * ray.start.z);
+    float C = ray.start.x * ray.start.x + ray.start.y * ray.start.y +
+        ray.start.z * ray.start.z - 1.0;
+
+    float radical = B * B - 4.0 * A * C;
+
+    // no intersection
+    if (radical < 0) return -1.0;
+
+    float root = sqrt(radical);
+
+    float t1 = (-B - root) / (2.0 * A);
+    float t2 = (-B + root) / (2.0 * A);
+
+    // negative when the object is fully behind the ray
+    return (t1 >= 0 && t2 >= 0) ? min(t1, t2) : max(t1, t2);
+}
+
+// Ray time of the hit on the unit box, negative if there is none
+float intersectBox(in const Ray ray)
+{
+    COUNT(countedPrimitiveTests);
+    float txMin, txMax, tyMin, tyMax, tzMin, tzMax;
+
+    if (!intersectsWithBoxSide(txMin, txMax, ray.start.x, ray.direction.x))
+        return -1.0;
+
+    if (!intersectsWithBoxSide(tyMin, tyMax, ray.start.y, ray.direction.y))
+        return -1.0;
+
+    if (!intersectsWithBoxSide(tzMin, tzMax, ray.start.z, ray.direction.z))
+        return -1.0;
+
+    float tMin = max(max(txMin, tyMin), tzMin);
+    float tMax = min(min(txMax, tyMax), tzMax);
+
+    // no intersection
+    if (tMax < tMin) return -1.0;
+
+    // negative when the object is fully behind the ray
+    return (tMin >= 0 && tMax >= 0) ? min(tMin, tMax) : max(tMin, tMax);
+}
+
+// Records the hit in the prototype's space, raycast moves it into world space and normalizes the normal
+void intersectObject(uint objIndex, in const Ray prototypeRay, inout HitRecord hit)
 {
     Ray ray;
+    const ObjectData obj = objs[objIndex];
 
-    for (uint objIndex = 0; objIndex < OBJECT_COUNT && objIndex < MAX_OBJECT_COUNT; ++objIndex) {
-        const ObjectData obj = objs[objIndex];
+    ray.start = obj.mvInverse * prototypeRay.start;
+    ray.direction = obj.mvInverse * prototypeRay.direction;
 
-        ray.start = obj.mvInverse * viewspaceRay.start;
-        ray.direction = obj.mvInverse * viewspaceRay.direction;
+    switch (obj.type) {
+#if HAS_SPHERES
+    case 0: // Sphere
+    {
+        float tMin = intersectSphere(ray);
+        // no intersection, or object is fully behind camera
+        if (tMin < 0) return;
 
-        switch (obj.type) {
-        case 0: // Sphere
-        {
-            // Solve quadratic
-            float A = ray.direction.x * ray.direction.x +
-                ray.direction.y * ray.direction.y +
-                ray.direction.z * ray.direction.z;
-            float B = 2.0 *
-                (ray.direction.x * ray.start.x + ray.direction.y * ray.start.y +
-                    ray.direction.z * ray.start.z);
-            float C = ray.start.x * ray.start.x + ray.start.y * ray.start.y +
-                ray.start.z * ray.start.z - 1.0;
+        if (hit.time < tMin) return;
 
-            float radical = B * B - 4.0 * A * C;
+        hit.time = tMin;
 
-            // no intersection
-            if (radical < 0) continue;
+        vec4 objSpaceIntersection = ray.start + tMin * ray.direction;
+        hit.intersection = obj.mv * objSpaceIntersection;
+        vec4 objSpaceNormal = objSpaceIntersection;
+        objSpaceNormal.w = 0.0;
+        vec4 normal = obj.mv * objSpaceNormal;
+        hit.normal = normal.xyz;
+        hit.mat = materials[obj.materialIndex];
+        return;
+    }
+#endif
 
-            float root = sqrt(radical);
+#if HAS_BOXES
+    case 1: // Box
+    {
+        float tHit = intersectBox(ray);
+        // no intersection, or object is fully behind camera
+        if (tHit < 0) return;
 
-            float t1 = (-B - root) / (2.0 * A);
-            float t2 = (-B + root) / (2.0 * A);
+        // already hit a closer object
+        if (hit.time <= tHit) return;
 
-            float tMin = (t1 >= 0 && t2 >= 0) ? min(t1, t2) : max(t1, t2);
-            // object is fully behind camera
-            if (tMin < 0) continue;
+        vec4 objSpaceIntersection = ray.start + tHit * ray.direction;
 
-            if (hit.time < tMin) continue;
+        vec4 objSpaceNormal = { 0.0, 0.0, 0.0, 0.0 };
+        const float BOX_EXTENTS = 0.4998;
+        if (objSpaceIntersection.x > BOX_EXTENTS) objSpaceNormal.x += 1.0;
+        else if (objSpaceIntersection.x < -BOX_EXTENTS) objSpaceNormal.x -= 1.0;
 
-            hit.time = tMin;
+        if (objSpaceIntersection.y > BOX_EXTENTS) objSpaceNormal.y += 1.0;
+        else if (objSpaceIntersection.y < -BOX_EXTENTS) objSpaceNormal.y -= 1.0;
 
-            vec4 objSpaceIntersection = ray.start + tMin * ray.direction;
-            hit.intersection = obj.mv * objSpaceIntersection;
-            vec4 objSpaceNormal = objSpaceIntersection;
-            objSpaceNormal.w = 0.0;
-            vec4 normal = obj.mv * objSpaceNormal;
-            hit.normal = normalize(normal.xyz);
-            hit.mat = obj.mat;
-            continue;
-        }
+        if (objSpaceIntersection.z > BOX_EXTENTS) objSpaceNormal.z += 1.0;
+        else if (objSpaceIntersection.z < -BOX_EXTENTS) objSpaceNormal.z -= 1.0;
 
-        case 1: // Box
-        {
-            float txMin, txMax, tyMin, tyMax, tzMin, tzMax;
+        hit.time = tHit;
+        hit.intersection = obj.mv * objSpaceIntersection;
+        vec4 normal = obj.mv * objSpaceNormal;
+        hit.normal = normal.xyz;
+        hit.mat = materials[obj.materialIndex];
+        return;
+    }
+#endif
 
-            if (!intersectsWithBoxSide(txMin, txMax, ray.start.x, ray.direction.x))
-                continue;
+#if HAS_MESHES
+    case 2: // Mesh
+        intersectMesh(obj, ray, hit);
+        return;
+#endif
 
-            if (!intersectsWithBoxSide(tyMin, tyMax, ray.start.y, ray.direction.y))
-                continue;
+    // Keeps the switch valid when a variant compiles out every primitive type
+    default:
+        return;
+    }
+}
 
-            if (!intersectsWithBoxSide(tzMin, tzMax, ray.start.z, ray.direction.z))
-                continue;
+// Returns the entry time into the bounds, or MAX_FLOAT if the ray misses them before maxTime
+float intersectBounds(in const vec3 boundsMin, in const vec3 boundsMax, in const vec3 start, in const vec3 invDirection, float maxTime)
+{
+    COUNT(countedNodeTests);
+    vec3 t1 = (boundsMin - start) * invDirection;
+    vec3 t2 = (boundsMax - start) * invDirection;
+    vec3 tNear = min(t1, t2);
+    vec3 tFar = max(t1, t2);
 
-            float tMin = max(max(txMin, tyMin), tzMin);
-            float tMax = min(min(txMax, tyMax), tzMax);
+    float entryTime = max(max(tNear.x, tNear.y), tNear.z);
+    float exitTime = min(min(tFar.x, tFar.y), tFar.z);
 
-            // no intersection
-            if (tMax < tMin) continue;
+    if (entryTime > exitTime || exitTime < 0 || entryTime > maxTime) return MAX_FLOAT;
+    return entryTime;
+}
 
-            float tHit = (tMin >= 0 && tMax >= 0) ? min(tMin, tMax) : max(tMin, tMax);
-            // object is fully behind camera
-            if (tHit < 0) continue;
+// Keeps the reciprocal finite so axis-aligned rays never produce 0 * inf
+vec3 safeInverse(vec3 direction)
+{
+    direction = mix(direction, vec3(1e-20), lessThan(abs(direction), vec3(1e-20)));
+    return 1.0 / direction;
+}
 
-            // already hit a closer object
-            if (hit.time <= tHit) continue;
+// Moller-Trumbore, returns the ray time of the hit or MAX_FLOAT. Triangles are hit from either side.
+float intersectTriangle(in const vec3 v0, in const vec3 v1, in const vec3 v2, in const Ray ray, out vec2 barycentric)
+{
+    COUNT(countedPrimitiveTests);
+    vec3 edge1 = v1 - v0;
+    vec3 edge2 = v2 - v0;
+    vec3 p = cross(ray.direction.xyz, edge2);
+    float determinant = dot(edge1, p);
+    // Ray is parallel to the triangle
+    if (determinant == 0.0) return MAX_FLOAT;
+
+    float invDeterminant = 1.0 / determinant;
+    vec3 s = ray.start.xyz - v0;
+    barycentric.x = dot(s, p) * invDeterminant;
+    if (barycentric.x < 0.0 || barycentric.x > 1.0) return MAX_FLOAT;
+
+    vec3 q = cross(s, edge1);
+    barycentric.y = dot(ray.direction.xyz, q) * invDeterminant;
+    if (barycentric.y < 0.0 || barycentric.x + barycentric.y > 1.0) return MAX_FLOAT;
+
+    float t = dot(edge2, q) * invDeterminant;
+    return t > 0.0 ? t : MAX_FLOAT;
+}
 
-            vec4 objSpaceIntersection = ray.start + tHit * ray.direction;
+// Closest hit on a mesh object, walking the mesh's BVH with the ray in mesh space
+void intersectMesh(in const ObjectData obj, in const Ray ray, inout HitRecord hit)
+{
+    vec3 start = ray.start.xyz;
+    vec3 invDirection = safeInverse(ray.direction.xyz);
+    uint hitTriangle = 0;
+    vec2 hitBarycentric = vec2(0.0);
+    float hitTime = hit.time;
+
+    uint nodeStack[BVH_STACK_SIZE];
+    float entryStack[BVH_STACK_SIZE];
+    uint stackSize = 0;
+
+    uint nodeIndex = obj.meshRoot;
+    float nodeEntry = intersectBounds(meshNodes[nodeIndex].boundsMin, meshNodes[nodeIndex].boundsMax, start, invDirection, hitTime);
+
+    while (nodeEntry != MAX_FLOAT) {
+        const BVHNode node = meshNodes[nodeIndex];
+        float nearEntry = MAX_FLOAT, farEntry = MAX_FLOAT;
+        uint nearIndex = 0, farIndex = 0;
+
+        if (node.primCount > 0) {
+            for (uint triangle = node.leftOrFirst; triangle < node.leftOrFirst + node.primCount; ++triangle) {
+                vec2 barycentric;
+                float t = intersectTriangle(meshVertices[meshIndices[3 * triangle]].position, meshVertices[meshIndices[3 * triangle + 1]].position,
+                    meshVertices[meshIndices[3 * triangle + 2]].position, ray, barycentric);
+                if (t < hitTime) {
+                    hitTime = t;
+                    hitTriangle = triangle;
+                    hitBarycentric = barycentric;
+                }
+            }
+        }
+        else {
+            nearIndex = node.leftOrFirst;
+            farIndex = node.leftOrFirst + 1;
+            nearEntry = intersectBounds(meshNodes[nearIndex].boundsMin, meshNodes[nearIndex].boundsMax, start, invDirection, hitTime);
+            farEntry = intersectBounds(meshNodes[farIndex].boundsMin, meshNodes[farIndex].boundsMax, start, invDirection, hitTime);
+
+            // Visit the nearer child first
+            if (farEntry < nearEntry) {
+                uint swapIndex = nearIndex;
+                nearIndex = farIndex;
+                farIndex = swapIndex;
+                float swapEntry = nearEntry;
+                nearEntry = farEntry;
+                farEntry = swapEntry;
+            }
+        }
 
-            vec4 objSpaceNormal = { 0.0, 0.0, 0.0, 0.0 };
-            const float BOX_EXTENTS = 0.4998;
-            if (objSpaceIntersection.x > BOX_EXTENTS) objSpaceNormal.x += 1.0;
-            else if (objSpaceIntersection.x < -BOX_EXTENTS) objSpaceNormal.x -= 1.0;
+        if (nearEntry != MAX_FLOAT) {
+            if (farEntry != MAX_FLOAT && stackSize < BVH_STACK_SIZE) {
+                nodeStack[stackSize] = farIndex;
+                entryStack[stackSize++] = farEntry;
+            }
+            nodeIndex = nearIndex;
+            nodeEntry = nearEntry;
+        }
+        else {
+            // Pop the next node that could still hold a closer hit
+            nodeEntry = MAX_FLOAT;
+            while (stackSize > 0 && nodeEntry == MAX_FLOAT) {
+                --stackSize;
+                if (entryStack[stackSize] <= hitTime) {
+                    nodeIndex = nodeStack[stackSize];
+                    nodeEntry = entryStack[stackSize];
+                }
+            }
+        }
+    }
 
-            if (objSpaceIntersection.y > BOX_EXTENTS) objSpaceNormal.y += 1.0;
-            else if (objSpaceIntersection.y < -BOX_EXTENTS) objSpaceNormal.y -= 1.0;
+    if (hitTime >= hit.time) return;
+
+    const MeshVertex v0 = meshVertices[meshIndices[3 * hitTriangle]];
+    const MeshVertex v1 = meshVertices[meshIndices[3 * hitTriangle + 1]];
+    const MeshVertex v2 = meshVertices[meshIndices[3 * hitTriangle + 2]];
+    vec3 normal = (1.0 - hitBarycentric.x - hitBarycentric.y) * v0.normal + hitBarycentric.x * v1.normal + hitBarycentric.y * v2.normal;
+    if (normal == vec3(0.0))
+        normal = cross(v1.position - v0.position, v2.position - v0.position);
+    // Face the ray, mesh windings are not consistent enough to cull or trust
+    if (dot(normal, ray.direction.xyz) > 0.0)
+        normal = -normal;
+
+    hit.time = hitTime;
+    hit.intersection = obj.mv * (ray.start + hitTime * ray.direction);
+    hit.normal = (obj.mvInverseTranspose * vec4(normal, 0.0)).xyz;
+    hit.mat = materials[obj.materialIndex];
+}
 
-            if (objSpaceIntersection.z > BOX_EXTENTS) objSpaceNormal.z += 1.0;
-            else if (objSpaceIntersection.z < -BOX_EXTENTS) objSpaceNormal.z -= 1.0;
+// Finds the closest hit among the objects of one prototype, walking the BLAS from its root.
+// Instance transforms are affine so ray times match world space, and hit.time still culls across instances.
+bool traverseBLAS(uint rootIndex, in const Ray prototypeRay, inout HitRecord hit)
+{
+    vec3 start = prototypeRay.start.xyz;
+    vec3 invDirection = safeInverse(prototypeRay.direction.xyz);
+    const float previousTime = hit.time;
+
+    uint nodeStack[BVH_STACK_SIZE];
+    float entryStack[BVH_STACK_SIZE];
+    uint stackSize = 0;
+
+    uint nodeIndex = rootIndex;
+    float nodeEntry = intersectBounds(bvhNodes[rootIndex].boundsMin, bvhNodes[rootIndex].boundsMax, start, invDirection, hit.time);
+
+    while (nodeEntry != MAX_FLOAT) {
+        const BVHNode node = bvhNodes[nodeIndex];
+        float nearEntry = MAX_FLOAT, farEntry = MAX_FLOAT;
+        uint nearIndex = 0, farIndex = 0;
+
+        if (node.primCount > 0) {
+            for (uint primIndex = node.leftOrFirst; primIndex < node.leftOrFirst + node.primCount; ++primIndex) {
+                intersectObject(bvhPrimIndices[primIndex], prototypeRay, hit);
+            }
+        }
+        else {
+            nearIndex = node.leftOrFirst;
+            farIndex = node.leftOrFirst + 1;
+            nearEntry = intersectBounds(bvhNodes[nearIndex].boundsMin, bvhNodes[nearIndex].boundsMax, start, invDirection, hit.time);
+            farEntry = intersectBounds(bvhNodes[farIndex].boundsMin, bvhNodes[farIndex].boundsMax, start, invDirection, hit.time);
+
+            // Visit the nearer child first
+            if (farEntry < nearEntry) {
+                uint swapIndex = nearIndex;
+                nearIndex = farIndex;
+                farIndex = swapIndex;
+                float swapEntry = nearEntry;
+                nearEntry = farEntry;
+                farEntry = swapEntry;
+            }
+        }
 
-            hit.time = tHit;
-            hit.intersection = obj.mv * objSpaceIntersection;
-            vec4 normal = obj.mv * objSpaceNormal;
-            hit.normal = normalize(normal.xyz);
-            hit.mat = obj.mat;
-            continue;
+        if (nearEntry != MAX_FLOAT) {
+            if (farEntry != MAX_FLOAT && stackSize < BVH_STACK_SIZE) {
+                nodeStack[stackSize] = farIndex;
+                entryStack[stackSize++] = farEntry;
+            }
+            nodeIndex = nearIndex;
+            nodeEntry = nearEntry;
+        }
+        else {
+            // Pop the next node that could still hold a closer hit
+            nodeEntry = MAX_FLOAT;
+            while (stackSize > 0 && nodeEntry == MAX_FLOAT) {
+                --stackSize;
+                if (entryStack[stackSize] <= hit.time) {
+                    nodeIndex = nodeStack[stackSize];
+                    nodeEntry = entryStack[stackSize];
+                }
+            }
+        }
+    }
+
+    return hit.time < previousTime;
+}
+
+// Walks the TLAS over the instances, then moves the closest hit from its prototype's space into world space
+bool raycast(in const Ray worldRay, inout HitRecord hit)
+{
+    COUNT(countedRaycasts);
+    vec3 start = worldRay.start.xyz;
+    vec3 invDirection = safeInverse(worldRay.direction.xyz);
+
+    uint nodeStack[BVH_STACK_SIZE];
+    float entryStack[BVH_STACK_SIZE];
+    uint stackSize = 0;
+    uint hitInstance = 0;
+
+    // A scene without instances has a lone TLAS root that links back to itself
+    if (bvhNodes[0].primCount == 0 && bvhNodes[0].leftOrFirst == 0) return false;
+
+    uint nodeIndex = 0;
+    float nodeEntry = intersectBounds(bvhNodes[0].boundsMin, bvhNodes[0].boundsMax, start, invDirection, hit.time);
+
+    while (nodeEntry != MAX_FLOAT) {
+        const BVHNode node = bvhNodes[nodeIndex];
+        float nearEntry = MAX_FLOAT, farEntry = MAX_FLOAT;
+        uint nearIndex = 0, farIndex = 0;
+
+        if (node.primCount > 0) {
+            for (uint primIndex = node.leftOrFirst; primIndex < node.leftOrFirst + node.primCount; ++primIndex) {
+                const uint instanceIndex = bvhPrimIndices[primIndex];
+                Ray prototypeRay;
+                prototypeRay.start = instances[instanceIndex].transformInverse * worldRay.start;
+                prototypeRay.direction = instances[instanceIndex].transformInverse * worldRay.direction;
+                if (traverseBLAS(instances[instanceIndex].blasRoot, prototypeRay, hit))
+                    hitInstance = instanceIndex;
+            }
+        }
+        else {
+            nearIndex = node.leftOrFirst;
+            farIndex = node.leftOrFirst + 1;
+            nearEntry = intersectBounds(bvhNodes[nearIndex].boundsMin, bvhNodes[nearIndex].boundsMax, start, invDirection, hit.time);
+            farEntry = intersectBounds(bvhNodes[farIndex].boundsMin, bvhNodes[farIndex].boundsMax, start, invDirection, hit.time);
+
+            // Visit the nearer child first
+            if (farEntry < nearEntry) {
+                uint swapIndex = nearIndex;
+                nearIndex = farIndex;
+                farIndex = swapIndex;
+                float swapEntry = nearEntry;
+                nearEntry = farEntry;
+                farEntry = swapEntry;
+            }
         }
 
+        if (nearEntry != MAX_FLOAT) {
+            if (farEntry != MAX_FLOAT && stackSize < BVH_STACK_SIZE) {
+                nodeStack[stackSize] = farIndex;
+                entryStack[stackSize++] = farEntry;
+            }
+            nodeIndex = nearIndex;
+            nodeEntry = nearEntry;
+        }
+        else {
+            // Pop the next node that could still hold a closer hit
+            nodeEntry = MAX_FLOAT;
+            while (stackSize > 0 && nodeEntry == MAX_FLOAT) {
+                --stackSize;
+                if (entryStack[stackSize] <= hit.time) {
+                    nodeIndex = nodeStack[stackSize];
+                    nodeEntry = entryStack[stackSize];
+                }
+            }
         }
     }
 
     if (hit.time == MAX_FLOAT) return false;
 
-    hit.reflection = reflect(viewspaceRay.direction.xyz, hit.normal);
+    // Normals take the inverse transpose, v * M is transpose(M) * v
+    const Instance instance = instances[hitInstance];
+    hit.intersection = instance.transform * hit.intersection;
+    hit.normal = normalize((vec4(hit.normal, 0.0) * instance.transformInverse).xyz);
+    hit.reflection = reflect(worldRay.direction.xyz, hit.normal);
     return true;
 }
 
-vec3 shade(in HitRecord hit)
+// Any-hit tests for shadow rays: each returns as soon as something is hit before maxTime, and builds no hit record.
+// Children are visited in any order since the first hit ends the walk.
+
+bool meshOccludes(in const ObjectData obj, in const Ray ray, float maxTime)
 {
-    vec3 fPosition = hit.intersection.xyz;
-    vec3 fNormal = hit.normal;
-    vec3 fColor = vec3( 0.0, 0.0, 0.0 );
-    vec3 lightVec = vec3( 0.0, 0.0, 0.0 ), viewVec = vec3( 0.0, 0.0, 0.0 ), reflectVec = vec3( 0.0, 0.0, 0.0 );
-    vec3 normalView = vec3( 0.0, 0.0, 0.0 );
-    vec3 ambient = vec3( 0.0, 0.0, 0.0 ), diffuse = vec3( 0.0, 0.0, 0.0 ), specular = vec3( 0.0, 0.0, 0.0 );
-    float nDotL, rDotV;
+    vec3 start = ray.start.xyz;
+    vec3 invDirection = safeInverse(ray.direction.xyz);
+
+    uint nodeStack[BVH_STACK_SIZE];
+    uint stackSize = 0;
+    if (intersectBounds(meshNodes[obj.meshRoot].boundsMin, meshNodes[obj.meshRoot].boundsMax, start, invDirection, maxTime) != MAX_FLOAT)
+        nodeStack[stackSize++] = obj.meshRoot;
+
+    while (stackSize > 0) {
+        const BVHNode node = meshNodes[nodeStack[--stackSize]];
+        if (node.primCount > 0) {
+            for (uint triangle = node.leftOrFirst; triangle < node.leftOrFirst + node.primCount; ++triangle) {
+                vec2 barycentric;
+                if (intersectTriangle(meshVertices[meshIndices[3 * triangle]].position, meshVertices[meshIndices[3 * triangle + 1]].position,
+                    meshVertices[meshIndices[3 * triangle + 2]].position, ray, barycentric) < maxTime)
+                    return true;
+            }
+            continue;
+        }
 
-    for (uint lightIndex = 0; lightIndex < LIGHT_COUNT; ++lightIndex) {
-        const Light light = lights[lightIndex];
-        if (light.position.w != 0)
-            lightVec = light.position.xyz - fPosition.xyz;
-        else
-            lightVec = -light.position.xyz;
+        for (uint child = node.leftOrFirst; child < node.leftOrFirst + 2; ++child) {
+            if (stackSize < BVH_STACK_SIZE && intersectBounds(meshNodes[child].boundsMin, meshNodes[child].boundsMax, start, invDirection, maxTime) != MAX_FLOAT)
+                nodeStack[stackSize++] = child;
+        }
+    }
+    return false;
+}
+
+bool objectOccludes(uint objIndex, in const Ray prototypeRay, float maxTime)
+{
+    Ray ray;
+    const ObjectData obj = objs[objIndex];
+
+    ray.start = obj.mvInverse * prototypeRay.start;
+    ray.direction = obj.mvInverse * prototypeRay.direction;
+
+    float t = -1.0;
+    switch (obj.type) {
+#if HAS_SPHERES
+    case 0: t = intersectSphere(ray); break;
+#endif
+#if HAS_BOXES
+    case 1: t = intersectBox(ray); break;
+#endif
+#if HAS_MESHES
+    case 2: return meshOccludes(obj, ray, maxTime);
+#endif
+    default: break;
+    }
+    return t >= 0 && t < maxTime;
+}
 
-        // Shoot ray towards light source, any hit means shadow.
-        Ray rayToLight;
-        rayToLight.start = vec4(fPosition, 1.0);
-        rayToLight.direction = vec4(lightVec, 0.0);
-        // Need 'skin' width to avoid hitting itself.
-        rayToLight.start += 0.01 * vec4(normalize(rayToLight.direction.xyz), 0);
-        HitRecord shadowcastHit;
-        shadowcastHit.time = MAX_FLOAT;
+bool prototypeOccludes(uint rootIndex, in const Ray prototypeRay, float maxTime)
+{
+    vec3 start = prototypeRay.start.xyz;
+    vec3 invDirection = safeInverse(prototypeRay.direction.xyz);
+
+    uint nodeStack[BVH_STACK_SIZE];
+    uint stackSize = 0;
+    if (intersectBounds(bvhNodes[rootIndex].boundsMin, bvhNodes[rootIndex].boundsMax, start, invDirection, maxTime) != MAX_FLOAT)
+        nodeStack[stackSize++] = rootIndex;
+
+    while (stackSize > 0) {
+        const BVHNode node = bvhNodes[nodeStack[--stackSize]];
+        if (node.primCount > 0) {
+            for (uint primIndex = node.leftOrFirst; primIndex < node.leftOrFirst + node.primCount; ++primIndex) {
+                if (objectOccludes(bvhPrimIndices[primIndex], prototypeRay, maxTime))
+                    return true;
+            }
+            continue;
+        }
 
-        raycast(rayToLight, shadowcastHit);
+        for (uint child = node.leftOrFirst; child < node.leftOrFirst + 2; ++child) {
+            if (stackSize < BVH_STACK_SIZE && intersectBounds(bvhNodes[child].boundsMin, bvhNodes[child].boundsMax, start, invDirection, maxTime) != MAX_FLOAT)
+                nodeStack[stackSize++] = child;
+        }
+    }
+    return false;
+}
 
-        lightVec = normalize(lightVec);
+// Whether anything lies on the ray between its start and maxTime
+bool occluded(in const Ray worldRay, float maxTime)
+{
+    COUNT(countedShadowRays);
+    vec3 start = worldRay.start.xyz;
+    vec3 invDirection = safeInverse(worldRay.direction.xyz);
+
+    uint nodeStack[BVH_STACK_SIZE];
+    uint stackSize = 0;
+    if (bvhNodes[0].primCount == 0 && bvhNodes[0].leftOrFirst == 0) return false;
+    if (intersectBounds(bvhNodes[0].boundsMin, bvhNodes[0].boundsMax, start, invDirection, maxTime) != MAX_FLOAT)
+        nodeStack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const BVHNode node = bvhNodes[nodeStack[--stackSize]];
+        if (node.primCount > 0) {
+            for (uint primIndex = node.leftOrFirst; primIndex < node.leftOrFirst + node.primCount; ++primIndex) {
+                const Instance instance = instances[bvhPrimIndices[primIndex]];
+                Ray prototypeRay;
+                prototypeRay.start = instance.transformInverse * worldRay.start;
+                prototypeRay.direction = instance.transformInverse * worldRay.direction;
+                if (prototypeOccludes(instance.blasRoot, prototypeRay, maxTime))
+                    return true;
+            }
+            continue;
+        }
 
-        vec3 tNormal = fNormal;
-        normalView = normalize(tNormal);
-        nDotL = dot(normalView, lightVec);
+        for (uint child = node.leftOrFirst; child < node.leftOrFirst + 2; ++child) {
+            if (stackSize < BVH_STACK_SIZE && intersectBounds(bvhNodes[child].boundsMin, bvhNodes[child].boundsMax, start, invDirection, maxTime) != MAX_FLOAT)
+                nodeStack[stackSize++] = child;
+        }
+    }
+    return false;
+}
 
-        viewVec = -fPosition;
-        viewVec = normalize(viewVec);
+// PCG hash, see Jarzynski and Olano, "Hash Functions for GPU Rendering"
+uint pcgHash(uint value)
+{
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
 
-        reflectVec = reflect(-lightVec, normalView);
-        reflectVec = normalize(reflectVec);
+// Uniform in [0, 1), advances the state
+float randomFloat(inout uint rngState)
+{
+    rngState = pcgHash(rngState);
+    return float(rngState >> 8u) * (1.0 / 16777216.0);
+}
 
-        rDotV = dot(reflectVec, viewVec);
-        rDotV = max(rDotV, 0.0f);
+// Upper bound on the light a subtree could deliver to a point: its power times the largest N.L over its bounds.
+// Lights have no falloff, so distance only matters through the angle the bounds cover.
+float lightImportance(in const LightTreeNode node, in const vec3 position, in const vec3 normal)
+{
+    vec3 center = 0.5 * (node.boundsMin + node.boundsMax);
+    float radius = 0.5 * length(node.boundsMax - node.boundsMin);
+    vec3 toCenter = center - position;
+    float distance = length(toCenter);
+    // Inside the bounding sphere, lights may be in any direction
+    if (distance <= radius)
+        return node.power;
+
+    // cos(max(theta - alpha, 0)) for the angle theta to the center and the half-angle alpha of the sphere
+    float cosTheta = dot(normal, toCenter) / distance;
+    float sinAlpha = radius / distance;
+    float cosAlpha = sqrt(1.0 - sinAlpha * sinAlpha);
+    if (cosTheta >= cosAlpha)
+        return node.power;
+
+    float sinTheta = sqrt(max(1.0 - cosTheta * cosTheta, 0.0));
+    return node.power * max(cosTheta * cosAlpha + sinTheta * sinAlpha, 0.0);
+}
 
-        ambient = hit.mat.ambient * light.ambient;
+const uint NO_LIGHT = 0xffffffffu;
 
-        // Object cannot directly see the light
-        if (shadowcastHit.time >= 1.0 || shadowcastHit.time < 0) {
-            diffuse = hit.mat.diffuse * light.diffuse * max(nDotL, 0.0);
-            if (nDotL > 0)
-                specular = hit.mat.specular * light.specular * pow(rDotV, max(hit.mat.shininess, 1.0));
+// Walks the light tree from the root, picking each child in proportion to its importance.
+// Returns the light's index and the probability of picking it, or NO_LIGHT if none can reach the point.
+uint sampleLightTree(in const vec3 position, in const vec3 normal, inout uint rngState, out float pdf)
+{
+    uint nodeIndex = 0;
+    pdf = 1.0;
+    while (lightTreeNodes[nodeIndex].lightCount == 0) {
+        uint left = lightTreeNodes[nodeIndex].leftOrFirst;
+        float leftImportance = lightImportance(lightTreeNodes[left], position, normal);
+        float rightImportance = lightImportance(lightTreeNodes[left + 1], position, normal);
+        float totalImportance = leftImportance + rightImportance;
+        if (totalImportance <= 0.0)
+            return NO_LIGHT;
+
+        float leftProbability = leftImportance / totalImportance;
+        if (randomFloat(rngState) < leftProbability) {
+            nodeIndex = left;
+            pdf *= leftProbability;
         }
         else {
-            diffuse = vec3( 0.0, 0.0, 0.0 );
-            specular = vec3( 0.0, 0.0, 0.0 );
+            nodeIndex = left + 1;
+            pdf *= 1.0 - leftProbability;
         }
-        fColor += ambient + diffuse + specular;
     }
+    return lightTreeNodes[nodeIndex].leftOrFirst;
+}
+
+#if WAVEFRONT_STAGE
+// Hands a light's contribution to the shadow stage, which adds it if nothing blocks the ray, see wavefront.glsl
+void queueShadowRay(in const Ray rayToLight, in const vec3 light);
+#endif
+
+// Diffuse and specular light from one light, zero when it is behind the surface or blocked.
+// The wavefront shading stage queues a shadow ray for the light scaled by weight instead, and returns zero.
+vec3 directLight(in const HitRecord hit, in const Light light, in const vec3 normalView, float weight)
+{
+    vec3 lightVec;
+    if (light.position.w != 0)
+        lightVec = light.position.xyz - hit.intersection.xyz;
+    else
+        lightVec = -light.position.xyz;
+
+    vec3 lightDirection = normalize(lightVec);
+    float nDotL = dot(normalView, lightDirection);
+
+    // Surfaces facing away from the light get no direct light whether or not it is blocked
+    if (nDotL <= 0)
+        return vec3( 0.0, 0.0, 0.0 );
+
+    // Shoot ray towards light source, any hit before it means shadow.
+    Ray rayToLight;
+    rayToLight.start = vec4(hit.intersection.xyz, 1.0);
+    rayToLight.direction = vec4(lightVec, 0.0);
+    // Need 'skin' width to avoid hitting itself.
+    rayToLight.start += 0.01 * vec4(lightDirection, 0);
+
+#if !WAVEFRONT_STAGE
+    if (occluded(rayToLight, 1.0))
+        return vec3( 0.0, 0.0, 0.0 );
+#endif
+
+    vec3 viewVec = normalize(camera.toWorld[3].xyz - hit.intersection.xyz);
+    vec3 reflectVec = normalize(reflect(-lightDirection, normalView));
+    float rDotV = max(dot(reflectVec, viewVec), 0.0f);
+
+    vec3 diffuse = hit.mat.diffuse * light.diffuse * nDotL;
+    vec3 specular = hit.mat.specular * light.specular * pow(rDotV, max(hit.mat.shininess, 1.0));
+#if WAVEFRONT_STAGE
+    queueShadowRay(rayToLight, weight * (diffuse + specular));
+    return vec3( 0.0, 0.0, 0.0 );
+#else
+    return diffuse + specular;
+#endif
+}
+
+vec3 shade(in HitRecord hit, inout uint rngState)
+{
+    vec3 normalView = normalize(hit.normal);
+    vec3 fColor = vec3( 0.0, 0.0, 0.0 );
+
+#if LIGHT_SAMPLES > 0
+    // Ambient light is never blocked, every light's share of it is summed on the host
+    fColor += hit.mat.ambient * ambientLight;
+
+    // Each sample stands in for every point light, weighted by how likely it was to be picked.
+    // Progressive accumulation averages the noise away over the frame's samples.
+    vec3 sampledColor = vec3( 0.0, 0.0, 0.0 );
+    for (uint sampleIndex = 0; sampleIndex < uint(LIGHT_SAMPLES); ++sampleIndex) {
+        float pdf;
+        uint lightIndex = sampleLightTree(hit.intersection.xyz, normalView, rngState, pdf);
+        if (lightIndex != NO_LIGHT)
+            sampledColor += directLight(hit, lights[lightIndex], normalView, 1.0 / (pdf * float(LIGHT_SAMPLES))) / pdf;
+    }
+    // Clamping an estimate would bias it, only the accumulated pixel is clamped, on readback
+    return fColor + sampledColor / float(LIGHT_SAMPLES);
+#else
+#ifdef FIXED_LIGHT_COUNT
+    for (uint lightIndex = 0; lightIndex < FIXED_LIGHT_COUNT; ++lightIndex) {
+#else
+    for (uint lightIndex = 0; lightIndex < uint(lights.length()); ++lightIndex) {
+#endif
+        const Light light = lights[lightIndex];
+        fColor += hit.mat.ambient * light.ambient + directLight(hit, light, normalView, 1.0);
+    }
+#endif
     return vec3(min(fColor.x, 1.f), min(fColor.y, 1.f), min(fColor.z, 1.f));
 }
 
+#if !WAVEFRONT_STAGE
 void getFragmentRay(out Ray ray)
 {
     const float halfWidth = camera.frameSize.x / 2.0f;
     const float halfHeight = camera.frameSize.y / 2.0f;
 
-    ray.start = vec4( 0.0, 0.0, 0.0, 1.0 );
-    ray.direction = vec4(gl_FragCoord.x - halfWidth, gl_FragCoord.y - halfHeight, -(halfHeight / tan(camera.fov)), 0.);
+    const vec2 fragCoord = gl_FragCoord.xy + camera.tileOffset + camera.jitter;
+
+    ray.start = camera.toWorld * vec4( 0.0, 0.0, 0.0, 1.0 );
+    ray.direction = camera.toWorld * vec4(fragCoord.x - halfWidth, fragCoord.y - halfHeight, -(halfHeight / tan(camera.fov)), 0.);
 }
 
 out vec4 diffuseColor;
 
-void main() {
+// rngState seeds the light sampling of every hit along the pixel's path
+vec3 tracePixel(inout uint rngState) {
     Ray ray;
     getFragmentRay(ray);
 
@@ -235,17 +884,15 @@ void main() {
     hit.time = MAX_FLOAT;
 
     if (!raycast(ray, hit))
-    {
-        diffuseColor = vec4(0.0, 0.0, 0.0, 1.0);
-        return;
-    }
+        return vec3(0.0, 0.0, 0.0);
 
     vec3 absorbColor = vec3( 0.0, 0.0, 0.0 ), reflectColor = vec3( 0.0, 0.0, 0.0 ), transparencyColor = vec3( 0.0, 0.0, 0.0 );
 
-    absorbColor = hit.mat.absorption * shade(hit);
+    absorbColor = hit.mat.absorption * shade(hit, rngState);
     float absorptionPercent = hit.mat.absorption;
 
     uint bounces = 0;
+#if HAS_REFLECTIONS
     Ray reflectionRay;
     reflectionRay.start = hit.intersection;
     reflectionRay.direction = vec4(hit.reflection, 0.f);
@@ -255,7 +902,7 @@ void main() {
 
     while (bounces++ < MAX_BOUNCES && absorptionPercent <= 0.999f && raycast(reflectionRay, reflectionHit))
     {
-        reflectColor = shade(reflectionHit);
+        reflectColor = shade(reflectionHit, rngState);
         float reflectedAbsorption = (1.f - absorptionPercent) * reflectionHit.mat.absorption;
         absorbColor += reflectedAbsorption * reflectColor;
         absorptionPercent += reflectedAbsorption;
@@ -266,12 +913,43 @@ void main() {
         reflectionRay.start += vec4(normalize(reflectionRay.direction.xyz), 0.f) * 0.001f;
         reflectionHit.time = MAX_FLOAT;
     }
+#endif
 
     if (bounces == 0 && absorptionPercent < 1.f)
         absorbColor += (1.f - absorptionPercent) * reflectColor;
 
-    diffuseColor = vec4(absorbColor, 1.f);
+    return absorbColor;
+}
+
+void main() {
+    // Differs per pixel of the full frame and per progressive sample
+    uvec2 pixel = uvec2(gl_FragCoord.xy + camera.tileOffset);
+    uint rngState = pcgHash(pixel.x + pcgHash(pixel.y + pcgHash(accumulatedSamples)));
+    vec3 color = tracePixel(rngState);
+#if COST_OUTPUT
+    // Raw counts for CostHeatmap, which needs a float target. Every raycast after the primary one follows a reflection.
+    color = vec3(float(countedNodeTests + countedPrimitiveTests), float(countedRaycasts - 1u), float(countedShadowRays));
+#endif
+
+    // Blend into the running mean of the previous samples, read from the other ping-pong target
+    if (accumulatedSamples > 0u)
+    {
+        vec3 previous = texelFetch(accumulation, ivec2(gl_FragCoord.xy), 0).rgb;
+        color = previous + (color - previous) / float(accumulatedSamples + 1u);
+    }
+
+    diffuseColor = vec4(color, 1.f);
+
+#if COUNT_RAYS
+    // Every raycast after the primary one follows a reflection
+    addRayCount(PRIMARY_RAYS, 1u);
+    addRayCount(BOUNCE_RAYS, countedRaycasts - 1u);
+    addRayCount(SHADOW_RAYS, countedShadowRays);
+    addRayCount(NODE_TESTS, countedNodeTests);
+    addRayCount(PRIMITIVE_TESTS, countedPrimitiveTests);
+#endif
 }
+#endif
 
 bool intersectsWithBoxSide(inout float tMin, inout float tMax, float start, float dir)
 {
@@ -0,0 +1,272 @@
+// Wavefront path tracing, compiled after shade_and_reflect.glsl once per stage with WAVEFRONT_STAGE set (see
+// WavefrontPipeline). Instead of one fragment tracing a whole path, each stage is its own dispatch over a queue of
+// live paths, so lanes never wait on a neighbour's deeper bounce chain or hold registers for code they skip.
+// Stages append to the queues with atomics, which keeps them compact and provides the next stage's group count.
+
+#define STAGE_RAY_GENERATION 1
+#define STAGE_EXTENSION 2
+#define STAGE_SHADING 3
+#define STAGE_SHADOWS 4
+#define STAGE_RESOLVE 5
+
+// Must match WAVEFRONT_GROUP_SIZE in WavefrontPipeline.cpp
+#define WAVEFRONT_GROUP_SIZE 64u
+layout(local_size_x = 64) in;
+
+// Laid out as glDispatchComputeIndirect arguments, followed by the number of entries
+struct QueueHeader {
+    uint groupsX, groupsY, groupsZ;
+    uint count;
+};
+
+// Queues hold path indices: the rays to extend, ping-ponged between bounces, and the hits to shade
+const uint RAY_QUEUE = 0u, HIT_QUEUE = 2u, SHADOW_QUEUE = 3u;
+
+// One pixel of the current wave. The fragment shader keeps all of this in registers for the whole path.
+struct PathState {
+    HitRecord hit;
+    // The next ray to extend
+    Ray ray;
+    vec3 absorbColor;
+    float absorptionPercent;
+    // Light of the last hit, added to absorbColor once its shadow rays have been traced. The shadow stage adds
+    // unblocked lights to pendingLight in fixed point, GLSL has no portable floating point atomics.
+    vec3 pendingAmbient;
+    float pendingWeight;
+    uvec3 pendingLight;
+    uint rngState;
+    uint bounces;
+};
+
+struct ShadowRay {
+    Ray ray;
+    // Scaled by the light's sampling weight
+    vec3 light;
+    uint path;
+};
+
+layout(std430, binding = 12) buffer WavefrontQueueBuffer {
+    QueueHeader queueHeaders[4];
+    // The two ray queues, then the hit queue, each waveCapacity entries
+    uint queueEntries[];
+};
+layout(std430, binding = 13) buffer PathBuffer {
+    PathState paths[];
+};
+layout(std430, binding = 14) buffer ShadowRayBuffer {
+    ShadowRay shadowRays[];
+};
+
+// Paths of the frame traced by this wave, starting at pixel waveStart of the renderSize target in row order
+uniform uint waveStart, waveSize, waveCapacity;
+uniform uvec2 renderSize;
+uniform uint shadowRayCapacity;
+// Which of the two ray queues is extended this bounce, shading fills the other
+uniform uint rayQueueParity;
+
+layout(rgba32f, binding = 0) uniform writeonly image2D wavefrontOutput;
+
+// 16 fractional bits, sums saturate at 65536 instead of wrapping, far beyond what any pixel keeps after its clamp
+const float LIGHT_FIXED_POINT_SCALE = 65536.0;
+// Largest float below 2^32, the most a single term converts to
+const float LIGHT_FIXED_POINT_MAX = 4294967040.0;
+
+// Appends to a queue, counting a new workgroup for the stage that consumes it whenever one fills up
+uint pushQueue(uint queue)
+{
+    uint index = atomicAdd(queueHeaders[queue].count, 1u);
+    if (index % WAVEFRONT_GROUP_SIZE == 0u)
+        atomicAdd(queueHeaders[queue].groupsX, 1u);
+    return index;
+}
+
+// The entries of queue start after the previous queues
+uint queueEntry(uint queue, uint index)
+{
+    return queue * waveCapacity + index;
+}
+
+// Adds the last hit's light to the path, once the shadow stage has traced its rays
+void resolvePendingLight(uint path)
+{
+    vec3 light = paths[path].pendingAmbient + vec3(paths[path].pendingLight) / LIGHT_FIXED_POINT_SCALE;
+#if LIGHT_SAMPLES == 0
+    // The same clamp as shade(), sampled estimates are only clamped with the accumulated pixel
+    light = min(light, vec3(1.0));
+#endif
+    paths[path].absorbColor += paths[path].pendingWeight * light;
+    paths[path].pendingAmbient = vec3(0.0);
+    paths[path].pendingWeight = 0.0;
+    paths[path].pendingLight = uvec3(0u);
+}
+
+#if WAVEFRONT_STAGE == STAGE_SHADING
+// The path being shaded, read by queueShadowRay
+uint shadingPath;
+
+void queueShadowRay(in const Ray rayToLight, in const vec3 light)
+{
+    uint index = pushQueue(SHADOW_QUEUE);
+    // Sized for the most shadow rays a hit can cast, see WavefrontPipeline::SetPrograms
+    if (index >= shadowRayCapacity)
+        return;
+
+    shadowRays[index].ray = rayToLight;
+    shadowRays[index].light = light;
+    shadowRays[index].path = shadingPath;
+}
+#elif WAVEFRONT_STAGE
+// Only the shading stage queues shadow rays
+void queueShadowRay(in const Ray rayToLight, in const vec3 light)
+{
+}
+#endif
+
+#if WAVEFRONT_STAGE == STAGE_RAY_GENERATION
+// Starts a path per pixel of the wave, from the same ray and seed as the fragment shader's
+void main()
+{
+    uint path = gl_GlobalInvocationID.x;
+    if (path >= waveSize)
+        return;
+
+    uint pixelIndex = waveStart + path;
+    uvec2 localPixel = uvec2(pixelIndex % renderSize.x, pixelIndex / renderSize.x);
+    vec2 fragCoord = vec2(localPixel) + 0.5 + camera.tileOffset + camera.jitter;
+    const float halfWidth = camera.frameSize.x / 2.0f;
+    const float halfHeight = camera.frameSize.y / 2.0f;
+
+    paths[path].ray.start = camera.toWorld * vec4( 0.0, 0.0, 0.0, 1.0 );
+    paths[path].ray.direction = camera.toWorld * vec4(fragCoord.x - halfWidth, fragCoord.y - halfHeight, -(halfHeight / tan(camera.fov)), 0.);
+    paths[path].absorbColor = vec3(0.0);
+    paths[path].absorptionPercent = 0.0;
+    paths[path].pendingAmbient = vec3(0.0);
+    paths[path].pendingWeight = 0.0;
+    paths[path].pendingLight = uvec3(0u);
+    uvec2 pixel = localPixel + uvec2(camera.tileOffset);
+    paths[path].rngState = pcgHash(pixel.x + pcgHash(pixel.y + pcgHash(accumulatedSamples)));
+    paths[path].bounces = 0u;
+
+    queueEntries[queueEntry(RAY_QUEUE, pushQueue(RAY_QUEUE))] = path;
+}
+#endif
+
+#if WAVEFRONT_STAGE == STAGE_EXTENSION
+// Finds the closest hit of every queued ray, paths that miss end here
+void main()
+{
+    uint queue = RAY_QUEUE + rayQueueParity;
+    if (gl_GlobalInvocationID.x >= queueHeaders[queue].count)
+        return;
+
+    uint path = queueEntries[queueEntry(queue, gl_GlobalInvocationID.x)];
+    HitRecord hit;
+    hit.time = MAX_FLOAT;
+    if (raycast(paths[path].ray, hit)) {
+        paths[path].hit = hit;
+        queueEntries[queueEntry(HIT_QUEUE, pushQueue(HIT_QUEUE))] = path;
+    }
+
+#if COUNT_RAYS
+    if (paths[path].bounces == 0u)
+        addRayCount(PRIMARY_RAYS, 1u);
+    else
+        addRayCount(BOUNCE_RAYS, 1u);
+    addRayCount(NODE_TESTS, countedNodeTests);
+    addRayCount(PRIMITIVE_TESTS, countedPrimitiveTests);
+#endif
+}
+#endif
+
+#if WAVEFRONT_STAGE == STAGE_SHADING
+// Shades every hit without its shadow rays, which are queued for the shadow stage, and queues the reflection
+void main()
+{
+    if (gl_GlobalInvocationID.x >= queueHeaders[HIT_QUEUE].count)
+        return;
+
+    uint path = queueEntries[queueEntry(HIT_QUEUE, gl_GlobalInvocationID.x)];
+    shadingPath = path;
+    // The previous hit's shadow rays have been traced since it was shaded
+    resolvePendingLight(path);
+
+    HitRecord hit = paths[path].hit;
+    uint rngState = paths[path].rngState;
+    // The primary hit's weight is its absorption, the same as the fragment shader's first shade()
+    float absorptionPercent = paths[path].absorptionPercent;
+    float reflectedAbsorption = (1.f - absorptionPercent) * hit.mat.absorption;
+    paths[path].pendingAmbient = shade(hit, rngState);
+    paths[path].pendingWeight = reflectedAbsorption;
+    absorptionPercent += reflectedAbsorption;
+    paths[path].absorptionPercent = absorptionPercent;
+    paths[path].rngState = rngState;
+
+#if HAS_REFLECTIONS
+    uint bounces = paths[path].bounces;
+    paths[path].bounces = bounces + 1u;
+    if (bounces < MAX_BOUNCES && absorptionPercent <= 0.999f) {
+        paths[path].ray.start = hit.intersection;
+        paths[path].ray.direction = vec4(hit.reflection, 0.f);
+        paths[path].ray.start += vec4(normalize(hit.reflection), 0.f) * 0.001f;
+        uint queue = RAY_QUEUE + 1u - rayQueueParity;
+        queueEntries[queueEntry(queue, pushQueue(queue))] = path;
+    }
+#endif
+}
+#endif
+
+#if WAVEFRONT_STAGE == STAGE_SHADOWS
+// Adds to the path's fixed point light, saturating each channel once its sum passes the range
+void addPendingLight(uint path, uvec3 light)
+{
+    // An add wraps exactly when the old value is above 2^32 - 1 minus the term. Saturated sums stay saturated,
+    // every later add to them wraps and sets the maximum again.
+    if (atomicAdd(paths[path].pendingLight.x, light.x) > 0xffffffffu - light.x)
+        atomicMax(paths[path].pendingLight.x, 0xffffffffu);
+    if (atomicAdd(paths[path].pendingLight.y, light.y) > 0xffffffffu - light.y)
+        atomicMax(paths[path].pendingLight.y, 0xffffffffu);
+    if (atomicAdd(paths[path].pendingLight.z, light.z) > 0xffffffffu - light.z)
+        atomicMax(paths[path].pendingLight.z, 0xffffffffu);
+}
+
+// Adds the light of every shadow ray that reaches its light
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= min(queueHeaders[SHADOW_QUEUE].count, shadowRayCapacity))
+        return;
+
+    if (!occluded(shadowRays[index].ray, 1.0)) {
+        vec3 light = min(shadowRays[index].light * LIGHT_FIXED_POINT_SCALE + 0.5, vec3(LIGHT_FIXED_POINT_MAX));
+        addPendingLight(shadowRays[index].path, uvec3(light));
+    }
+
+#if COUNT_RAYS
+    addRayCount(SHADOW_RAYS, 1u);
+    addRayCount(NODE_TESTS, countedNodeTests);
+    addRayCount(PRIMITIVE_TESTS, countedPrimitiveTests);
+#endif
+}
+#endif
+
+#if WAVEFRONT_STAGE == STAGE_RESOLVE
+// Writes each path's colour, blended into the running mean like the fragment shader's output
+void main()
+{
+    uint path = gl_GlobalInvocationID.x;
+    if (path >= waveSize)
+        return;
+
+    resolvePendingLight(path);
+    vec3 color = paths[path].absorbColor;
+
+    uint pixelIndex = waveStart + path;
+    ivec2 localPixel = ivec2(pixelIndex % renderSize.x, pixelIndex / renderSize.x);
+    if (accumulatedSamples > 0u)
+    {
+        vec3 previous = texelFetch(accumulation, localPixel, 0).rgb;
+        color = previous + (color - previous) / float(accumulatedSamples + 1u);
+    }
+    imageStore(wavefrontOutput, localPixel, vec4(color, 1.f));
+}
+#endif